@@ -62,9 +62,9 @@ if [ ! -z "$MISSING_TOOLS" ]; then
     print_error "Missing required tools:$MISSING_TOOLS"
     print_error "Please install the required dependencies."
     echo
-    echo "Ubuntu/Debian: sudo apt install build-essential cmake qt6-base-dev qt6-tools-dev"
-    echo "Fedora/RHEL:   sudo dnf install gcc-c++ cmake qt6-qtbase-devel qt6-qttools-devel"
-    echo "Arch Linux:    sudo pacman -S base-devel cmake qt6-base qt6-tools"
+    echo "Ubuntu/Debian: sudo apt install build-essential cmake qt6-base-dev qt6-tools-dev zlib1g-dev libbz2-dev liblzma-dev libzstd-dev"
+    echo "Fedora/RHEL:   sudo dnf install gcc-c++ cmake qt6-qtbase-devel qt6-qttools-devel zlib-devel bzip2-devel xz-devel libzstd-devel"
+    echo "Arch Linux:    sudo pacman -S base-devel cmake qt6-base qt6-tools zlib bzip2 xz zstd"
     exit 1
 fi
 
@@ -49,7 +49,7 @@ chmod 644 /usr/share/applications/linux-image-burner.desktop
 # Install polkit policy
 print_status "Installing polkit policy..."
 if [ -d "/usr/share/polkit-1/actions" ]; then
-    cp org.linuxburner.image-burner.policy /usr/share/polkit-1/actions/
+    cp build/org.linuxburner.image-burner.policy /usr/share/polkit-1/actions/
     chmod 644 /usr/share/polkit-1/actions/org.linuxburner.image-burner.policy
     print_status "Polkit policy installed - application can now request privileges as needed"
 else
@@ -0,0 +1,311 @@
+#include "Blake3.h"
+#include <QtEndian>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QVector>
+#include <QPair>
+#include <string.h>
+
+// Domain flags of the compression function
+static const quint32 ChunkStart = 1 << 0;
+static const quint32 ChunkEnd = 1 << 1;
+static const quint32 Parent = 1 << 2;
+static const quint32 Root = 1 << 3;
+
+static const quint32 IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// Parallel hashing does not bother with subtrees smaller than this many chunks per thread
+static const quint64 MinimumSubtreeChunks = 16;
+
+static const int MessagePermutation[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+
+static inline quint32 rotateRight(quint32 value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline void mix(quint32 *state, int a, int b, int c, int d, quint32 x, quint32 y)
+{
+    state[a] = state[a] + state[b] + x;
+    state[d] = rotateRight(state[d] ^ state[a], 16);
+    state[c] = state[c] + state[d];
+    state[b] = rotateRight(state[b] ^ state[c], 12);
+    state[a] = state[a] + state[b] + y;
+    state[d] = rotateRight(state[d] ^ state[a], 8);
+    state[c] = state[c] + state[d];
+    state[b] = rotateRight(state[b] ^ state[c], 7);
+}
+
+static void compress(const quint32 *chainingValue, const quint32 *blockWords, quint64 counter,
+                     quint32 blockLength, quint32 flags, quint32 *out)
+{
+    quint32 state[16] = {
+        chainingValue[0], chainingValue[1], chainingValue[2], chainingValue[3],
+        chainingValue[4], chainingValue[5], chainingValue[6], chainingValue[7],
+        IV[0], IV[1], IV[2], IV[3],
+        quint32(counter), quint32(counter >> 32), blockLength, flags
+    };
+    quint32 message[16];
+    memcpy(message, blockWords, sizeof(message));
+    
+    for (int round = 0; round < 7; ++round) {
+        mix(state, 0, 4, 8, 12, message[0], message[1]);
+        mix(state, 1, 5, 9, 13, message[2], message[3]);
+        mix(state, 2, 6, 10, 14, message[4], message[5]);
+        mix(state, 3, 7, 11, 15, message[6], message[7]);
+        mix(state, 0, 5, 10, 15, message[8], message[9]);
+        mix(state, 1, 6, 11, 12, message[10], message[11]);
+        mix(state, 2, 7, 8, 13, message[12], message[13]);
+        mix(state, 3, 4, 9, 14, message[14], message[15]);
+        
+        quint32 permuted[16];
+        for (int i = 0; i < 16; ++i) {
+            permuted[i] = message[MessagePermutation[i]];
+        }
+        memcpy(message, permuted, sizeof(message));
+    }
+    
+    for (int i = 0; i < 8; ++i) {
+        out[i] = state[i] ^ state[i + 8];
+        out[i + 8] = state[i + 8] ^ chainingValue[i];
+    }
+}
+
+static void wordsFromBytes(const quint8 *bytes, quint32 *words)
+{
+    for (int i = 0; i < 16; ++i) {
+        words[i] = qFromLittleEndian<quint32>(bytes + 4 * i);
+    }
+}
+
+Blake3::Blake3()
+{
+    reset();
+}
+
+void Blake3::reset()
+{
+    memcpy(m_chunkValue, IV, sizeof(m_chunkValue));
+    m_chunkCounter = 0;
+    memset(m_block, 0, sizeof(m_block));
+    m_blockLength = 0;
+    m_blocksCompressed = 0;
+    m_stackLength = 0;
+}
+
+void Blake3::addData(const char *data, qint64 length)
+{
+    const quint8 *input = reinterpret_cast<const quint8 *>(data);
+    
+    while (length > 0) {
+        // A full chunk is only finished once more input shows it is not the last one
+        if (m_blocksCompressed * BlockLength + m_blockLength == ChunkLength) {
+            finishChunk();
+        }
+        
+        // Likewise a full block is only compressed once there is more after it
+        if (m_blockLength == BlockLength) {
+            compressBlock();
+        }
+        
+        int take = int(qMin<qint64>(BlockLength - m_blockLength, length));
+        memcpy(m_block + m_blockLength, input, take);
+        m_blockLength += take;
+        input += take;
+        length -= take;
+    }
+}
+
+void Blake3::addDataParallel(const char *data, qint64 length)
+{
+    QThreadPool *pool = QThreadPool::globalInstance();
+    int threads = pool->maxThreadCount();
+    qint64 chunkLength = m_blocksCompressed * BlockLength + m_blockLength;
+    
+    // Subtrees start at a chunk boundary, so the chunk under way is completed first
+    if (chunkLength > 0 && chunkLength < ChunkLength) {
+        qint64 take = qMin<qint64>(ChunkLength - chunkLength, length);
+        addData(data, take);
+        data += take;
+        length -= take;
+    }
+    
+    // The last chunk stays with addData(): it may be the root, which is hashed differently
+    quint64 chunks = length > 0 ? quint64(length - 1) / ChunkLength : 0;
+    if (threads < 2 || chunks < quint64(threads) * MinimumSubtreeChunks) {
+        addData(data, length);
+        return;
+    }
+    if (m_blocksCompressed * BlockLength + m_blockLength == ChunkLength) {
+        finishChunk();
+    }
+    
+    // Subtrees are powers of two in size and aligned to their size; as large as
+    // still gives every thread one, then smaller ones for what is left
+    quint64 maxSubtree = 1;
+    while (maxSubtree * 2 <= chunks / threads) {
+        maxSubtree *= 2;
+    }
+    QVector<QPair<quint64, quint64>> subtrees;
+    quint64 first = m_chunkCounter;
+    quint64 end = first + chunks;
+    for (quint64 position = first; position < end; ) {
+        quint64 size = maxSubtree;
+        while (position % size != 0 || position + size > end) {
+            size /= 2;
+        }
+        subtrees.append(qMakePair(position, size));
+        position += size;
+    }
+    
+    // Workers and the calling thread take subtrees in turn until none are left
+    QVector<quint32> values(subtrees.count() * 8);
+    QAtomicInt next(0);
+    QSemaphore done;
+    const quint8 *input = reinterpret_cast<const quint8 *>(data);
+    auto work = [&]() {
+        int index;
+        while ((index = next.fetchAndAddRelaxed(1)) < subtrees.count()) {
+            const QPair<quint64, quint64> &subtree = subtrees[index];
+            subtreeValue(input + (subtree.first - first) * ChunkLength, subtree.first, subtree.second,
+                         values.data() + index * 8);
+        }
+    };
+    
+    int helpers = qMin(threads, int(subtrees.count())) - 1;
+    for (int i = 0; i < helpers; ++i) {
+        pool->start([&]() {
+            work();
+            done.release();
+        });
+    }
+    work();
+    done.acquire(helpers);
+    
+    for (int i = 0; i < subtrees.count(); ++i) {
+        pushSubtree(values.constData() + i * 8, subtrees[i].first, subtrees[i].second);
+    }
+    m_chunkCounter = end;
+    
+    qint64 hashed = qint64(chunks) * ChunkLength;
+    addData(data + hashed, length - hashed);
+}
+
+void Blake3::finishChunk()
+{
+    quint32 chainingValue[8];
+    chainingValueOf(chunkOutput(), chainingValue);
+    pushSubtree(chainingValue, m_chunkCounter, 1);
+    ++m_chunkCounter;
+    
+    memcpy(m_chunkValue, IV, sizeof(m_chunkValue));
+    memset(m_block, 0, sizeof(m_block));
+    m_blockLength = 0;
+    m_blocksCompressed = 0;
+}
+
+void Blake3::pushSubtree(const quint32 *chainingValue, quint64 firstChunk, quint64 chunks)
+{
+    // Every completed pair of subtrees merges into their parent; a subtree is
+    // aligned to its size, so the count of chunks so far says how often
+    quint32 value[8];
+    memcpy(value, chainingValue, sizeof(value));
+    quint64 totalChunks = firstChunk + chunks;
+    while (chunks > 1) {
+        totalChunks >>= 1;
+        chunks >>= 1;
+    }
+    while ((totalChunks & 1) == 0) {
+        chainingValueOf(parentOutput(m_stack[--m_stackLength], value), value);
+        totalChunks >>= 1;
+    }
+    memcpy(m_stack[m_stackLength++], value, sizeof(value));
+}
+
+void Blake3::subtreeValue(const quint8 *data, quint64 firstChunk, quint64 chunks, quint32 *chainingValue)
+{
+    if (chunks > 1) {
+        quint32 children[16];
+        subtreeValue(data, firstChunk, chunks / 2, children);
+        subtreeValue(data + chunks / 2 * ChunkLength, firstChunk + chunks / 2, chunks / 2, children + 8);
+        chainingValueOf(parentOutput(children, children + 8), chainingValue);
+        return;
+    }
+    
+    memcpy(chainingValue, IV, 8 * sizeof(quint32));
+    for (int block = 0; block < ChunkLength / BlockLength; ++block) {
+        quint32 blockWords[16];
+        quint32 out[16];
+        quint32 flags = (block == 0 ? ChunkStart : 0) | (block == ChunkLength / BlockLength - 1 ? ChunkEnd : 0);
+        wordsFromBytes(data + block * BlockLength, blockWords);
+        compress(chainingValue, blockWords, firstChunk, BlockLength, flags, out);
+        memcpy(chainingValue, out, 8 * sizeof(quint32));
+    }
+}
+
+void Blake3::compressBlock()
+{
+    quint32 blockWords[16];
+    quint32 out[16];
+    wordsFromBytes(m_block, blockWords);
+    compress(m_chunkValue, blockWords, m_chunkCounter, BlockLength,
+             m_blocksCompressed == 0 ? ChunkStart : 0, out);
+    memcpy(m_chunkValue, out, sizeof(m_chunkValue));
+    
+    ++m_blocksCompressed;
+    memset(m_block, 0, sizeof(m_block));
+    m_blockLength = 0;
+}
+
+Blake3::Output Blake3::chunkOutput() const
+{
+    Output output;
+    memcpy(output.chainingValue, m_chunkValue, sizeof(output.chainingValue));
+    wordsFromBytes(m_block, output.blockWords);
+    output.counter = m_chunkCounter;
+    output.blockLength = quint32(m_blockLength);
+    output.flags = ChunkEnd | (m_blocksCompressed == 0 ? ChunkStart : 0);
+    return output;
+}
+
+Blake3::Output Blake3::parentOutput(const quint32 *left, const quint32 *right)
+{
+    Output output;
+    memcpy(output.chainingValue, IV, sizeof(output.chainingValue));
+    memcpy(output.blockWords, left, 8 * sizeof(quint32));
+    memcpy(output.blockWords + 8, right, 8 * sizeof(quint32));
+    output.counter = 0;
+    output.blockLength = BlockLength;
+    output.flags = Parent;
+    return output;
+}
+
+void Blake3::chainingValueOf(const Output &output, quint32 *chainingValue)
+{
+    quint32 out[16];
+    compress(output.chainingValue, output.blockWords, output.counter, output.blockLength, output.flags, out);
+    memcpy(chainingValue, out, 8 * sizeof(quint32));
+}
+
+QByteArray Blake3::result() const
+{
+    // Fold the stack into the root from the right
+    Output output = chunkOutput();
+    for (int i = m_stackLength - 1; i >= 0; --i) {
+        quint32 chainingValue[8];
+        chainingValueOf(output, chainingValue);
+        output = parentOutput(m_stack[i], chainingValue);
+    }
+    
+    quint32 out[16];
+    compress(output.chainingValue, output.blockWords, 0, output.blockLength, output.flags | Root, out);
+    
+    QByteArray digest(DigestLength, 0);
+    for (int i = 0; i < 8; ++i) {
+        qToLittleEndian<quint32>(out[i], digest.data() + 4 * i);
+    }
+    return digest;
+}
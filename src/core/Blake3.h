@@ -0,0 +1,65 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// BLAKE3, which QCryptographicHash does not offer. A straightforward portable
+// implementation after the specification's reference code: one compression at
+// a time, no SIMD, hashing mode only.
+//
+// The input is split into 1 KiB chunks that are hashed independently and
+// merged pairwise into a binary tree; the stack holds the chaining values of
+// the subtrees not merged yet, one per level. Since subtrees do not depend on
+// each other, addDataParallel() hashes them on every core, which a single
+// SHA-256 stream cannot do.
+class Blake3
+{
+public:
+    static const int DigestLength = 32;
+    
+    Blake3();
+    
+    void reset();
+    void addData(const char *data, qint64 length);
+    
+    // The same digest as addData(), with whole subtrees of the data hashed on
+    // the global thread pool; for buffers of a few hundred KiB and more
+    void addDataParallel(const char *data, qint64 length);
+    
+    // Raw digest of everything added; the hash can still be added to afterwards
+    QByteArray result() const;
+
+private:
+    static const int BlockLength = 64;
+    static const int ChunkLength = 1024;
+    static const int MaxDepth = 54;             // 2^54 chunks is the most BLAKE3 allows
+    
+    struct Output {
+        quint32 chainingValue[8];
+        quint32 blockWords[16];
+        quint64 counter;
+        quint32 blockLength;
+        quint32 flags;
+    };
+    
+    void compressBlock();
+    void finishChunk();
+    void pushSubtree(const quint32 *chainingValue, quint64 firstChunk, quint64 chunks);
+    Output chunkOutput() const;
+    static void subtreeValue(const quint8 *data, quint64 firstChunk, quint64 chunks, quint32 *chainingValue);
+    static Output parentOutput(const quint32 *left, const quint32 *right);
+    static void chainingValueOf(const Output &output, quint32 *chainingValue);
+    
+    // The chunk being hashed
+    quint32 m_chunkValue[8];
+    quint64 m_chunkCounter;
+    quint8 m_block[BlockLength];
+    int m_blockLength;
+    int m_blocksCompressed;
+    
+    quint32 m_stack[MaxDepth][8];
+    int m_stackLength;
+};
+
+#endif // BLAKE3_H
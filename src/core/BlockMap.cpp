@@ -0,0 +1,215 @@
+#include "BlockMap.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QXmlStreamReader>
+#include <QDebug>
+
+// A block map larger than this is certainly not one
+static const qint64 MaxBlockMapSize = 64 * 1024 * 1024;
+
+static bool algorithmFromName(const QString &name, QCryptographicHash::Algorithm &algorithm)
+{
+    QString type = name.trimmed().toLower();
+    if (type == "sha256") {
+        algorithm = QCryptographicHash::Sha256;
+    } else if (type == "sha1") {
+        algorithm = QCryptographicHash::Sha1;
+    } else if (type == "sha512") {
+        algorithm = QCryptographicHash::Sha512;
+    } else if (type == "md5") {
+        algorithm = QCryptographicHash::Md5;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+BlockMap::BlockMap()
+    : m_valid(false)
+    , m_imageSize(0)
+    , m_blockSize(0)
+    , m_mappedBytes(0)
+    , m_hasChecksums(false)
+    , m_algorithm(QCryptographicHash::Sha256)
+{
+}
+
+QString BlockMap::findForImage(const QString &imagePath)
+{
+    QFileInfo imageInfo(imagePath);
+    QStringList candidates;
+    candidates << imagePath + ".bmap";
+    candidates << imageInfo.absolutePath() + "/" + imageInfo.completeBaseName() + ".bmap";
+    
+    for (const QString &candidate : candidates) {
+        if (QFileInfo(candidate).isFile()) {
+            return candidate;
+        }
+    }
+    return QString();
+}
+
+bool BlockMap::load(const QString &filePath)
+{
+    m_filePath = filePath;
+    m_valid = false;
+    m_errorString.clear();
+    m_imageSize = 0;
+    m_blockSize = 0;
+    m_mappedBytes = 0;
+    m_hasChecksums = false;
+    m_ranges.clear();
+    
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(QString("Cannot open block map: %1").arg(file.errorString()));
+    }
+    if (file.size() > MaxBlockMapSize) {
+        return fail("Block map file is too large");
+    }
+    
+    if (!parse(file.readAll())) {
+        return false;
+    }
+    
+    m_valid = true;
+    return true;
+}
+
+double BlockMap::mappedFraction() const
+{
+    if (m_imageSize <= 0) {
+        return 1.0;
+    }
+    return double(m_mappedBytes) / double(m_imageSize);
+}
+
+ByteRangeList BlockMap::byteRanges() const
+{
+    ByteRangeList list;
+    for (const Range &range : m_ranges) {
+        list.add(range.offset, range.length);
+    }
+    return list;
+}
+
+bool BlockMap::parse(const QByteArray &data)
+{
+    QXmlStreamReader xml(data);
+    QString version;
+    QByteArray fileChecksum;
+    qint64 mappedBlocks = -1;
+    bool checksumTypeSeen = false;
+    
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement) {
+            continue;
+        }
+        
+        QString name = xml.name().toString();
+        if (name == "bmap") {
+            version = xml.attributes().value("version").toString();
+        } else if (name == "ImageSize") {
+            m_imageSize = xml.readElementText().trimmed().toLongLong();
+        } else if (name == "BlockSize") {
+            m_blockSize = xml.readElementText().trimmed().toLongLong();
+        } else if (name == "MappedBlocksCount") {
+            mappedBlocks = xml.readElementText().trimmed().toLongLong();
+        } else if (name == "ChecksumType") {
+            if (!algorithmFromName(xml.readElementText(), m_algorithm)) {
+                return fail("Unsupported block map checksum type");
+            }
+            checksumTypeSeen = true;
+        } else if (name == "BmapFileChecksum" || name == "BmapFileSHA1") {
+            fileChecksum = xml.readElementText().trimmed().toLatin1().toLower();
+        } else if (name == "Range") {
+            // Format 1.x names the attribute after its fixed SHA-1 checksum
+            QByteArray checksum = xml.attributes().value("chksum").toString().toLatin1();
+            if (checksum.isEmpty()) {
+                checksum = xml.attributes().value("sha1").toString().toLatin1();
+                if (!checksum.isEmpty() && !checksumTypeSeen) {
+                    m_algorithm = QCryptographicHash::Sha1;
+                }
+            }
+            if (m_blockSize <= 0 || m_imageSize <= 0) {
+                return fail("Block map lists ranges before the image and block size");
+            }
+            if (!addRange(xml.readElementText(), checksum.trimmed().toLower())) {
+                return false;
+            }
+        }
+    }
+    
+    if (xml.hasError()) {
+        return fail(QString("Malformed block map: %1").arg(xml.errorString()));
+    }
+    if (!version.startsWith('1') && !version.startsWith('2')) {
+        return fail(QString("Unsupported block map version '%1'").arg(version));
+    }
+    if (mappedBlocks >= 0 && (m_mappedBytes + m_blockSize - 1) / m_blockSize != mappedBlocks) {
+        return fail("Block map range list does not match its mapped block count");
+    }
+    if (!fileChecksum.isEmpty() && !checkFileChecksum(data, fileChecksum)) {
+        return false;
+    }
+    
+    return true;
+}
+
+bool BlockMap::addRange(const QString &text, const QByteArray &checksum)
+{
+    QString range = text.trimmed();
+    bool firstOk = false;
+    bool lastOk = true;
+    qint64 first = range.section('-', 0, 0).trimmed().toLongLong(&firstOk);
+    qint64 last = range.contains('-') ? range.section('-', 1, 1).trimmed().toLongLong(&lastOk) : first;
+    
+    if (!firstOk || !lastOk || first < 0 || last < first) {
+        return fail(QString("Invalid block map range '%1'").arg(range));
+    }
+    
+    Range entry;
+    entry.offset = first * m_blockSize;
+    if (entry.offset >= m_imageSize) {
+        return fail(QString("Block map range '%1' lies outside the image").arg(range));
+    }
+    
+    // The last block of the image may be partial
+    entry.length = qMin((last + 1) * m_blockSize, m_imageSize) - entry.offset;
+    entry.checksum = checksum;
+    
+    if (!m_ranges.isEmpty() && entry.offset < m_ranges.last().offset + m_ranges.last().length) {
+        return fail("Block map ranges overlap or are out of order");
+    }
+    
+    m_hasChecksums = m_hasChecksums || !checksum.isEmpty();
+    m_mappedBytes += entry.length;
+    m_ranges.append(entry);
+    return true;
+}
+
+bool BlockMap::checkFileChecksum(const QByteArray &data, const QByteArray &expected)
+{
+    // bmaptool hashes the file with its own checksum field replaced by zeros
+    int position = data.toLower().indexOf(expected);
+    if (position < 0) {
+        return fail("Block map checksum field is malformed");
+    }
+    
+    QByteArray zeroed = data;
+    zeroed.replace(position, expected.size(), QByteArray(expected.size(), '0'));
+    
+    QCryptographicHash::Algorithm algorithm = expected.size() == 40 ? QCryptographicHash::Sha1 : m_algorithm;
+    QByteArray actual = QCryptographicHash::hash(zeroed, algorithm).toHex();
+    if (actual != expected) {
+        return fail("Block map file is corrupted (checksum mismatch)");
+    }
+    return true;
+}
+
+bool BlockMap::fail(const QString &message)
+{
+    m_errorString = message;
+    qWarning() << "BlockMap:" << m_filePath << message;
+    return false;
+}
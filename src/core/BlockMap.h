@@ -0,0 +1,61 @@
+#ifndef BLOCKMAP_H
+#define BLOCKMAP_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include "ByteRange.h"
+
+// Reader for bmaptool block maps (.bmap, format 1.x and 2.0) as shipped with
+// Yocto and Tizen images. Only the mapped ranges hold data; everything else
+// in the image is free space that does not need to be written.
+class BlockMap
+{
+public:
+    struct Range {
+        qint64 offset;
+        qint64 length;
+        QByteArray checksum;    // Lower case hex, empty when the map has none
+    };
+    
+    BlockMap();
+    
+    bool load(const QString &filePath);
+    
+    // Looks for image.img.bmap, then image.bmap next to the image
+    static QString findForImage(const QString &imagePath);
+    
+    bool isValid() const { return m_valid; }
+    QString errorString() const { return m_errorString; }
+    QString filePath() const { return m_filePath; }
+    
+    qint64 imageSize() const { return m_imageSize; }
+    qint64 blockSize() const { return m_blockSize; }
+    qint64 mappedBytes() const { return m_mappedBytes; }
+    double mappedFraction() const;
+    
+    bool hasChecksums() const { return m_hasChecksums; }
+    QCryptographicHash::Algorithm checksumAlgorithm() const { return m_algorithm; }
+    const QVector<Range> &ranges() const { return m_ranges; }
+    ByteRangeList byteRanges() const;
+
+private:
+    bool parse(const QByteArray &data);
+    bool addRange(const QString &text, const QByteArray &checksum);
+    bool checkFileChecksum(const QByteArray &data, const QByteArray &expected);
+    bool fail(const QString &message);
+    
+    QString m_filePath;
+    bool m_valid;
+    QString m_errorString;
+    
+    qint64 m_imageSize;
+    qint64 m_blockSize;
+    qint64 m_mappedBytes;
+    bool m_hasChecksums;
+    QCryptographicHash::Algorithm m_algorithm;
+    QVector<Range> m_ranges;
+};
+
+#endif // BLOCKMAP_H
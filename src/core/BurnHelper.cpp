@@ -0,0 +1,601 @@
+#include "BurnHelper.h"
+#include "WriteEngine.h"
+#include "Verifier.h"
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFileInfo>
+#include <QDir>
+#include <QVector>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+// pkexec says who asked for the burn, sudo does too; otherwise it is whoever runs the helper
+static uid_t invokingUser()
+{
+    for (const char *variable : {"PKEXEC_UID", "SUDO_UID"}) {
+        bool ok = false;
+        uint uid = qEnvironmentVariable(variable).toUInt(&ok);
+        if (ok) {
+            return uid_t(uid);
+        }
+    }
+    return getuid();
+}
+
+static int openAsUser(const QString &path, uid_t uid)
+{
+    QByteArray localPath = path.toLocal8Bit();
+    if (uid == 0) {
+        return open(localPath.constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    struct passwd *user = getpwuid(uid);
+    if (!user) {
+        return -1;
+    }
+    
+    int count = 0;
+    getgrouplist(user->pw_name, user->pw_gid, nullptr, &count);
+    QVector<gid_t> groups(qMax(count, 1));
+    int savedCount = getgroups(0, nullptr);
+    QVector<gid_t> savedGroups(qMax(savedCount, 1));
+    if (getgrouplist(user->pw_name, user->pw_gid, groups.data(), &count) < 0 || savedCount < 0
+        || getgroups(savedCount, savedGroups.data()) != savedCount) {
+        return -1;
+    }
+    gid_t savedGid = getegid();
+    
+    // Open the file as the user for a moment, so the kernel applies their
+    // permissions and those of every directory on the way
+    int fd = -1;
+    if (setgroups(count, groups.data()) == 0 && setegid(user->pw_gid) == 0 && seteuid(uid) == 0) {
+        fd = open(localPath.constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    }
+    
+    // Root again, or the device cannot be written either
+    if (seteuid(0) != 0 || setegid(savedGid) != 0 || setgroups(savedCount, savedGroups.data()) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+// Whether anything on the disk or one of its partitions is mounted, used as
+// swap, or held by the device mapper (LUKS, LVM)
+static bool diskInUse(const QString &diskSysfs)
+{
+    for (const char *table : {"/proc/self/mounts", "/proc/swaps"}) {
+        QFile file(table);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+        for (const QByteArray &line : file.readAll().split('\n')) {
+            QByteArray source = line.split(' ').first();
+            struct stat st;
+            if (!source.startsWith("/dev/") || stat(source.constData(), &st) != 0 || !S_ISBLK(st.st_mode)) {
+                continue;
+            }
+            QString sysfs = QFileInfo(QString("/sys/dev/block/%1:%2").arg(major(st.st_rdev)).arg(minor(st.st_rdev)))
+                            .canonicalFilePath();
+            if (sysfs == diskSysfs || sysfs.startsWith(diskSysfs + "/")) {
+                return true;
+            }
+        }
+    }
+    
+    QDir disk(diskSysfs);
+    QStringList holders = QStringList() << "holders";
+    for (const QString &entry : disk.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        if (QFileInfo::exists(disk.filePath(entry + "/partition"))) {
+            holders << entry + "/holders";
+        }
+    }
+    for (const QString &holder : holders) {
+        if (!QDir(disk.filePath(holder)).entryList(QDir::AllEntries | QDir::NoDotAndDotDot).isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+BurnHelper::BurnHelper(QObject *parent)
+    : QObject(parent)
+    , m_inputNotifier(nullptr)
+    , m_engine(nullptr)
+    , m_jobReceived(false)
+    , m_runningVerifiers(0)
+    , m_writeSucceeded(false)
+{
+    m_output.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered);
+}
+
+BurnHelper::~BurnHelper()
+{
+    if (m_engine) {
+        m_engine->cancel();
+        m_engine->wait();
+    }
+    qDeleteAll(m_verifiers);
+}
+
+QString BurnHelper::helperArgument()
+{
+    return "--burn-helper";
+}
+
+bool BurnHelper::isHelperInvocation(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (helperArgument() == QLatin1String(argv[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QByteArray BurnHelper::encodeJob(const BurnOptions &options)
+{
+    QJsonObject job;
+    job["imagePath"] = options.imagePath;
+    job["devicePath"] = options.devicePath;
+    job["additionalDevicePaths"] = QJsonArray::fromStringList(options.additionalDevicePaths);
+    job["mode"] = static_cast<int>(options.mode);
+    job["writeBackend"] = static_cast<int>(options.writeBackend);
+    job["queueDepth"] = options.queueDepth;
+    job["blockSize"] = options.blockSize;
+    job["autotune"] = options.autotune;
+    job["bufferedWrites"] = options.bufferedWrites;
+    job["dirtyLimit"] = options.dirtyLimit;
+    job["sparseMode"] = static_cast<int>(options.sparseMode);
+    job["recordSkippedRanges"] = options.recordSkippedRanges;
+    job["bmapPath"] = options.bmapPath;
+    job["repairRanges"] = options.repairRanges.toString();
+    job["resumeOffset"] = options.resumeOffset;
+    job["resumeHash"] = QString::fromLatin1(options.resumeHash);
+    job["verifyAfterBurn"] = options.verifyAfterBurn;
+    job["verifyOnly"] = options.verifyOnly;
+    job["verifyWhileWriting"] = options.verifyWhileWriting;
+    job["verifySample"] = options.verifySample;
+    job["verifySampleSeed"] = qint64(options.verifySampleSeed);
+    job["verifyHash"] = static_cast<int>(options.verifyHash);
+    job["imageDigest"] = QString::fromLatin1(options.imageDigest);
+    
+    return QJsonDocument(job).toJson(QJsonDocument::Compact);
+}
+
+bool BurnHelper::decodeJob(const QByteArray &job, BurnOptions &options)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(job, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        return false;
+    }
+    
+    QJsonObject object = doc.object();
+    options.imagePath = object["imagePath"].toString();
+    options.devicePath = object["devicePath"].toString();
+    options.additionalDevicePaths.clear();
+    for (const QJsonValue &value : object["additionalDevicePaths"].toArray()) {
+        if (!value.toString().startsWith("/dev/")) {
+            return false;
+        }
+        options.additionalDevicePaths << value.toString();
+    }
+    options.mode = static_cast<BurnMode>(object["mode"].toInt());
+    options.writeBackend = static_cast<WriteBackend>(object["writeBackend"].toInt());
+    options.queueDepth = object["queueDepth"].toInt(options.queueDepth);
+    options.blockSize = object["blockSize"].toInt(options.blockSize);
+    options.autotune = object["autotune"].toBool();
+    options.bufferedWrites = object["bufferedWrites"].toBool();
+    options.dirtyLimit = qMax<qint64>(1024 * 1024, object["dirtyLimit"].toInteger(options.dirtyLimit));
+    options.sparseMode = static_cast<SparseMode>(object["sparseMode"].toInt());
+    options.recordSkippedRanges = object["recordSkippedRanges"].toBool();
+    options.bmapPath = object["bmapPath"].toString();
+    options.repairRanges = ByteRangeList::fromString(object["repairRanges"].toString());
+    options.resumeOffset = object["resumeOffset"].toInteger();
+    options.resumeHash = object["resumeHash"].toString().toLatin1();
+    options.verifyAfterBurn = object["verifyAfterBurn"].toBool();
+    options.verifyOnly = object["verifyOnly"].toBool();
+    options.verifyWhileWriting = object["verifyWhileWriting"].toBool();
+    options.verifySample = qBound(0.0, object["verifySample"].toDouble(), 1.0);
+    options.verifySampleSeed = quint32(object["verifySampleSeed"].toInteger());
+    options.verifyHash = static_cast<VerifyHash>(object["verifyHash"].toInt());
+    options.imageDigest = object["imageDigest"].toString().toLatin1();
+    
+    return !options.imagePath.isEmpty() && options.devicePath.startsWith("/dev/");
+}
+
+void BurnHelper::start()
+{
+    m_inputNotifier = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(m_inputNotifier, &QSocketNotifier::activated, this, &BurnHelper::onInputReady);
+}
+
+void BurnHelper::onInputReady()
+{
+    char data[4096];
+    ssize_t count = read(STDIN_FILENO, data, sizeof(data));
+    
+    if (count < 0 && errno == EINTR) {
+        return;
+    }
+    
+    if (count <= 0) {
+        // The GUI went away; never keep writing a device nobody is watching
+        m_inputNotifier->setEnabled(false);
+        if (m_jobReceived) {
+            cancelJob();
+        } else {
+            finish(false, "No burn job received");
+        }
+        return;
+    }
+    
+    m_inputBuffer.append(data, count);
+    
+    int newline;
+    while ((newline = m_inputBuffer.indexOf('\n')) >= 0) {
+        QByteArray line = m_inputBuffer.left(newline).trimmed();
+        m_inputBuffer.remove(0, newline + 1);
+        handleLine(line);
+    }
+}
+
+void BurnHelper::handleLine(const QByteArray &line)
+{
+    if (!m_jobReceived) {
+        m_jobReceived = true;
+        startJob(line);
+        return;
+    }
+    
+    if (line == "cancel") {
+        cancelJob();
+    }
+}
+
+void BurnHelper::cancelJob()
+{
+    if (m_engine) {
+        m_engine->cancel();
+    }
+    for (Verifier *verifier : m_verifiers) {
+        if (verifier) {
+            verifier->cancel();
+        }
+    }
+}
+
+bool BurnHelper::checkJob(BurnOptions &options, QString &error)
+{
+    uid_t uid = invokingUser();
+    for (QString *path : {&options.imagePath, &options.bmapPath}) {
+        if (path->isEmpty()) {
+            continue;
+        }
+        int fd = openAsUser(*path, uid);
+        if (fd < 0) {
+            error = QString("%1 is not readable by the user who started the burn").arg(*path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            error = QString("%1 is not a file").arg(*path);
+            return false;
+        }
+        
+        // The descriptor stays open for the rest of the job, and everything
+        // opens the file through it; the path being swapped for a link to
+        // another file after this check changes nothing
+        *path = QString("/proc/self/fd/%1").arg(fd);
+    }
+    
+    QStringList devicePaths;
+    for (const QString &path : QStringList(options.devicePath) + options.additionalDevicePaths) {
+        QString canonical = QFileInfo(path).canonicalFilePath();
+        struct stat st;
+        if (!canonical.startsWith("/dev/") || stat(canonical.toLocal8Bit().constData(), &st) != 0
+            || !S_ISBLK(st.st_mode)) {
+            error = QString("%1 is not a block device").arg(path);
+            return false;
+        }
+        
+        QString sysfs = QString("/sys/dev/block/%1:%2").arg(major(st.st_rdev)).arg(minor(st.st_rdev));
+        if (QFileInfo::exists(sysfs + "/partition")) {
+            error = QString("%1 is a partition, not a whole device").arg(path);
+            return false;
+        }
+        // Reading a device back is harmless even while the desktop has it mounted again
+        if (!options.verifyOnly && diskInUse(QFileInfo(sysfs).canonicalFilePath())) {
+            error = QString("%1 is in use; unmount it first").arg(path);
+            return false;
+        }
+        devicePaths << canonical;
+    }
+    options.devicePath = devicePaths.takeFirst();
+    options.additionalDevicePaths = devicePaths;
+    return true;
+}
+
+void BurnHelper::startJob(const QByteArray &job)
+{
+    BurnOptions options;
+    if (!decodeJob(job, options)) {
+        finish(false, "Invalid burn job");
+        return;
+    }
+    
+    QString error;
+    if (!checkJob(options, error)) {
+        finish(false, error);
+        return;
+    }
+    
+    if (options.verifyOnly) {
+        QList<int> targets;
+        for (int i = 0; i <= options.additionalDevicePaths.count(); ++i) {
+            targets << i;
+        }
+        m_writeSucceeded = true;
+        startVerification(options, targets);
+        return;
+    }
+    
+    m_engine = new WriteEngine(options, this);
+    connect(m_engine, &WriteEngine::progressChanged, this, &BurnHelper::onEngineProgress);
+    connect(m_engine, &WriteEngine::statusChanged, this, &BurnHelper::onEngineStatus);
+    connect(m_engine, &WriteEngine::targetProgressChanged, this, &BurnHelper::onTargetProgress);
+    connect(m_engine, &WriteEngine::targetFailed, this, &BurnHelper::onTargetFailed);
+    connect(m_engine, &WriteEngine::checkpointReached, this, &BurnHelper::onCheckpointReached);
+    connect(m_engine, &WriteEngine::targetTuned, this, &BurnHelper::onTargetTuned);
+    connect(m_engine, &QThread::finished, this, &BurnHelper::onEngineFinished);
+    m_engine->start();
+}
+
+void BurnHelper::onEngineProgress(qint64 bytesWritten, qint64 totalBytes)
+{
+    sendEvent("progress", QString("%1 %2").arg(bytesWritten).arg(totalBytes));
+}
+
+void BurnHelper::onEngineStatus(const QString &status)
+{
+    sendEvent("status", status);
+}
+
+void BurnHelper::onTargetProgress(int target, qint64 bytesWritten, const QString &state)
+{
+    sendEvent("device", QString("%1 %2 %3").arg(target).arg(bytesWritten).arg(state));
+}
+
+void BurnHelper::onTargetFailed(int target, const QString &message)
+{
+    sendEvent("device-error", QString("%1 %2").arg(target).arg(message));
+}
+
+void BurnHelper::onCheckpointReached(int target, qint64 offset, const QByteArray &hash)
+{
+    sendEvent("checkpoint", QString("%1 %2 %3").arg(target).arg(offset).arg(QString::fromLatin1(hash)));
+}
+
+void BurnHelper::onTargetTuned(int target, qint64 requestSize, int queueDepth, qint64 bytesPerSecond)
+{
+    sendEvent("tuned", QString("%1 %2 %3 %4").arg(target).arg(requestSize).arg(queueDepth).arg(bytesPerSecond));
+}
+
+void BurnHelper::onEngineFinished()
+{
+    if (m_engine->isSuccessful()) {
+        if (m_engine->options().recordSkippedRanges && !m_engine->skippedRanges().isEmpty()) {
+            sendEvent("skipped", m_engine->skippedRanges().toString());
+        }
+        if (!m_engine->imageDigest().isEmpty()) {
+            sendEvent("digest", StreamDigest::algorithmName(m_engine->options().verifyHash) + " "
+                                + QString::fromLatin1(m_engine->imageDigest()));
+        }
+    }
+    
+    if (m_engine->isCancelled()) {
+        finish(false, "Operation cancelled");
+        return;
+    }
+    
+    m_writeSucceeded = m_engine->isSuccessful();
+    m_writeError = m_engine->errorString();
+    
+    // Devices that were written in full are checked even when another one failed
+    QList<int> written;
+    for (int i = 0; i < m_engine->targetCount(); ++i) {
+        if (!m_engine->isTargetDone(i)) {
+            continue;
+        }
+        if (m_engine->isDeltaWrite()) {
+            sendEvent("rewritten", QString("%1 %2").arg(i).arg(m_engine->changedBytes(i)));
+            
+            // Every chunk of an unchanged device was just read back and compared
+            if (m_engine->changedBytes(i) == 0) {
+                if (m_engine->options().verifyAfterBurn) {
+                    sendEvent("verified", QString("%1 ok").arg(i));
+                }
+                continue;
+            }
+        }
+        written << i;
+    }
+    
+    if (m_engine->options().verifyAfterBurn && !written.isEmpty() && m_engine->isVerifiedWhileWriting()) {
+        reportVerifiedWhileWriting(written);
+    } else if (m_engine->options().verifyAfterBurn && !written.isEmpty()) {
+        startVerification(m_engine->options(), written);
+    } else {
+        finish(m_writeSucceeded, m_writeError);
+    }
+}
+
+void BurnHelper::startVerification(const BurnOptions &options, const QList<int> &targets)
+{
+    QStringList devicePaths = QStringList() << options.devicePath << options.additionalDevicePaths;
+    
+    for (int i = 0; i < devicePaths.count(); ++i) {
+        m_verifiers << nullptr;
+        m_verifiedBytes << 0;
+    }
+    
+    // All devices are read back at once; each one is limited by its own bus anyway
+    for (int index : targets) {
+        Verifier *verifier = new Verifier(options.imagePath, devicePaths[index]);
+        verifier->setBlockMap(options.bmapPath);
+        verifier->setRanges(options.repairRanges);
+        verifier->setSample(options.verifySample, options.verifySampleSeed);
+        verifier->setDigestAlgorithm(options.verifyHash);
+        verifier->setImageDigest(options.imageDigest);
+        if (m_engine) {
+            verifier->setImageDigest(m_engine->imageDigest());
+            verifier->setImageLeaves(m_engine->imageLeaves());
+            verifier->setImageSize(m_engine->imageSize());
+            verifier->setZeroRanges(m_engine->skippedRanges());
+        }
+        connect(verifier, &Verifier::progressChanged, this, &BurnHelper::onVerifierProgress);
+        connect(verifier, &Verifier::statusChanged, this, &BurnHelper::onEngineStatus);
+        connect(verifier, &QThread::finished, this, &BurnHelper::onVerifierFinished);
+        m_verifiers[index] = verifier;
+        ++m_runningVerifiers;
+    }
+    
+    for (Verifier *verifier : m_verifiers) {
+        if (verifier) {
+            verifier->start();
+        }
+    }
+}
+
+void BurnHelper::reportVerifiedWhileWriting(const QList<int> &targets)
+{
+    // The devices were read back behind the writer; only the results are left
+    sendEvent("verify-progress", QString("%1 %1").arg(m_engine->imageSize()));
+    
+    for (int index : targets) {
+        QString error = m_engine->targetVerifyError(index);
+        if (error.isEmpty()) {
+            sendEvent("verified", QString("%1 ok").arg(index));
+            continue;
+        }
+        if (!m_engine->targetMismatches(index).isEmpty()) {
+            sendEvent("mismatch", QString("%1 %2").arg(index).arg(m_engine->targetMismatches(index).toString()));
+        }
+        sendEvent("verified", QString("%1 failed %2").arg(index).arg(error));
+        m_verifyErrors << (m_engine->targetCount() == 1 ? error : m_engine->targetPath(index) + ": " + error);
+    }
+    
+    if (!m_writeSucceeded) {
+        finish(false, m_writeError);
+    } else if (!m_verifyErrors.isEmpty()) {
+        finish(false, "Verification failed: " + m_verifyErrors.join("; "));
+    } else {
+        finish(true, QString());
+    }
+}
+
+void BurnHelper::onVerifierProgress(qint64 bytesVerified, qint64 totalBytes)
+{
+    Verifier *verifier = qobject_cast<Verifier *>(sender());
+    int index = m_verifiers.indexOf(verifier);
+    if (index < 0) {
+        return;
+    }
+    m_verifiedBytes[index] = bytesVerified;
+    
+    // Like writing, overall progress is the average over the devices being checked
+    qint64 total = 0;
+    int count = 0;
+    for (int i = 0; i < m_verifiers.count(); ++i) {
+        if (m_verifiers[i]) {
+            total += m_verifiedBytes[i];
+            ++count;
+        }
+    }
+    sendEvent("verify-progress", QString("%1 %2").arg(total / count).arg(totalBytes));
+    
+    if (m_verifiers.count() > 1) {
+        sendEvent("device", QString("%1 %2 verifying").arg(index).arg(bytesVerified));
+    }
+}
+
+void BurnHelper::onVerifierFinished()
+{
+    Verifier *verifier = qobject_cast<Verifier *>(sender());
+    int index = m_verifiers.indexOf(verifier);
+    if (index < 0) {
+        return;
+    }
+    
+    // An image the write did not hash, or that was only verified, was hashed here
+    if ((!m_engine || m_engine->imageDigest().isEmpty()) && !verifier->imageDigest().isEmpty()) {
+        sendEvent("digest", StreamDigest::algorithmName(verifier->digestAlgorithm()) + " "
+                            + QString::fromLatin1(verifier->imageDigest()));
+    }
+    
+    if (verifier->sampledBytes() > 0) {
+        sendEvent("sampled", QString("%1 %2 %3 %4").arg(index).arg(verifier->sampledBytes())
+                             .arg(verifier->sampleBaseBytes()).arg(verifier->sampleDetectableDamage()));
+    }
+    if (verifier->isSuccessful()) {
+        sendEvent("verified", QString("%1 ok").arg(index));
+    } else if (!verifier->isCancelled()) {
+        if (!verifier->mismatches().isEmpty()) {
+            sendEvent("mismatch", QString("%1 %2").arg(index).arg(verifier->mismatches().toString()));
+        }
+        sendEvent("verified", QString("%1 failed %2").arg(index).arg(verifier->errorString()));
+        m_verifyErrors << (m_verifiers.count() == 1 ? verifier->errorString()
+                                                    : verifier->devicePath() + ": " + verifier->errorString());
+    }
+    
+    if (--m_runningVerifiers > 0) {
+        return;
+    }
+    
+    bool cancelled = false;
+    for (Verifier *each : m_verifiers) {
+        cancelled = cancelled || (each && each->isCancelled());
+    }
+    
+    if (cancelled) {
+        finish(false, "Operation cancelled");
+    } else if (!m_writeSucceeded) {
+        finish(false, m_writeError);
+    } else if (!m_verifyErrors.isEmpty()) {
+        finish(false, "Verification failed: " + m_verifyErrors.join("; "));
+    } else {
+        finish(true, QString());
+    }
+}
+
+void BurnHelper::sendEvent(const QString &event, const QString &arguments)
+{
+    QString line = event;
+    if (!arguments.isEmpty()) {
+        line += ' ' + QString(arguments).replace('\n', ' ');
+    }
+    line += '\n';
+    
+    m_output.write(line.toUtf8());
+}
+
+void BurnHelper::finish(bool success, const QString &message)
+{
+    if (!success) {
+        sendEvent("error", message);
+    }
+    
+    emit finished(success ? 0 : 1);
+}
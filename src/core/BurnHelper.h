@@ -0,0 +1,118 @@
+#ifndef BURNHELPER_H
+#define BURNHELPER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include "Burner.h"
+
+class QSocketNotifier;
+class WriteEngine;
+class Verifier;
+
+// Privileged side of a burn. Burner re-executes the application through
+// pkexec with helperArgument(); the helper reads a JSON job line from stdin,
+// runs the WriteEngine and reports back with one event per stdout line:
+//
+//   status <text>             human readable phase description
+//   progress <bytes> <total>  exact byte count acknowledged by the device
+//   skipped <ranges>          zero ranges that were not written, as
+//                             "offset+length,..." (when requested)
+//   digest <algorithm> <hex>  digest of the whole image, hashed while writing
+//   checkpoint <index> <offset> <hash>
+//                             everything before offset is flushed to device
+//                             <index>; hash identifies the image data there
+//   error <text>              reason for a failed job
+//
+// Jobs for several devices also report each one by its index in the job
+// (0 is devicePath, then additionalDevicePaths in order):
+//
+//   device <index> <bytes> <state>  writing, detached, flushing, done or failed
+//   device-error <index> <text>     that device failed; the others carry on
+//
+// Delta jobs (BurnMode::DeltaMode) report for every device that finished how
+// much of it differed from the image and was written; devices reported with 0
+// were already up to date and are not read back again:
+//
+//   rewritten <index> <bytes>
+//
+// With autotune each device reports the write settings it settled on once it
+// has tried them all, with the throughput it reached (bytes per second):
+//
+//   tuned <index> <blockSize> <queueDepth> <throughput>
+//
+// With verifyAfterBurn every device that was written is then read back, or
+// with verifyWhileWriting already was during the write, in which case a single
+// verify-progress line precedes the results:
+//
+//   verify-progress <bytes> <total> bytes read back so far, per device
+//   verified <index> ok|failed [text]
+//                                   result for one device
+//
+// A verifyOnly job skips writing and only reads the devices back.
+//
+// Further stdin lines are commands ("cancel"). EOF on stdin cancels the job.
+class BurnHelper : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BurnHelper(QObject *parent = nullptr);
+    ~BurnHelper();
+    
+    static QString helperArgument();
+    static bool isHelperInvocation(int argc, char *argv[]);
+    
+    // Job serialization shared by both sides of the pipe
+    static QByteArray encodeJob(const BurnOptions &options);
+    static bool decodeJob(const QByteArray &job, BurnOptions &options);
+    
+    // The helper runs as root on whatever a job names, so before it starts:
+    // files are opened as the user who asked for the burn and handed on as
+    // /proc/self/fd paths, and devices must be whole disks with nothing on
+    // them mounted. Device paths come back canonical.
+    static bool checkJob(BurnOptions &options, QString &error);
+
+public slots:
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onInputReady();
+    void onEngineProgress(qint64 bytesWritten, qint64 totalBytes);
+    void onEngineStatus(const QString &status);
+    void onTargetProgress(int target, qint64 bytesWritten, const QString &state);
+    void onTargetFailed(int target, const QString &message);
+    void onCheckpointReached(int target, qint64 offset, const QByteArray &hash);
+    void onTargetTuned(int target, qint64 requestSize, int queueDepth, qint64 bytesPerSecond);
+    void onEngineFinished();
+    void onVerifierProgress(qint64 bytesVerified, qint64 totalBytes);
+    void onVerifierFinished();
+
+private:
+    void handleLine(const QByteArray &line);
+    void startJob(const QByteArray &job);
+    void startVerification(const BurnOptions &options, const QList<int> &targets);
+    void reportVerifiedWhileWriting(const QList<int> &targets);
+    void cancelJob();
+    void sendEvent(const QString &event, const QString &arguments = QString());
+    void finish(bool success, const QString &message);
+    
+    QSocketNotifier *m_inputNotifier;
+    QFile m_output;
+    QByteArray m_inputBuffer;
+    WriteEngine *m_engine;
+    bool m_jobReceived;
+    
+    // Verification, one Verifier per device by job index; null for devices not checked
+    QList<Verifier *> m_verifiers;
+    QList<qint64> m_verifiedBytes;
+    int m_runningVerifiers;
+    bool m_writeSucceeded;
+    QString m_writeError;
+    QStringList m_verifyErrors;
+};
+
+#endif // BURNHELPER_H
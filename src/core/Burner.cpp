@@ -1,27 +1,49 @@
 #include "Burner.h"
 #include "DeviceManager.h"
+#include "BurnHelper.h"
+#include "BlockMap.h"
+#include "ImageSource.h"
+#include "ChecksumCache.h"
+#include "VerifySample.h"
+#include <QCoreApplication>
 #include <QDebug>
 #include <QFileInfo>
 #include <QDateTime>
-#include <QCryptographicHash>
 #include <QThread>
 #include <QTextStream>
 #include <QFile>
 #include <QDir>
-#include <QRegularExpression>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QRandomGenerator>
+#include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 #include <sys/statvfs.h>
 
+// Reading back faster than this is not timed, it was done while writing
+static const qint64 MinimumVerifyMs = 1000;
+
+// Logged, so a quick verification can be repeated over the same sample
+static quint32 newSampleSeed()
+{
+    quint32 seed = QRandomGenerator::global()->bounded(1u, 0xFFFFFFFFu);
+    qDebug() << "Verification sample seed" << seed;
+    return seed;
+}
+
 Burner::Burner(QObject *parent)
     : QObject(parent)
     , m_isBurning(false)
     , m_isPaused(false)
     , m_isCancelled(false)
+    , m_isVerifying(false)
+    , m_resumePending(false)
     , m_process(nullptr)
     , m_progressTimer(new QTimer(this))
     , m_totalBytes(0)
+    , m_verifyTotalBytes(0)
     , m_bytesWritten(0)
     , m_lastBytesWritten(0)
     , m_lastUpdateTime()
@@ -33,8 +55,12 @@ Burner::Burner(QObject *parent)
 Burner::~Burner()
 {
     if (m_process && m_process->state() != QProcess::NotRunning) {
-        m_process->kill();
-        m_process->waitForFinished(3000);
+        // The helper runs as root, so ask it to stop rather than signalling it
+        sendHelperCommand("cancel");
+        m_process->closeWriteChannel();
+        if (!m_process->waitForFinished(3000)) {
+            m_process->kill();
+        }
     }
 }
 
@@ -50,9 +76,42 @@ void Burner::burnImage(const BurnOptions &options)
     m_currentOptions = options;
     m_isBurning = true;
     m_isPaused = false;
+    m_resumePending = false;
     m_isCancelled = false;
+    m_isVerifying = false;
     m_bytesWritten = 0;
     m_lastBytesWritten = 0;
+    m_skippedRanges.clear();
+    m_sampleSummary.clear();
+    m_devices.clear();
+    m_verifyFailures.clear();
+    
+    DeviceManager deviceManager;
+    for (const QString &devicePath : QStringList() << options.devicePath << options.additionalDevicePaths) {
+        DeviceInfo info = deviceManager.getDeviceInfo(devicePath);
+        CheckpointJournal journal(options.imagePath, options.bmapPath, info);
+        DeviceProgress device = {devicePath, 0, 0, QDateTime(), QString(), "writing", journal};
+        device.stats = DeviceStats(devicePath);
+        device.stats.sample();
+        device.profile = DeviceProfile(info);
+        device.profile.load();
+        m_devices.append(device);
+    }
+    
+    if (options.autotune) {
+        applyTunedSettings(m_currentOptions);
+    }
+    useCachedDigest(m_currentOptions);
+    // recordBurn() leaves skipped ranges out of the write speed
+    m_currentOptions.recordSkippedRanges = m_currentOptions.sparseMode != SparseMode::Off;
+    if (m_currentOptions.verifyAfterBurn && m_currentOptions.verifySampleSeed == 0) {
+        m_currentOptions.verifySampleSeed = newSampleSeed();
+    }
+    
+    // A fresh burn makes any older checkpoint for these devices meaningless
+    if (options.resumeOffset == 0) {
+        removeCheckpoints(false);
+    }
     
     // Get image size
     QFileInfo imageInfo(options.imagePath);
@@ -62,25 +121,38 @@ void Burner::burnImage(const BurnOptions &options)
         return;
     }
     
-    m_totalBytes = imageInfo.size();
+    // Unknown for gzip and bzip2 images until the helper reports it with progress
+    m_totalBytes = ImageSource::imageSize(options.imagePath);
     m_startTime = QDateTime::currentDateTime();
     m_lastUpdateTime = m_startTime;
+    m_writeStartTime = QDateTime();
+    m_verifyStartTime = QDateTime();
+    m_progressTimer->setInterval(qMax(50, options.statsIntervalMs));
     
     emit burnStarted();
     emit statusChanged("Preparing device...");
     
-    // Prepare the device
-    if (!prepareDevice(options.devicePath, options)) {
-        emit error("Failed to prepare device");
-        m_isBurning = false;
-        return;
+    // Prepare every device before anything is written; a resumed burn only
+    // needs them unmounted, partitioning would destroy what is already there
+    for (const DeviceProgress &device : m_devices) {
+        bool prepared = options.resumeOffset > 0 ? unmountDevice(device.devicePath)
+                                                 : prepareDevice(device.devicePath, options);
+        if (!prepared) {
+            emit error(m_devices.count() == 1 ? QString("Failed to prepare device")
+                                              : QString("Failed to prepare device %1").arg(device.devicePath));
+            m_isBurning = false;
+            return;
+        }
     }
     
     // Start burning based on mode
     bool success = false;
-    switch (options.mode) {
+    switch (options.resumeOffset > 0 ? BurnMode::DDMode : options.mode) {
         case BurnMode::DDMode:
-            success = burnWithDD(options);
+            success = burnWithDD(m_currentOptions);
+            break;
+        case BurnMode::DeltaMode:
+            success = burnWithDelta(m_currentOptions);
             break;
         case BurnMode::UEFIMode:
             success = burnWithUEFI(options);
@@ -89,7 +161,7 @@ void Burner::burnImage(const BurnOptions &options)
             success = burnWithWindowsToGo(options);
             break;
         default:
-            success = burnWithDD(options);
+            success = burnWithDD(m_currentOptions);
             break;
     }
     
@@ -132,66 +204,239 @@ void Burner::formatDevice(const QString &devicePath, FileSystem fs, const QStrin
     emit burnFinished(true, "Device formatted successfully");
 }
 
-void Burner::verifyBurn(const QString &imagePath, const QString &devicePath)
+void Burner::verifyBurn(const QString &imagePath, const QString &devicePath, VerifyHash verifyHash, double sample)
 {
-    emit verificationStarted();
-    emit statusChanged("Verifying burn...");
+    if (m_isBurning) {
+        emit error("Operation already in progress");
+        return;
+    }
+    
+    // Reading the device needs root as much as writing it, so the helper does this too
+    BurnOptions options{};
+    options.imagePath = imagePath;
+    options.devicePath = devicePath;
+    options.mode = BurnMode::DDMode;
+    options.verifyAfterBurn = true;
+    options.verifyOnly = true;
+    options.verifyHash = verifyHash;
+    options.verifySample = sample;
+    options.verifySampleSeed = sample > 0 ? newSampleSeed() : 0;
+    useCachedDigest(options);
+    
+    m_currentOptions = options;
+    m_isBurning = true;
+    m_isPaused = false;
+    m_resumePending = false;
+    m_isCancelled = false;
+    m_isVerifying = false;
+    m_bytesWritten = 0;
+    m_lastBytesWritten = 0;
+    m_totalBytes = ImageSource::imageSize(imagePath);
+    m_sampleSummary.clear();
+    m_devices.clear();
+    m_devices.append({devicePath, 0, 0, QDateTime(), QString(), "done", CheckpointJournal()});
+    m_verifyFailures.clear();
+    
+    if (!startHelper(BurnHelper::encodeJob(options))) {
+        emit verificationFinished(false, "Failed to start verification");
+        m_isBurning = false;
+        return;
+    }
+    
+    m_progressTimer->start();
+}
+
+ByteRangeList Burner::mismatchedRanges() const
+{
+    ByteRangeList ranges;
+    for (const DeviceProgress &device : m_devices) {
+        for (const ByteRange &range : device.mismatches.ranges()) {
+            ranges.add(range);
+        }
+    }
+    return ranges;
+}
+
+QStringList Burner::mismatchedDevices() const
+{
+    QStringList devicePaths;
+    for (const DeviceProgress &device : m_devices) {
+        if (!device.mismatches.isEmpty()) {
+            devicePaths << device.devicePath;
+        }
+    }
+    return devicePaths;
+}
+
+void Burner::repair()
+{
+    QStringList devicePaths = mismatchedDevices();
+    if (devicePaths.isEmpty()) {
+        emit error("No device differs from the image");
+        return;
+    }
     
-    bool success = verifyImageChecksum(imagePath, devicePath);
+    // The same image and devices; the rest of each device already matched, so
+    // one pass over the differing ranges of all of them does
+    BurnOptions options = m_currentOptions;
+    options.devicePath = devicePaths.takeFirst();
+    options.additionalDevicePaths = devicePaths;
+    options.repairRanges = mismatchedRanges();
+    options.mode = BurnMode::DDMode;
+    options.verifyAfterBurn = true;
+    options.verifyWhileWriting = false;
+    options.verifyOnly = false;
+    options.verifySample = 0.0;
+    options.resumeOffset = 0;
+    options.resumeHash.clear();
+    options.sparseMode = SparseMode::Off;
+    options.autotune = false;
+    burnImage(options);
+}
+
+bool Burner::findResumePoint(BurnOptions &options)
+{
+    options.resumeOffset = 0;
+    options.resumeHash.clear();
     
-    emit verificationFinished(success, success ? "Verification successful" : "Verification failed");
+    DeviceManager deviceManager;
+    qint64 resumeOffset = -1;
+    QByteArray resumeHash;
+    
+    for (const QString &devicePath : QStringList() << options.devicePath << options.additionalDevicePaths) {
+        CheckpointJournal journal(options.imagePath, options.bmapPath, deviceManager.getDeviceInfo(devicePath));
+        qint64 offset = 0;
+        QByteArray hash;
+        if (!journal.load(offset, hash)) {
+            return false;
+        }
+        
+        // Every device goes on from the earliest checkpoint among them
+        if (resumeOffset < 0 || offset < resumeOffset) {
+            resumeOffset = offset;
+            resumeHash = hash;
+        }
+    }
+    
+    options.resumeOffset = resumeOffset;
+    options.resumeHash = resumeHash;
+    return resumeOffset > 0;
 }
 
 void Burner::cancel()
 {
     QMutexLocker locker(&m_mutex);
     
+    bool wasPaused = m_isPaused;
     m_isCancelled = true;
+    m_isPaused = false;
+    m_resumePending = false;
     
-    if (m_process && m_process->state() != QProcess::NotRunning) {
-        m_process->kill();
-    }
+    // A cancelled burn is abandoned, so nothing is left to resume
+    removeCheckpoints(false);
     
-    // Clean up temporary script files
-    QDir tmpDir("/tmp");
-    QStringList scriptFiles = tmpDir.entryList(QStringList() << "burn_script_*.sh", QDir::Files);
-    for (const QString &file : scriptFiles) {
-        QFile::remove("/tmp/" + file);
+    bool helperRunning = m_process && m_process->state() != QProcess::NotRunning;
+    if (helperRunning) {
+        sendHelperCommand("cancel");
     }
     
     m_progressTimer->stop();
     emit statusChanged("Cancelled");
+    
+    // Without a helper left to exit, nobody else reports the end of the burn
+    if (wasPaused && !helperRunning && m_isBurning) {
+        emit burnFinished(false, "Operation cancelled");
+    }
     m_isBurning = false;
 }
 
 void Burner::pause()
 {
-    if (!m_isBurning || m_isPaused) {
+    // Paused again before the helper even exited, so there is nothing to stop
+    if (m_resumePending) {
+        m_resumePending = false;
+        emit statusChanged("Paused");
+        return;
+    }
+    
+    // Verification has no checkpoints to go on from
+    if (!m_isBurning || m_isPaused || m_isVerifying) {
         return;
     }
     
     m_isPaused = true;
     
+    // The helper flushes the device and reports a last checkpoint before it exits
     if (m_process && m_process->state() == QProcess::Running) {
-        m_process->kill(); // Send SIGTERM to pause
+        sendHelperCommand("cancel");
     }
     
+    m_progressTimer->stop();
     emit statusChanged("Paused");
 }
 
 void Burner::resume()
 {
-    if (!m_isBurning || !m_isPaused) {
+    if (!m_isBurning || !m_isPaused || m_resumePending) {
+        return;
+    }
+    
+    // The paused helper may still be flushing its last checkpoint; its exit picks this up
+    if (m_process && m_process->state() != QProcess::NotRunning) {
+        m_resumePending = true;
+        emit statusChanged("Waiting for the device to be flushed...");
         return;
     }
     
+    resumeBurn();
+}
+
+void Burner::resumeBurn()
+{
     m_isPaused = false;
+    relocateDevices();
+    
+    // Devices that failed stay out; the rest continue from the last checkpoint they all have
+    QList<DeviceProgress> remaining;
+    QStringList devicePaths;
+    for (const DeviceProgress &device : m_devices) {
+        if (device.state != "failed") {
+            if (!unmountDevice(device.devicePath)) {
+                emit error(QString("Failed to unmount %1").arg(device.devicePath));
+            }
+            remaining.append(device);
+            devicePaths << device.devicePath;
+        }
+    }
+    m_devices = remaining;
+    if (devicePaths.isEmpty()) {
+        emit burnFinished(false, "No device left to resume");
+        m_isBurning = false;
+        return;
+    }
+    m_currentOptions.devicePath = devicePaths.first();
+    m_currentOptions.additionalDevicePaths = devicePaths.mid(1);
     
-    // Restart the process from where it left off
-    // This is a simplified implementation - in practice, you'd need to track progress more carefully
-    burnWithDD(m_currentOptions);
+    if (!findResumePoint(m_currentOptions)) {
+        emit statusChanged("No usable checkpoint, starting over...");
+        m_bytesWritten = 0;
+        m_lastBytesWritten = 0;
+    } else {
+        emit statusChanged(QString("Resuming from %1...").arg(DeviceManager::formatSize(m_currentOptions.resumeOffset)));
+    }
     
-    emit statusChanged("Resuming...");
+    // Writing from the start again is measured from the start again
+    m_lastUpdateTime = QDateTime();
+    m_writeStartTime = QDateTime();
+    for (DeviceProgress &device : m_devices) {
+        device.eta = EtaEstimator();
+    }
+    if (burnWithDD(m_currentOptions)) {
+        m_progressTimer->start();
+    } else {
+        emit burnFinished(false, "Failed to resume burn operation");
+        m_isBurning = false;
+    }
 }
 
 void Burner::onProgressTimer()
@@ -201,42 +446,89 @@ void Burner::onProgressTimer()
     }
     
     updateProgress();
+    sampleDeviceStats();
 }
 
 void Burner::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
 {
-    Q_UNUSED(exitStatus)
-    
     m_progressTimer->stop();
     
+    // Pick up any events the helper wrote just before exiting
+    onProcessOutput();
+    
+    // A paused burn is restarted by resume(), which may have been waiting for this
+    if (m_isPaused) {
+        if (m_resumePending) {
+            m_resumePending = false;
+            resumeBurn();
+        }
+        return;
+    }
+    
+    bool success = exitStatus == QProcess::NormalExit && exitCode == 0;
+    
+    // Every burn that got as far as writing goes into the devices' history
+    if (!m_isCancelled && m_writeStartTime.isValid() && !m_currentOptions.verifyOnly
+        && m_currentOptions.repairRanges.isEmpty()) {
+        recordBurn(success);
+    }
+    
     // Ensure we show 100% when process completes successfully
-    if (exitCode == 0) {
+    if (success && !m_isCancelled) {
         emit progressChanged(100);
         emit statusChanged("USB burning completed successfully!");
     }
     
-    // Clean up temporary script files
-    QDir tmpDir("/tmp");
-    QStringList scriptFiles = tmpDir.entryList(QStringList() << "burn_script_*.sh", QDir::Files);
-    for (const QString &file : scriptFiles) {
-        QFile::remove("/tmp/" + file);
-    }
-    
     if (m_isCancelled) {
         emit burnFinished(false, "Operation cancelled");
-    } else if (exitCode == 0) {
-        // Note: We don't call syncDevice here as sync is already done in the script
+    } else if (success) {
+        removeCheckpoints(false);
         
-        if (m_currentOptions.verifyAfterBurn) {
-            verifyBurn(m_currentOptions.imagePath, m_currentOptions.devicePath);
+        // Note: We don't call syncDevice here as the helper flushes the device itself
+        
+        // A quick verification says how much it compared and what it would have caught
+        QString sampleNote = m_sampleSummary.isEmpty() ? QString() : ", " + m_sampleSummary;
+        if (m_isVerifying) {
+            emit verificationFinished(true, (m_devices.count() == 1 ? QString("Verification successful")
+                                                                    : QString("Verification successful on %1 devices").arg(m_devices.count()))
+                                            + sampleNote);
+        }
+        if (m_currentOptions.verifyOnly) {
+            emit burnFinished(true, "Verification successful" + sampleNote);
+        } else if (!m_currentOptions.repairRanges.isEmpty()) {
+            emit burnFinished(true, QString("Rewrote %1 MB that differed from the image%2")
+                                    .arg(qMax<qint64>(1, m_currentOptions.repairRanges.totalLength() / (1024 * 1024)))
+                                    .arg(m_isVerifying ? " and verified it" : ""));
+        } else if (m_currentOptions.mode == BurnMode::DeltaMode) {
+            emit burnFinished(true, deltaSummary());
         } else {
-            emit burnFinished(true, "Burn completed successfully");
+            emit burnFinished(true, m_isVerifying ? "Burn completed and verified successfully" + sampleNote
+                                                  : QString("Burn completed successfully"));
         }
+    } else if (exitCode == 126 || exitCode == 127) {
+        // pkexec reports a dismissed or denied authentication this way
+        emit burnFinished(false, "Administrator authentication was cancelled or denied");
+    } else if (m_devices.count() > 1 && !completedDevices().isEmpty()) {
+        // Failed devices dropped out on their own; the others were written in full
+        removeCheckpoints(true);
+        if (m_isVerifying) {
+            emit verificationFinished(m_verifyFailures.isEmpty(), m_verifyFailures.isEmpty()
+                                      ? QString("Verification successful on %1 devices").arg(completedDevices().count())
+                                      : QString("Verification failed on %1").arg(m_verifyFailures.join(", ")));
+        }
+        emit burnFinished(false, QString("Burn completed on %1 of %2 devices. %3")
+                                 .arg(completedDevices().count()).arg(m_devices.count()).arg(m_helperError));
+    } else if (!m_verifyFailures.isEmpty()) {
+        emit verificationFinished(false, m_helperError);
+        emit burnFinished(false, m_helperError);
+    } else if (!m_helperError.isEmpty()) {
+        emit burnFinished(false, "Burn failed: " + m_helperError);
     } else {
         emit burnFinished(false, "Burn failed with exit code " + QString::number(exitCode));
     }
     
     m_isBurning = false;
+    m_isVerifying = false;
 }
 
 void Burner::onProcessError(QProcess::ProcessError error)
@@ -266,118 +558,105 @@ void Burner::onProcessOutput()
 {
     if (!m_process) return;
     
-    // Read from both stderr and stdout
-    QByteArray stderrData = m_process->readAllStandardError();
-    QByteArray stdoutData = m_process->readAllStandardOutput();
-    
-    QString output = QString::fromUtf8(stderrData) + QString::fromUtf8(stdoutData);
-    
-    if (!output.trimmed().isEmpty()) {
-        qDebug() << "DD Output:" << output; // Debug output to see actual format
+    // Diagnostics from pkexec and the helper only go to the debug log
+    QByteArray diagnostics = m_process->readAllStandardError();
+    if (!diagnostics.trimmed().isEmpty()) {
+        qDebug() << "Burn helper:" << diagnostics.trimmed();
     }
     
-    // Parse dd progress output with status=progress
-    // DD outputs progress in different formats:
-    // Format 1: "512000000 bytes (512 MB, 488 MiB) copied, 12.3456 s, 41.5 MB/s"
-    // Format 2: "512+0 records in\n512+0 records out\n537919488 bytes (538 MB, 513 MiB) copied"
-    // Format 3: Just the bytes on a line by itself when using status=progress
+    // The helper writes one event per line, see BurnHelper.h
+    m_helperOutput += m_process->readAllStandardOutput();
     
-    QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-    
-    for (const QString &line : lines) {
-        QString trimmedLine = line.trimmed();
-        if (trimmedLine.isEmpty()) continue;
-        
-        // Try multiple regex patterns to catch different dd output formats
-        QRegularExpression patterns[] = {
-            QRegularExpression(R"((\d+)\s+bytes\s+\([^)]+\)\s+copied)"), // Standard format: "104857600 bytes (105 MB, 100 MiB) copied"
-            QRegularExpression(R"((\d+)\s+bytes.*copied)"),               // Basic format: "104857600 bytes copied"
-            QRegularExpression(R"(^(\d+)\s+bytes)"),                      // Simple: "104857600 bytes"
-            QRegularExpression(R"((\d+)\+\d+\s+records\s+out)"),          // Records format: "100+0 records out"
-        };
+    int newline;
+    while ((newline = m_helperOutput.indexOf('\n')) >= 0) {
+        QString line = QString::fromUtf8(m_helperOutput.left(newline)).trimmed();
+        m_helperOutput.remove(0, newline + 1);
         
-        bool foundMatch = false;
-        qint64 bytes = 0;
-        
-        for (const auto &regex : patterns) {
-            QRegularExpressionMatch match = regex.match(trimmedLine);
-            if (match.hasMatch()) {
-                bool ok = false;
-                bytes = match.captured(1).toLongLong(&ok);
-                if (ok && bytes > 0) {
-                    foundMatch = true;
-                    break;
-                }
-            }
+        if (!line.isEmpty()) {
+            handleHelperEvent(line);
         }
-        
-        if (foundMatch) {
-            QMutexLocker locker(&m_mutex);
-            
-            // Only update if we got a reasonable value (not going backwards)
-            if (bytes >= m_bytesWritten) {
-                m_bytesWritten = bytes;
-                
-                // Calculate and emit progress
-                int percentage = 0;
-                if (m_totalBytes > 0) {
-                    percentage = (int)((m_bytesWritten * 100) / m_totalBytes);
-                    // Cap progress at 95% until sync is complete
-                    // This prevents showing 100% while sync is still running
-                    percentage = qMin(percentage, 95);
-                }
-                
-                qDebug() << "Progress update:" << m_bytesWritten << "of" << m_totalBytes << "(" << percentage << "%)";
-                
-                emit progressChanged(percentage);
-                
-                // Calculate speed and time remaining
-                QDateTime currentTime = QDateTime::currentDateTime();
-                if (!m_lastUpdateTime.isValid()) {
-                    m_lastUpdateTime = currentTime;
-                    m_lastBytesWritten = 0;
-                }
-                
-                qint64 timeDiff = m_lastUpdateTime.msecsTo(currentTime);
-                
-                if (timeDiff > 500) { // Update every 500ms to avoid too frequent updates
-                    qint64 bytesDiff = m_bytesWritten - m_lastBytesWritten;
-                    if (bytesDiff > 0 && timeDiff > 0) {
-                        QString speed = calculateSpeed(bytesDiff, timeDiff);
-                        emit speedChanged(speed);
-                        
-                        // Calculate time remaining
-                        qint64 bytesRemaining = m_totalBytes - m_bytesWritten;
-                        double speedBytesPerSec = (double)bytesDiff / (timeDiff / 1000.0);
-                        if (speedBytesPerSec > 0) {
-                            QString timeRemaining = calculateTimeRemaining(bytesRemaining, speedBytesPerSec);
-                            emit timeRemainingChanged(timeRemaining);
-                        }
-                    }
-                    
-                    m_lastUpdateTime = currentTime;
-                    m_lastBytesWritten = m_bytesWritten;
-                }
+    }
+}
+
+void Burner::handleHelperEvent(const QString &line)
+{
+    QString event = line.section(' ', 0, 0);
+    QString arguments = line.section(' ', 1);
+    
+    if (event == "progress") {
+        setBytesWritten(arguments.section(' ', 0, 0).toLongLong(),
+                        arguments.section(' ', 1, 1).toLongLong());
+    } else if (event == "status") {
+        emit statusChanged(arguments);
+    } else if (event == "skipped") {
+        m_skippedRanges = ByteRangeList::fromString(arguments);
+        qDebug() << "Helper skipped" << m_skippedRanges.count() << "zero ranges,"
+                 << m_skippedRanges.totalLength() << "bytes";
+    } else if (event == "device") {
+        setDeviceProgress(arguments.section(' ', 0, 0).toInt(),
+                          arguments.section(' ', 1, 1).toLongLong(),
+                          arguments.section(' ', 2, 2));
+    } else if (event == "device-error") {
+        int index = arguments.section(' ', 0, 0).toInt();
+        if (index >= 0 && index < m_devices.count()) {
+            m_devices[index].state = "failed";
+            emit deviceFailed(m_devices[index].devicePath, arguments.section(' ', 1));
+        }
+    } else if (event == "digest") {
+        QString algorithm = arguments.section(' ', 0, 0);
+        QByteArray digest = arguments.section(' ', 1, 1).toLatin1();
+        if (algorithm == StreamDigest::algorithmName(m_currentOptions.verifyHash) && digest != m_imageDigest) {
+            m_imageDigest = digest;
+            if (!m_imageKey.isEmpty()) {
+                ChecksumCache::store(m_currentOptions.imagePath, algorithm, digest, m_imageKey);
             }
         }
-        
-        // Emit status updates for lines containing useful information
-        if (trimmedLine.contains("bytes") || trimmedLine.contains("copied") || 
-            trimmedLine.contains("records")) {
-            emit statusChanged(QString("Writing... %1").arg(trimmedLine));
+    } else if (event == "verify-progress") {
+        if (!m_isVerifying) {
+            startVerificationPhase();
         }
-        
-        // Detect sync phase
-        if (trimmedLine.contains("Syncing device")) {
-            emit statusChanged("Syncing device - finalizing USB drive...");
-            emit progressChanged(98); // Show 98% during sync
+        setBytesWritten(arguments.section(' ', 0, 0).toLongLong(),
+                        arguments.section(' ', 1, 1).toLongLong());
+    } else if (event == "rewritten") {
+        int index = arguments.section(' ', 0, 0).toInt();
+        if (index >= 0 && index < m_devices.count()) {
+            m_devices[index].rewrittenBytes = arguments.section(' ', 1, 1).toLongLong();
         }
-        
-        // Detect completion
-        if (trimmedLine.contains("Burn operation completed successfully")) {
-            emit statusChanged("USB burning completed successfully!");
-            emit progressChanged(100); // Only now show 100%
+    } else if (event == "tuned") {
+        int index = arguments.section(' ', 0, 0).toInt();
+        if (index >= 0 && index < m_devices.count()) {
+            DeviceProfile &profile = m_devices[index].profile;
+            profile.setTuning(arguments.section(' ', 1, 1).toInt(), arguments.section(' ', 2, 2).toInt(),
+                              arguments.section(' ', 3, 3).toLongLong());
+            profile.save();
+            qDebug() << "Tuned" << m_devices[index].devicePath << "to" << profile.blockSize() / 1024
+                     << "KB blocks at queue depth" << profile.queueDepth();
+        }
+    } else if (event == "mismatch") {
+        int index = arguments.section(' ', 0, 0).toInt();
+        if (index >= 0 && index < m_devices.count()) {
+            m_devices[index].mismatches = ByteRangeList::fromString(arguments.section(' ', 1, 1));
+        }
+    } else if (event == "sampled") {
+        m_sampleSummary = VerifySample::describe(arguments.section(' ', 1, 1).toLongLong(),
+                                                 arguments.section(' ', 2, 2).toLongLong(),
+                                                 arguments.section(' ', 3, 3).toDouble());
+    } else if (event == "verified") {
+        setDeviceVerified(arguments.section(' ', 0, 0).toInt(),
+                          arguments.section(' ', 1, 1) == "ok",
+                          arguments.section(' ', 2));
+    } else if (event == "checkpoint") {
+        int index = arguments.section(' ', 0, 0).toInt();
+        // A repair covers scattered ranges, which a checkpoint offset cannot describe
+        if (index >= 0 && index < m_devices.count() && !m_isCancelled && m_currentOptions.repairRanges.isEmpty()) {
+            m_devices[index].journal.save(arguments.section(' ', 1, 1).toLongLong(),
+                                          arguments.section(' ', 2, 2).toLatin1(),
+                                          m_devices[index].devicePath);
         }
+    } else if (event == "error") {
+        m_helperError = arguments;
+    } else {
+        qDebug() << "Unknown burn helper event:" << line;
     }
 }
 
@@ -388,8 +667,8 @@ bool Burner::prepareDevice(const QString &devicePath, const BurnOptions &options
         return false;
     }
     
-    // For DD mode, no preparation needed
-    if (options.mode == BurnMode::DDMode) {
+    // For DD mode, no preparation needed; a delta burn relies on what is already there
+    if (options.mode == BurnMode::DDMode || options.mode == BurnMode::DeltaMode) {
         return true;
     }
     
@@ -443,77 +722,218 @@ bool Burner::formatPartition(const QString &partitionPath, FileSystem fs, const
 
 bool Burner::burnWithDD(const BurnOptions &options)
 {
-    m_process = new QProcess(this);
-    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
-            this, &Burner::onProcessFinished);
-    connect(m_process, &QProcess::errorOccurred, this, &Burner::onProcessError);
-    connect(m_process, &QProcess::readyReadStandardError, this, &Burner::onProcessOutput);
-    connect(m_process, &QProcess::readyReadStandardOutput, this, &Burner::onProcessOutput);
-    
     emit statusChanged("Preparing to write image to device...");
     
-    // First check if pkexec is available
-    QProcess pkexecCheck;
-    pkexecCheck.start("which", QStringList() << "pkexec");
-    pkexecCheck.waitForFinished(3000);
-    
-    if (pkexecCheck.exitCode() != 0) {
-        emit error("pkexec not found. Please install policykit-1 package or run as root.");
+    if (!startHelper(BurnHelper::encodeJob(options))) {
         return false;
     }
     
-    // Create a script that will be executed with pkexec
-    QString scriptPath = QString("/tmp/burn_script_%1.sh").arg(QDateTime::currentMSecsSinceEpoch());
-    QFile scriptFile(scriptPath);
-    if (!scriptFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        emit error("Failed to create temporary script. Check /tmp directory permissions.");
+    emit statusChanged("Writing image to device...");
+    return true;
+}
+
+bool Burner::burnWithDelta(const BurnOptions &options)
+{
+    emit statusChanged("Preparing to compare image with device...");
+    
+    // The helper reads each chunk of the device before writing it and leaves
+    // alone the ones that already hold the image
+    if (!startHelper(BurnHelper::encodeJob(options))) {
         return false;
     }
     
-    QTextStream out(&scriptFile);
-    out << "#!/bin/bash\n";
-    out << "set -e\n";
-    out << "# Linux Image Burner - Burn Script\n";
-    out << QString("echo 'Starting burn operation: %1 -> %2'\n")
-           .arg(QFileInfo(options.imagePath).fileName()).arg(options.devicePath);
-    out << "# Ensure progress output is not buffered\n";
-    out << "export LC_ALL=C\n";
-    out << QString("dd if='%1' of='%2' bs=1M conv=fdatasync status=progress oflag=direct 2>&1 | tee /dev/stderr\n")
-           .arg(options.imagePath).arg(options.devicePath);
-    out << "echo 'Syncing device...'\n";
-    out << "sync\n";
-    out << "echo 'Burn operation completed successfully'\n";
-    scriptFile.close();
-    
-    // Make script executable
-    QProcess chmod;
-    chmod.start("chmod", QStringList() << "+x" << scriptPath);
-    chmod.waitForFinished();
-    
-    if (chmod.exitCode() != 0) {
-        emit error("Failed to make script executable");
-        QFile::remove(scriptPath);
-        return false;
+    emit statusChanged("Comparing image with device...");
+    return true;
+}
+
+void Burner::useCachedDigest(BurnOptions &options)
+{
+    // The helper hashes the data it writes, which only for an uncompressed
+    // image are the bytes of the file the cache has digests of
+    options.imageDigest.clear();
+    m_imageKey.clear();
+    if (ImageSource::detectCompression(options.imagePath) == ImageSource::None) {
+        m_imageKey = ChecksumCache::fileKey(options.imagePath);
+        options.imageDigest = ChecksumCache::lookup(options.imagePath, StreamDigest::algorithmName(options.verifyHash));
+    }
+    m_imageDigest = options.imageDigest;
+}
+
+void Burner::applyTunedSettings(BurnOptions &options) const
+{
+    // Any device not tuned yet gets tuned, the others again along with it
+    const DeviceProfile *slowest = nullptr;
+    for (const DeviceProgress &device : m_devices) {
+        if (!device.profile.isTuned()) {
+            return;
+        }
+        if (!slowest || device.profile.tunedThroughput() < slowest->tunedThroughput()) {
+            slowest = &device.profile;
+        }
     }
     
-    emit statusChanged("Requesting administrator privileges...");
+    // All devices share the settings; the slowest one paces the burn anyway
+    if (slowest) {
+        options.autotune = false;
+        options.blockSize = slowest->blockSize();
+        options.queueDepth = slowest->queueDepth();
+    }
+}
+
+void Burner::recordBurn(bool success)
+{
+    QDateTime now = QDateTime::currentDateTime();
+    qint64 writeMs = m_writeStartTime.msecsTo(m_verifyStartTime.isValid() ? m_verifyStartTime : now);
+    qint64 verifyMs = m_verifyStartTime.isValid() ? m_verifyStartTime.msecsTo(now) : 0;
+    
+    // Only a full write from the start says how fast the device writes; a
+    // repair or a block map writes scattered ranges, and sparse writing only
+    // counts what it did not skip
+    bool timed = m_currentOptions.resumeOffset == 0 && m_currentOptions.mode != BurnMode::DeltaMode
+                 && m_currentOptions.repairRanges.isEmpty() && m_currentOptions.bmapPath.isEmpty()
+                 && m_totalBytes > 0;
+    qint64 submittedBytes = m_totalBytes - m_skippedRanges.totalLength();
+    QStringList completed = completedDevices();
+    
+    for (DeviceProgress &device : m_devices) {
+        if (!device.profile.isValid()) {
+            continue;
+        }
+        
+        DeviceProfile::BurnRecord record;
+        record.date = now;
+        record.imageName = QFileInfo(m_currentOptions.imagePath).fileName();
+        record.success = success || (m_devices.count() > 1 && completed.contains(device.devicePath));
+        // Once verifying, a device's progress counts bytes read back, not written
+        record.bytes = record.success || device.writeMs > 0 ? m_totalBytes : device.bytesWritten;
+        
+        if (record.success && timed) {
+            qint64 deviceWriteMs = device.writeMs > 0 ? device.writeMs : writeMs;
+            if (deviceWriteMs > 0 && submittedBytes > 0) {
+                record.writeThroughput = submittedBytes * 1000 / deviceWriteMs;
+            }
+            // Scattered reads of a quick verification say little about reading speed
+            if (verifyMs >= MinimumVerifyMs && device.state == "verified" && m_currentOptions.verifySample <= 0
+                && m_verifyTotalBytes > 0) {
+                record.readThroughput = m_verifyTotalBytes * 1000 / verifyMs;
+            }
+            
+            if (device.eta.isCliffDetected()) {
+                device.profile.setCliff(device.eta.cliffOffset(), qint64(device.eta.cacheThroughput()),
+                                        qint64(device.eta.cliffThroughput()));
+            }
+        }
+        
+        device.profile.recordBurn(record);
+        device.profile.save();
+    }
+}
+
+void Burner::seedEstimators()
+{
+    // What the devices did last time stands in until they show what they do now
+    for (DeviceProgress &device : m_devices) {
+        device.eta = EtaEstimator();
+        const DeviceProfile &profile = device.profile;
+        if (profile.cliffOffset() > 0 && profile.cacheThroughput() > 0) {
+            device.eta.seed(profile.cacheThroughput(), profile.cliffOffset(), profile.cliffThroughput());
+        } else if (profile.writeThroughput() > 0) {
+            device.eta.seed(profile.writeThroughput());
+        }
+    }
+}
+
+void Burner::updateTimeRemaining()
+{
+    double seconds = -1;
+    double lowerSeconds = 0;
+    double upperSeconds = 0;
+    
+    if (m_isVerifying) {
+        if (!m_verifyEta.estimate(phaseTotalBytes(), seconds, lowerSeconds, upperSeconds)) {
+            return;
+        }
+    } else {
+        // The slowest device still writing decides
+        for (const DeviceProgress &device : m_devices) {
+            double deviceSeconds = 0;
+            double deviceLower = 0;
+            double deviceUpper = 0;
+            if (device.state == "done" || device.state == "failed"
+                || !device.eta.estimate(m_totalBytes, deviceSeconds, deviceLower, deviceUpper)) {
+                continue;
+            }
+            if (deviceSeconds > seconds) {
+                seconds = deviceSeconds;
+                lowerSeconds = deviceLower;
+                upperSeconds = deviceUpper;
+            }
+        }
+        if (seconds < 0) {
+            return;
+        }
+    }
+    
+    emit timeRemainingChanged(formatTimeRemaining(seconds));
+    emit timeRemainingRangeChanged(formatTimeRemaining(lowerSeconds), formatTimeRemaining(upperSeconds));
+}
+
+bool Burner::startHelper(const QByteArray &job)
+{
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->deleteLater();
+    }
+    
+    m_process = new QProcess(this);
+    connect(m_process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &Burner::onProcessFinished);
+    connect(m_process, &QProcess::errorOccurred, this, &Burner::onProcessError);
+    connect(m_process, &QProcess::readyReadStandardError, this, &Burner::onProcessOutput);
+    connect(m_process, &QProcess::readyReadStandardOutput, this, &Burner::onProcessOutput);
+    
+    m_helperOutput.clear();
+    m_helperError.clear();
     
-    // Execute with pkexec
+    // The helper is this same executable; only the device access needs root
+    QString program = QCoreApplication::applicationFilePath();
     QStringList args;
-    args << scriptPath;
+    args << BurnHelper::helperArgument();
     
-    m_process->start("pkexec", args);
+    if (geteuid() == 0) {
+        m_process->start(program, args);
+    } else {
+        // First check if pkexec is available
+        QProcess pkexecCheck;
+        pkexecCheck.start("which", QStringList() << "pkexec");
+        pkexecCheck.waitForFinished(3000);
+        
+        if (pkexecCheck.exitCode() != 0) {
+            emit error("pkexec not found. Please install policykit-1 package or run as root.");
+            return false;
+        }
+        
+        emit statusChanged("Requesting administrator privileges...");
+        m_process->start("pkexec", QStringList() << program << args);
+    }
     
     if (!m_process->waitForStarted(10000)) {
         emit error("Failed to start burning process. User may have cancelled authentication.");
-        QFile::remove(scriptPath);
         return false;
     }
     
-    emit statusChanged("Writing image to device...");
+    // The job stays queued in the pipe until authentication has completed
+    m_process->write(job + '\n');
     return true;
 }
 
+void Burner::sendHelperCommand(const QByteArray &command)
+{
+    if (m_process && m_process->state() != QProcess::NotRunning) {
+        m_process->write(command + '\n');
+    }
+}
+
 bool Burner::burnWithUEFI(const BurnOptions &options)
 {
     // For UEFI mode, we need to:
@@ -567,19 +987,201 @@ bool Burner::addBootFiles(const QString &devicePath, const BurnOptions &options)
 
 void Burner::updateProgress()
 {
-    // Progress is now handled directly in onProcessOutput()
+    // Progress is now handled directly in setBytesWritten()
     // This method is kept for compatibility with the timer-based approach
-    if (m_totalBytes > 0) {
-        int percentage = (int)((m_bytesWritten * 100) / m_totalBytes);
-        percentage = qMin(percentage, 100); // Cap at 100%
+    if (phaseTotalBytes() > 0) {
+        int percentage = (int)((m_bytesWritten * 100) / phaseTotalBytes());
+        percentage = qMin(percentage, 99); // 100% is reserved for the finished helper
         emit progressChanged(percentage);
     }
 }
 
+void Burner::sampleDeviceStats()
+{
+    // A few numbers from sysfs per device, no parsing of helper output
+    for (DeviceProgress &device : m_devices) {
+        if (device.stats.sample()) {
+            emit deviceStatsChanged(device.devicePath, device.stats.bytesWritten(), device.stats.inFlight(),
+                                    device.stats.averageQueueDepth(), device.stats.utilization());
+        }
+    }
+}
+
+void Burner::setBytesWritten(qint64 bytes, qint64 total)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    // The written total is what the device's history records, so a quick
+    // verification's smaller total is kept apart from it
+    if (total > 0 && m_isVerifying) {
+        m_verifyTotalBytes = total;
+    } else if (total > 0) {
+        m_totalBytes = total;
+    }
+    
+    // Only update if the value is not going backwards
+    if (bytes < m_bytesWritten) {
+        return;
+    }
+    m_bytesWritten = bytes;
+    
+    // Bytes are exact, but the device is not flushed until the helper exits
+    int percentage = 0;
+    if (phaseTotalBytes() > 0) {
+        percentage = (int)((m_bytesWritten * 100) / phaseTotalBytes());
+        percentage = qMin(percentage, 99);
+    }
+    
+    emit progressChanged(percentage);
+    
+    // Calculate speed and time remaining
+    QDateTime currentTime = QDateTime::currentDateTime();
+    if (!m_lastUpdateTime.isValid()) {
+        m_lastUpdateTime = currentTime;
+        m_lastBytesWritten = 0;
+    }
+    
+    // Time is measured from the first progress, not from authenticating
+    if (!m_isVerifying && !m_writeStartTime.isValid()) {
+        m_writeStartTime = currentTime;
+        seedEstimators();
+        updateTimeRemaining();
+    }
+    
+    qint64 timeDiff = m_lastUpdateTime.msecsTo(currentTime);
+    
+    if (timeDiff > 500) { // Update every 500ms to avoid too frequent updates
+        qint64 bytesDiff = m_bytesWritten - m_lastBytesWritten;
+        if (m_isVerifying) {
+            m_verifyEta.addSample(m_verifyStartTime.msecsTo(currentTime), m_bytesWritten);
+        } else if (m_devices.count() == 1) {
+            m_devices.first().eta.addSample(m_writeStartTime.msecsTo(currentTime), m_bytesWritten);
+        }
+        if (bytesDiff > 0 && timeDiff > 0) {
+            QString speed = calculateSpeed(bytesDiff, timeDiff);
+            emit speedChanged(speed);
+            updateTimeRemaining();
+        }
+        
+        m_lastUpdateTime = currentTime;
+        m_lastBytesWritten = m_bytesWritten;
+    }
+}
+
+qint64 Burner::phaseTotalBytes() const
+{
+    // Progress counts toward what is being written, or toward what is being read back
+    return m_isVerifying && m_verifyTotalBytes > 0 ? m_verifyTotalBytes : m_totalBytes;
+}
+
+void Burner::setDeviceProgress(int index, qint64 bytes, const QString &state)
+{
+    if (index < 0 || index >= m_devices.count()) {
+        return;
+    }
+    
+    DeviceProgress &device = m_devices[index];
+    device.bytesWritten = bytes;
+    device.state = state;
+    
+    QDateTime currentTime = QDateTime::currentDateTime();
+    if (!device.lastUpdateTime.isValid()) {
+        device.lastUpdateTime = currentTime;
+        device.lastBytesWritten = 0;
+    }
+    
+    if (state == "done" && device.writeMs == 0 && m_writeStartTime.isValid()) {
+        device.writeMs = m_writeStartTime.msecsTo(currentTime);
+    }
+    
+    qint64 timeDiff = device.lastUpdateTime.msecsTo(currentTime);
+    if (timeDiff > 500) {
+        if (!m_isVerifying && m_writeStartTime.isValid() && m_devices.count() > 1) {
+            device.eta.addSample(m_writeStartTime.msecsTo(currentTime), bytes);
+        }
+        device.speed = calculateSpeed(bytes - device.lastBytesWritten, timeDiff);
+        device.lastUpdateTime = currentTime;
+        device.lastBytesWritten = bytes;
+    }
+    
+    int percentage = 0;
+    if (phaseTotalBytes() > 0) {
+        percentage = (int)((bytes * 100) / phaseTotalBytes());
+    }
+    
+    emit deviceProgressChanged(device.devicePath, percentage, device.speed, state);
+}
+
+QStringList Burner::completedDevices() const
+{
+    // A single device only reports through the overall progress
+    if (m_devices.count() == 1) {
+        return QStringList() << m_devices.first().devicePath;
+    }
+    
+    QStringList devicePaths;
+    for (const DeviceProgress &device : m_devices) {
+        if (device.state == "done" || device.state == "verifying" || device.state == "verified") {
+            devicePaths << device.devicePath;
+        }
+    }
+    return devicePaths;
+}
+
+QString Burner::deltaSummary() const
+{
+    qint64 rewrittenBytes = 0;
+    for (const DeviceProgress &device : m_devices) {
+        rewrittenBytes += qMax<qint64>(0, device.rewrittenBytes);
+    }
+    
+    if (rewrittenBytes == 0) {
+        return m_devices.count() == 1 ? QString("Device already up to date")
+                                      : QString("All %1 devices already up to date").arg(m_devices.count());
+    }
+    return QString("Burn completed%1, %2 MB rewritten where the device differed")
+           .arg(m_isVerifying ? " and verified" : "")
+           .arg(qMax<qint64>(1, rewrittenBytes / (1024 * 1024)));
+}
+
+void Burner::removeCheckpoints(bool completedOnly)
+{
+    QStringList completed = completedDevices();
+    for (DeviceProgress &device : m_devices) {
+        if (!completedOnly || completed.contains(device.devicePath)) {
+            device.journal.remove();
+        }
+    }
+}
+
+void Burner::relocateDevices()
+{
+    // A device that was replugged while paused may be back under another name
+    DeviceManager deviceManager;
+    QList<DeviceInfo> present = deviceManager.getRemovableDevices();
+    
+    for (DeviceProgress &device : m_devices) {
+        for (const DeviceInfo &info : present) {
+            if (info.path != device.devicePath
+                && CheckpointJournal::identityOf(info) == device.journal.deviceIdentity()) {
+                qDebug() << device.devicePath << "is now" << info.path;
+                device.devicePath = info.path;
+                device.stats = DeviceStats(info.path);
+                device.stats.sample();
+                break;
+            }
+        }
+    }
+}
+
 qint64 Burner::getBytesWritten(const QString &devicePath)
 {
-    Q_UNUSED(devicePath)
-    // Return current bytes written as tracked by the process output parsing
+    // What the device's own counters saw completed; the helper's count otherwise
+    for (const DeviceProgress &device : m_devices) {
+        if (device.devicePath == devicePath && device.stats.isValid()) {
+            return device.stats.bytesWritten();
+        }
+    }
     return m_bytesWritten;
 }
 
@@ -600,11 +1202,11 @@ QString Burner::calculateSpeed(qint64 bytes, qint64 timeMs)
     return QString::number(bytesPerSec, 'f', 2) + " " + units[unitIndex];
 }
 
-QString Burner::calculateTimeRemaining(qint64 bytesRemaining, double speedBytesPerSec)
+QString Burner::formatTimeRemaining(double secondsLeft)
 {
-    if (speedBytesPerSec <= 0) return "Unknown";
+    if (secondsLeft < 0) return "Unknown";
     
-    int secondsRemaining = (int)(bytesRemaining / speedBytesPerSec);
+    int secondsRemaining = (int)secondsLeft;
     
     int hours = secondsRemaining / 3600;
     int minutes = (secondsRemaining % 3600) / 60;
@@ -675,13 +1277,16 @@ bool Burner::unmountDevice(const QString &devicePath)
 
 bool Burner::syncDevice(const QString &devicePath)
 {
-    Q_UNUSED(devicePath)
-    
-    QProcess sync;
-    sync.start("sync");
-    sync.waitForFinished(10000);
+    // Flush this device only; sync(1) would wait for every filesystem on the machine
+    int fd = open(devicePath.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        qWarning() << "Cannot open" << devicePath << "to flush it:" << strerror(errno);
+        return false;
+    }
     
-    return sync.exitCode() == 0;
+    bool flushed = fdatasync(fd) == 0;
+    close(fd);
+    return flushed;
 }
 
 QString Burner::getPartitionPath(const QString &devicePath, int partitionNumber)
@@ -698,42 +1303,64 @@ QString Burner::getPartitionPath(const QString &devicePath, int partitionNumber)
     return devicePath + QString::number(partitionNumber);
 }
 
-bool Burner::verifyImageChecksum(const QString &imagePath, const QString &devicePath)
+void Burner::startVerificationPhase()
 {
-    QString imageHash = calculateSHA256(imagePath);
-    QString deviceHash = calculateSHA256(devicePath);
+    // Verification reports through the same progress, speed and time signals as writing
+    QMutexLocker locker(&m_mutex);
+    m_isVerifying = true;
+    m_verifyTotalBytes = 0;
+    m_bytesWritten = 0;
+    m_lastBytesWritten = 0;
+    m_lastUpdateTime = QDateTime();
+    for (DeviceProgress &device : m_devices) {
+        device.lastUpdateTime = QDateTime();
+    }
+    m_verifyStartTime = QDateTime::currentDateTime();
+    
+    // The devices are read back together, so the slowest reader sets the pace
+    m_verifyEta = EtaEstimator();
+    qint64 readThroughput = 0;
+    for (const DeviceProgress &device : m_devices) {
+        if (device.profile.readThroughput() <= 0) {
+            readThroughput = 0;
+            break;
+        }
+        if (readThroughput == 0 || device.profile.readThroughput() < readThroughput) {
+            readThroughput = device.profile.readThroughput();
+        }
+    }
+    if (readThroughput > 0) {
+        m_verifyEta.seed(readThroughput);
+    }
+    locker.unlock();
     
-    return !imageHash.isEmpty() && imageHash == deviceHash;
+    emit verificationStarted();
+    emit progressChanged(0);
 }
 
-QString Burner::calculateMD5(const QString &filePath)
+void Burner::setDeviceVerified(int index, bool verified, const QString &message)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return QString();
+    if (index < 0 || index >= m_devices.count()) {
+        return;
     }
     
-    QCryptographicHash hash(QCryptographicHash::Md5);
-    if (hash.addData(&file)) {
-        return hash.result().toHex();
+    DeviceProgress &device = m_devices[index];
+    if (verified) {
+        setDeviceProgress(index, phaseTotalBytes(), "verified");
+        return;
     }
     
-    return QString();
+    device.state = "failed";
+    m_verifyFailures << device.devicePath;
+    emit deviceFailed(device.devicePath, "Verification failed: " + message);
 }
 
-QString Burner::calculateSHA256(const QString &filePath)
+QMap<MultiHasher::Algorithm, QByteArray> Burner::calculateDigests(const QString &filePath,
+                                                                  const QList<MultiHasher::Algorithm> &algorithms)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return QString();
-    }
-    
-    QCryptographicHash hash(QCryptographicHash::Sha256);
-    if (hash.addData(&file)) {
-        return hash.result().toHex();
-    }
-    
-    return QString();
+    // One read of the image, however many digests are wanted, and none for
+    // digests cached from earlier
+    return ChecksumCache::hashFile(filePath, algorithms);
 }
 
 
@@ -7,12 +7,33 @@
 #include <QTimer>
 #include <QMutex>
 #include <QDateTime>
+#include <QStringList>
+#include "ByteRange.h"
+#include "CheckpointJournal.h"
+#include "DeviceStats.h"
+#include "DeviceProfile.h"
+#include "EtaEstimator.h"
+#include "MultiHasher.h"
+#include "StreamDigest.h"
 
 enum class BurnMode {
     DDMode,          // Direct disk copy (dd)
     ISOHybridMode,   // ISO hybrid mode
     UEFIMode,        // UEFI compatible mode
-    WindowsToGo      // Windows To Go mode
+    WindowsToGo,     // Windows To Go mode
+    DeltaMode        // Direct copy, rewriting only blocks that differ from the device
+};
+
+enum class WriteBackend {
+    Auto,            // io_uring when the kernel allows it, pwrite otherwise
+    IoUring,         // io_uring with several writes in flight
+    Pwrite           // One synchronous pwrite at a time
+};
+
+enum class SparseMode {
+    Off,             // Write every block of the image
+    Discard,         // Discard the device once, then skip zero blocks
+    ZeroOut          // BLKZEROOUT each zero range instead of writing it
 };
 
 enum class PartitionScheme {
@@ -30,6 +51,7 @@ enum class FileSystem {
 struct BurnOptions {
     QString imagePath;
     QString devicePath;
+    QStringList additionalDevicePaths;  // Further targets written from the same read of the image
     BurnMode mode;
     PartitionScheme partitionScheme;
     FileSystem fileSystem;
@@ -40,6 +62,58 @@ struct BurnOptions {
     bool addFixupFiles;
     int clusterSize;
     bool badBlockCheck;
+    QString bmapPath;                   // Optional bmaptool block map of the image
+    
+    // Write engine tuning
+    WriteBackend writeBackend = WriteBackend::Auto;
+    int queueDepth = 4;                 // Writes kept in flight by io_uring
+    int blockSize = 1024 * 1024;        // Bytes per write request
+    
+    // Try request sizes and queue depths at the start of the write and keep
+    // the fastest for each device; see WriteEngine and DeviceProfile
+    bool autotune = false;
+    
+    // Write through the page cache instead of O_DIRECT, keeping at most
+    // dirtyLimit bytes of each device dirty so a slow stick cannot soak up
+    // gigabytes of memory and stall the desktop
+    bool bufferedWrites = false;
+    qint64 dirtyLimit = 64 * 1024 * 1024;
+    
+    // Zero blocks in the image are not written when sparse writing is on
+    SparseMode sparseMode = SparseMode::Off;
+    bool recordSkippedRanges = false;   // Report skipped ranges for verification and the write speed
+    
+    // Continue an interrupted burn: image bytes before resumeOffset are already on
+    // the device, as long as it still matches resumeHash (see CheckpointJournal)
+    qint64 resumeOffset = 0;
+    QByteArray resumeHash;
+    
+    // Rewrite only these ranges of the image, which a verification found
+    // different (see repair)
+    ByteRangeList repairRanges;
+    
+    // Only read the devices back and compare them with the image (see verifyBurn)
+    bool verifyOnly = false;
+    
+    // With verifyAfterBurn, read each device back while it is still being written
+    bool verifyWhileWriting = false;
+    
+    // Quick verification: compare only this fraction of the image, drawn at
+    // random from verifySampleSeed (see VerifySample); 0 compares all of it.
+    // The seed also picks which ranges skipped by sparse writing a full
+    // verification reads back. burnImage() and verifyBurn() pick one when it is 0.
+    double verifySample = 0.0;
+    quint32 verifySampleSeed = 0;
+    
+    // What image and devices are compared by; BLAKE3 hashes on every core
+    VerifyHash verifyHash = VerifyHash::Sha256;
+    
+    // The image's digest by verifyHash as hex, when already known (see
+    // ChecksumCache); the image is then not hashed again
+    QByteArray imageDigest;
+    
+    // How often the GUI samples progress and the devices' kernel I/O counters
+    int statsIntervalMs = 1000;
 };
 
 class Burner : public QObject
@@ -53,7 +127,20 @@ public:
     // Main burning operations
     void burnImage(const BurnOptions &options);
     void formatDevice(const QString &devicePath, FileSystem fs, const QString &label = QString());
-    void verifyBurn(const QString &imagePath, const QString &devicePath);
+    // A sample above 0 quick-verifies that fraction of the image (see BurnOptions::verifySample)
+    void verifyBurn(const QString &imagePath, const QString &devicePath,
+                    VerifyHash verifyHash = VerifyHash::Sha256, double sample = 0.0);
+    
+    // Fills in resumeOffset and resumeHash when every device of the burn has a
+    // checkpoint for this image left by an interrupted burn
+    bool findResumePoint(BurnOptions &options);
+    
+    // After a verification that found devices different from the image: the
+    // ranges that differed on any of them, those devices, and a burn that
+    // rewrites just those ranges on them and verifies them again
+    ByteRangeList mismatchedRanges() const;
+    QStringList mismatchedDevices() const;
+    void repair();
     
     // Control operations
     void cancel();
@@ -62,7 +149,7 @@ public:
     
     // Status
     bool isBurning() const { return m_isBurning; }
-    bool isPaused() const { return m_isPaused; }
+    bool isPaused() const { return m_isPaused && !m_resumePending; }
     bool isCancelled() const { return m_isCancelled; }
 
 signals:
@@ -70,11 +157,20 @@ signals:
     void speedChanged(const QString &speed);
     void statusChanged(const QString &status);
     void timeRemainingChanged(const QString &timeRemaining);
+    void timeRemainingRangeChanged(const QString &minimum, const QString &maximum);  // 90% confidence
     void burnStarted();
     void burnFinished(bool success, const QString &message);
     void verificationStarted();
     void verificationFinished(bool success, const QString &message);
     void error(const QString &message);
+    
+    // Burns to several devices report each one separately as well
+    void deviceProgressChanged(const QString &devicePath, int percentage, const QString &speed, const QString &state);
+    void deviceFailed(const QString &devicePath, const QString &message);
+    
+    // Sampled from the device's kernel counters (see DeviceStats)
+    void deviceStatsChanged(const QString &devicePath, qint64 bytesWritten, int inFlight,
+                            double queueDepth, double utilization);
 
 private slots:
     void onProgressTimer();
@@ -83,20 +179,50 @@ private slots:
     void onProcessOutput();
 
 private:
+    struct DeviceProgress {
+        QString devicePath;
+        qint64 bytesWritten;
+        qint64 lastBytesWritten;
+        QDateTime lastUpdateTime;
+        QString speed;
+        QString state;
+        CheckpointJournal journal;
+        qint64 rewrittenBytes = -1;    // Bytes a delta burn found different; -1 until reported
+        DeviceStats stats{};
+        DeviceProfile profile{};
+        EtaEstimator eta{};            // Time left writing, and where the write slowed down
+        qint64 writeMs = 0;            // How long writing took, once the device is done
+        ByteRangeList mismatches{};    // Where verification found the device different
+    };
+    
     bool m_isBurning;
     bool m_isPaused;
     bool m_isCancelled;
+    bool m_isVerifying;                // The helper is reading the devices back
+    bool m_resumePending;              // resume() waits for the paused helper to exit
     
     QProcess *m_process;
+    QByteArray m_helperOutput;
+    QString m_helperError;
+    ByteRangeList m_skippedRanges;     // Zero ranges the helper did not write
+    QByteArray m_imageDigest;          // Of the image by verifyHash, cached or hashed by the helper
+    QString m_imageKey;                // The image file's ChecksumCache key when the burn started
+    QString m_sampleSummary;           // What a quick verification covered, once the helper reports it
     QTimer *m_progressTimer;
     QMutex m_mutex;
     
     BurnOptions m_currentOptions;
-    qint64 m_totalBytes;
+    qint64 m_totalBytes;               // Of the image, as written
+    qint64 m_verifyTotalBytes;         // Read back by verification, less than written for a quick one
     qint64 m_bytesWritten;
     QDateTime m_startTime;
     QDateTime m_lastUpdateTime;
+    QDateTime m_writeStartTime;        // First progress from the helper, not counting authentication
+    QDateTime m_verifyStartTime;
+    EtaEstimator m_verifyEta;
     qint64 m_lastBytesWritten;
+    QList<DeviceProgress> m_devices;   // Every target of the burn, in job order
+    QStringList m_verifyFailures;      // Devices whose read back did not match the image
     
     // Helper methods
     bool prepareDevice(const QString &devicePath, const BurnOptions &options);
@@ -104,15 +230,33 @@ private:
     bool createPartition(const QString &devicePath, FileSystem fs, const QString &label);
     bool formatPartition(const QString &partitionPath, FileSystem fs, const QString &label);
     bool burnWithDD(const BurnOptions &options);
+    bool burnWithDelta(const BurnOptions &options);
+    void useCachedDigest(BurnOptions &options);
+    void applyTunedSettings(BurnOptions &options) const;
+    void recordBurn(bool success);
+    void seedEstimators();
+    void updateTimeRemaining();
+    bool startHelper(const QByteArray &job);
+    void sendHelperCommand(const QByteArray &command);
+    void handleHelperEvent(const QString &line);
     bool burnWithUEFI(const BurnOptions &options);
     bool burnWithWindowsToGo(const BurnOptions &options);
     bool addBootFiles(const QString &devicePath, const BurnOptions &options);
     
     // Progress tracking
     void updateProgress();
+    void sampleDeviceStats();
+    void setBytesWritten(qint64 bytes, qint64 total);
+    qint64 phaseTotalBytes() const;
+    void setDeviceProgress(int index, qint64 bytes, const QString &state);
+    QStringList completedDevices() const;
+    QString deltaSummary() const;
+    void removeCheckpoints(bool completedOnly);
+    void relocateDevices();
+    void resumeBurn();                 // resume() once the paused helper has exited
     qint64 getBytesWritten(const QString &devicePath);
     QString calculateSpeed(qint64 bytes, qint64 timeMs);
-    QString calculateTimeRemaining(qint64 bytesRemaining, double speedBytesPerSec);
+    QString formatTimeRemaining(double seconds);
     
     // Utility functions
     QString getFileSystemCommand(FileSystem fs);
@@ -121,10 +265,11 @@ private:
     bool syncDevice(const QString &devicePath);
     QString getPartitionPath(const QString &devicePath, int partitionNumber);
     
-    // Verification
-    bool verifyImageChecksum(const QString &imagePath, const QString &devicePath);
-    QString calculateMD5(const QString &filePath);
-    QString calculateSHA256(const QString &filePath);
+    // Verification, done by the helper after writing (see Verifier)
+    void startVerificationPhase();
+    void setDeviceVerified(int index, bool verified, const QString &message);
+    QMap<MultiHasher::Algorithm, QByteArray> calculateDigests(const QString &filePath,
+                                                              const QList<MultiHasher::Algorithm> &algorithms);
 };
 
 #endif // BURNER_H
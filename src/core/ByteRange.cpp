@@ -0,0 +1,120 @@
+#include "ByteRange.h"
+#include <QStringList>
+#include <algorithm>
+
+void ByteRangeList::add(qint64 offset, qint64 length)
+{
+    if (length <= 0) {
+        return;
+    }
+    
+    // Ranges are almost always appended in order, so try the cheap case first
+    if (m_ranges.isEmpty() || m_ranges.last().end() < offset) {
+        m_ranges.append({offset, length});
+        return;
+    }
+    if (m_ranges.last().offset <= offset) {
+        ByteRange &last = m_ranges.last();
+        last.length = qMax(last.end(), offset + length) - last.offset;
+        return;
+    }
+    
+    // Out of order: insert, then merge whatever now overlaps
+    auto position = std::lower_bound(m_ranges.begin(), m_ranges.end(), offset,
+                                     [](const ByteRange &range, qint64 value) { return range.offset < value; });
+    int index = int(position - m_ranges.begin());
+    m_ranges.insert(index, {offset, length});
+    if (index > 0) {
+        --index;
+    }
+    
+    while (index + 1 < m_ranges.count()) {
+        ByteRange &current = m_ranges[index];
+        const ByteRange &next = m_ranges[index + 1];
+        if (current.end() < next.offset) {
+            ++index;
+            continue;
+        }
+        current.length = qMax(current.end(), next.end()) - current.offset;
+        m_ranges.removeAt(index + 1);
+    }
+}
+
+qint64 ByteRangeList::totalLength() const
+{
+    qint64 total = 0;
+    for (const ByteRange &range : m_ranges) {
+        total += range.length;
+    }
+    return total;
+}
+
+bool ByteRangeList::contains(qint64 offset, qint64 length) const
+{
+    auto position = std::upper_bound(m_ranges.begin(), m_ranges.end(), offset,
+                                     [](qint64 value, const ByteRange &range) { return value < range.offset; });
+    if (position == m_ranges.begin()) {
+        return false;
+    }
+    --position;
+    return position->offset <= offset && offset + length <= position->end();
+}
+
+ByteRangeList ByteRangeList::intersected(const ByteRangeList &other) const
+{
+    ByteRangeList result;
+    int first = 0;
+    for (const ByteRange &range : m_ranges) {
+        while (first < other.count() && other.m_ranges[first].end() <= range.offset) {
+            ++first;
+        }
+        for (int i = first; i < other.count() && other.m_ranges[i].offset < range.end(); ++i) {
+            qint64 start = qMax(range.offset, other.m_ranges[i].offset);
+            result.add(start, qMin(range.end(), other.m_ranges[i].end()) - start);
+        }
+    }
+    return result;
+}
+
+ByteRangeList ByteRangeList::subtracted(const ByteRangeList &other) const
+{
+    ByteRangeList result;
+    int first = 0;
+    for (const ByteRange &range : m_ranges) {
+        while (first < other.count() && other.m_ranges[first].end() <= range.offset) {
+            ++first;
+        }
+        qint64 position = range.offset;
+        for (int i = first; i < other.count() && other.m_ranges[i].offset < range.end(); ++i) {
+            result.add(position, other.m_ranges[i].offset - position);
+            position = qMax(position, other.m_ranges[i].end());
+        }
+        result.add(position, range.end() - position);
+    }
+    return result;
+}
+
+QString ByteRangeList::toString() const
+{
+    QStringList parts;
+    for (const ByteRange &range : m_ranges) {
+        parts << QString("%1+%2").arg(range.offset).arg(range.length);
+    }
+    return parts.join(',');
+}
+
+ByteRangeList ByteRangeList::fromString(const QString &text)
+{
+    ByteRangeList list;
+    const QStringList parts = text.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool offsetOk = false;
+        bool lengthOk = false;
+        qint64 offset = part.section('+', 0, 0).toLongLong(&offsetOk);
+        qint64 length = part.section('+', 1, 1).toLongLong(&lengthOk);
+        if (offsetOk && lengthOk && offset >= 0) {
+            list.add(offset, length);
+        }
+    }
+    return list;
+}
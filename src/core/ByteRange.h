@@ -0,0 +1,43 @@
+#ifndef BYTERANGE_H
+#define BYTERANGE_H
+
+#include <QVector>
+#include <QString>
+
+struct ByteRange {
+    qint64 offset;
+    qint64 length;
+    
+    qint64 end() const { return offset + length; }
+};
+
+// Sorted list of non-overlapping byte ranges on a device or image.
+// Adjacent and overlapping ranges are merged as they are added.
+class ByteRangeList
+{
+public:
+    ByteRangeList() {}
+    
+    void add(qint64 offset, qint64 length);
+    void add(const ByteRange &range) { add(range.offset, range.length); }
+    void clear() { m_ranges.clear(); }
+    
+    bool isEmpty() const { return m_ranges.isEmpty(); }
+    int count() const { return m_ranges.count(); }
+    const QVector<ByteRange> &ranges() const { return m_ranges; }
+    qint64 totalLength() const;
+    bool contains(qint64 offset, qint64 length) const;
+    
+    // The parts of these ranges that the other list covers, or does not
+    ByteRangeList intersected(const ByteRangeList &other) const;
+    ByteRangeList subtracted(const ByteRangeList &other) const;
+    
+    // Compact "offset+length,offset+length" form used by the helper protocol
+    QString toString() const;
+    static ByteRangeList fromString(const QString &text);
+
+private:
+    QVector<ByteRange> m_ranges;
+};
+
+#endif // BYTERANGE_H
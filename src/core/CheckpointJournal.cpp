@@ -0,0 +1,101 @@
+#include "CheckpointJournal.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+CheckpointJournal::CheckpointJournal()
+{
+}
+
+CheckpointJournal::CheckpointJournal(const QString &imagePath, const QString &bmapPath, const DeviceInfo &device)
+    : m_imagePath(QFileInfo(imagePath).absoluteFilePath())
+    , m_bmapPath(bmapPath)
+    , m_deviceIdentity(identityOf(device))
+{
+    QByteArray key = QCryptographicHash::hash((m_imagePath + "\n" + m_deviceIdentity).toUtf8(),
+                                              QCryptographicHash::Sha1).toHex();
+    m_path = journalDirectory() + "/" + QString::fromLatin1(key) + ".json";
+}
+
+bool CheckpointJournal::load(qint64 &offset, QByteArray &hash) const
+{
+    QFile file(m_path);
+    if (!isValid() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    QJsonObject journal = QJsonDocument::fromJson(file.readAll()).object();
+    QFileInfo image(m_imagePath);
+    
+    // A checkpoint only means something for the exact image and write plan it was taken with
+    if (journal["imagePath"].toString() != m_imagePath
+        || journal["deviceIdentity"].toString() != m_deviceIdentity
+        || journal["bmapPath"].toString() != m_bmapPath
+        || journal["imageSize"].toInteger() != image.size()
+        || journal["imageModified"].toInteger() != image.lastModified().toMSecsSinceEpoch()) {
+        qDebug() << "Discarding stale checkpoint journal" << m_path;
+        return false;
+    }
+    
+    offset = journal["offset"].toInteger();
+    hash = journal["hash"].toString().toLatin1();
+    return offset > 0 && !hash.isEmpty();
+}
+
+bool CheckpointJournal::save(qint64 offset, const QByteArray &hash, const QString &devicePath)
+{
+    if (!isValid() || !QDir().mkpath(journalDirectory())) {
+        return false;
+    }
+    
+    QFileInfo image(m_imagePath);
+    
+    QJsonObject journal;
+    journal["imagePath"] = m_imagePath;
+    journal["imageSize"] = image.size();
+    journal["imageModified"] = image.lastModified().toMSecsSinceEpoch();
+    journal["bmapPath"] = m_bmapPath;
+    journal["deviceIdentity"] = m_deviceIdentity;
+    journal["devicePath"] = devicePath;
+    journal["offset"] = offset;
+    journal["hash"] = QString::fromLatin1(hash);
+    journal["updated"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    
+    // Replace the old checkpoint atomically; a torn journal would be worse than none
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write checkpoint journal" << m_path;
+        return false;
+    }
+    file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+void CheckpointJournal::remove()
+{
+    if (isValid()) {
+        QFile::remove(m_path);
+    }
+}
+
+QString CheckpointJournal::identityOf(const DeviceInfo &device)
+{
+    // Without a serial number a device is only recognised by its path
+    QStringList identity = {device.vendor, device.model, device.serial, device.sizeString};
+    if (device.serial.isEmpty()) {
+        identity << device.path;
+    }
+    return identity.join("|");
+}
+
+QString CheckpointJournal::journalDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/checkpoints";
+}
@@ -0,0 +1,41 @@
+#ifndef CHECKPOINTJOURNAL_H
+#define CHECKPOINTJOURNAL_H
+
+#include <QString>
+#include <QByteArray>
+#include "DeviceManager.h"
+
+// Small on-disk record of how far a burn got, so an interrupted burn can go on
+// from the last offset the helper flushed to the device instead of from zero.
+// There is one journal per image and device. Devices are recognised by
+// vendor, model, serial and size, so a device that was replugged and came
+// back under another path still finds its journal.
+//
+// Journals live in the user's data directory and are only ever written by the
+// unprivileged side; the helper just reports checkpoints.
+class CheckpointJournal
+{
+public:
+    CheckpointJournal();
+    CheckpointJournal(const QString &imagePath, const QString &bmapPath, const DeviceInfo &device);
+    
+    bool isValid() const { return !m_path.isEmpty(); }
+    QString path() const { return m_path; }
+    QString deviceIdentity() const { return m_deviceIdentity; }
+    
+    // False when there is no checkpoint or the image changed since it was taken
+    bool load(qint64 &offset, QByteArray &hash) const;
+    bool save(qint64 offset, const QByteArray &hash, const QString &devicePath);
+    void remove();
+    
+    static QString identityOf(const DeviceInfo &device);
+    static QString journalDirectory();
+
+private:
+    QString m_path;
+    QString m_imagePath;
+    QString m_bmapPath;
+    QString m_deviceIdentity;
+};
+
+#endif // CHECKPOINTJOURNAL_H
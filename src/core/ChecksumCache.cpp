@@ -0,0 +1,164 @@
+#include "ChecksumCache.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+
+// Room for a key and the longest digest, SHA-512 in hex
+static const int MaxAttributeLength = 256;
+
+QString ChecksumCache::fileKey(const QString &path)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return QString();
+    }
+    return QString("%1 %2 %3.%4")
+           .arg(quint64(st.st_ino))
+           .arg(qint64(st.st_size))
+           .arg(qint64(st.st_mtim.tv_sec))
+           .arg(qint64(st.st_mtim.tv_nsec), 9, 10, QChar('0'));
+}
+
+QByteArray ChecksumCache::lookup(const QString &path, const QString &algorithm)
+{
+    QString key = fileKey(path);
+    if (key.isEmpty()) {
+        return QByteArray();
+    }
+    
+    // The attribute holds the key it was stored with, then the digest
+    char value[MaxAttributeLength];
+    ssize_t length = getxattr(QFile::encodeName(path).constData(), attributeName(algorithm).constData(),
+                              value, sizeof(value));
+    if (length > 0) {
+        QByteArray entry(value, int(length));
+        int split = entry.lastIndexOf(' ');
+        if (split > 0 && entry.left(split) == key.toLatin1()) {
+            return entry.mid(split + 1);
+        }
+    }
+    
+    return lookupIndex(path, algorithm, key);
+}
+
+bool ChecksumCache::store(const QString &path, const QString &algorithm, const QByteArray &digest,
+                          const QString &key)
+{
+    if (digest.isEmpty() || key.isEmpty() || fileKey(path) != key) {
+        return false;
+    }
+    
+    // Setting an attribute changes the inode's ctime, not what the key is made of
+    QByteArray value = key.toLatin1() + ' ' + digest;
+    if (setxattr(QFile::encodeName(path).constData(), attributeName(algorithm).constData(),
+                 value.constData(), size_t(value.size()), 0) == 0) {
+        return true;
+    }
+    
+    // Read-only or someone else's image, or a file system without user attributes
+    return storeIndex(path, algorithm, digest, key);
+}
+
+QMap<MultiHasher::Algorithm, QByteArray> ChecksumCache::hashFile(const QString &path,
+                                                               const QList<MultiHasher::Algorithm> &algorithms)
+{
+    // Taken before reading, so a file changed meanwhile is not cached
+    QString key = fileKey(path);
+    
+    QMap<MultiHasher::Algorithm, QByteArray> digests;
+    QList<MultiHasher::Algorithm> missing;
+    for (MultiHasher::Algorithm algorithm : algorithms) {
+        QByteArray digest = lookup(path, MultiHasher::algorithmName(algorithm));
+        if (digest.isEmpty()) {
+            missing << algorithm;
+        } else {
+            digests.insert(algorithm, digest);
+        }
+    }
+    if (missing.isEmpty()) {
+        return digests;
+    }
+    
+    QMap<MultiHasher::Algorithm, QByteArray> computed = MultiHasher::hashFile(path, missing);
+    if (computed.isEmpty()) {
+        return computed;
+    }
+    for (auto it = computed.constBegin(); it != computed.constEnd(); ++it) {
+        store(path, MultiHasher::algorithmName(it.key()), it.value(), key);
+        digests.insert(it.key(), it.value());
+    }
+    return digests;
+}
+
+QByteArray ChecksumCache::attributeName(const QString &algorithm)
+{
+    return "user.checksum." + algorithm.toLatin1();
+}
+
+QByteArray ChecksumCache::lookupIndex(const QString &path, const QString &algorithm, const QString &key)
+{
+    QFile file(indexPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    
+    QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+    QJsonObject entry = index[QFileInfo(path).canonicalFilePath()].toObject();
+    if (entry["key"].toString() != key) {
+        return QByteArray();
+    }
+    return entry["digests"].toObject()[algorithm].toString().toLatin1();
+}
+
+bool ChecksumCache::storeIndex(const QString &path, const QString &algorithm, const QByteArray &digest,
+                               const QString &key)
+{
+    QString indexFile = indexPath();
+    if (!QDir().mkpath(QFileInfo(indexFile).path())) {
+        return false;
+    }
+    
+    QJsonObject index;
+    QFile existing(indexFile);
+    if (existing.open(QIODevice::ReadOnly)) {
+        index = QJsonDocument::fromJson(existing.readAll()).object();
+        existing.close();
+    }
+    
+    // Entries for images that were deleted or changed are dropped on the way
+    for (auto it = index.begin(); it != index.end(); ) {
+        if (fileKey(it.key()) != it.value().toObject()["key"].toString()) {
+            it = index.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    QString canonicalPath = QFileInfo(path).canonicalFilePath();
+    QJsonObject entry = index[canonicalPath].toObject();
+    QJsonObject digests = entry["digests"].toObject();
+    digests[algorithm] = QString::fromLatin1(digest);
+    entry["key"] = key;
+    entry["digests"] = digests;
+    index[canonicalPath] = entry;
+    
+    QSaveFile file(indexFile);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write checksum index" << indexFile;
+        return false;
+    }
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+QString ChecksumCache::indexPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/checksums.json";
+}
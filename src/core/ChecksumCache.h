@@ -0,0 +1,49 @@
+#ifndef CHECKSUMCACHE_H
+#define CHECKSUMCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include "MultiHasher.h"
+
+// Digests of image files remembered across burns, so burning and verifying the
+// same image again does not mean hashing it again. A digest is kept in a
+// user.checksum.<algorithm> extended attribute of the file itself, or, where
+// the file system has no user attributes or the file is not ours to change, in
+// an index in the user's cache directory.
+//
+// Either way a digest is stored together with the file's inode, size and
+// modification time and ignored as soon as one of them differs. Digests are of
+// the file as stored, so a compressed image's digest is not that of the data
+// written to the device.
+class ChecksumCache
+{
+public:
+    // Inode, size and modification time of the file, empty when it cannot be
+    // looked at; a digest is only valid for the key it was stored with
+    static QString fileKey(const QString &path);
+    
+    // Lower case hex digest by algorithm name (see MultiHasher::algorithmName),
+    // empty when none is cached for the file as it is now
+    static QByteArray lookup(const QString &path, const QString &algorithm);
+    
+    // Records a digest computed while the file had the given key; nothing is
+    // stored if the file changed since
+    static bool store(const QString &path, const QString &algorithm, const QByteArray &digest,
+                      const QString &key);
+    
+    // MultiHasher::hashFile() that only reads the file for digests not cached
+    // yet, and caches those
+    static QMap<MultiHasher::Algorithm, QByteArray> hashFile(const QString &path,
+                                                           const QList<MultiHasher::Algorithm> &algorithms);
+
+private:
+    static QByteArray attributeName(const QString &algorithm);
+    static QByteArray lookupIndex(const QString &path, const QString &algorithm, const QString &key);
+    static bool storeIndex(const QString &path, const QString &algorithm, const QByteArray &digest,
+                           const QString &key);
+    static QString indexPath();
+};
+
+#endif // CHECKSUMCACHE_H
@@ -39,7 +39,7 @@ QList<DeviceInfo> DeviceManager::getRemovableDevices()
     
     // Use lsblk to get device information without requiring root
     QProcess lsblk;
-    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,FSTYPE,UUID,TRAN");
+    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,SERIAL,FSTYPE,UUID,TRAN");
     lsblk.waitForFinished(5000);
     
     if (lsblk.exitCode() == 0) {
@@ -56,7 +56,7 @@ QList<DeviceInfo> DeviceManager::getAllStorageDevices()
     
     // Use lsblk to get all storage device information
     QProcess lsblk;
-    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,FSTYPE,UUID,TRAN");
+    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,SERIAL,FSTYPE,UUID,TRAN");
     lsblk.waitForFinished(5000);
     
     if (lsblk.exitCode() == 0) {
@@ -71,7 +71,7 @@ DeviceInfo DeviceManager::getDeviceInfo(const QString &devicePath)
 {
     // Use lsblk to get device info instead of direct file access
     QProcess lsblk;
-    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,FSTYPE,UUID,TRAN" << devicePath);
+    lsblk.start("lsblk", QStringList() << "-J" << "-o" << "NAME,SIZE,TYPE,MOUNTPOINT,RM,VENDOR,MODEL,SERIAL,FSTYPE,UUID,TRAN" << devicePath);
     lsblk.waitForFinished(5000);
     
     if (lsblk.exitCode() == 0) {
@@ -248,6 +248,7 @@ DeviceInfo DeviceManager::parseDeviceInfo(const QString &devicePath)
     
     info.model = getDeviceModel(devicePath);
     info.vendor = getDeviceVendor(devicePath);
+    info.serial = readSysfsAttribute(devicePath, "device/serial");
     info.size = getDeviceSize(devicePath);
     info.sizeString = formatSize(info.size);
     info.isRemovable = isRemovableDevice(devicePath);
@@ -257,6 +258,7 @@ DeviceInfo DeviceManager::parseDeviceInfo(const QString &devicePath)
     info.uuid = getDeviceUUID(devicePath);
     info.isUSB = isUSBDevice(devicePath);
     info.isMMC = isMMCDevice(devicePath);
+    info.usbSpeed = info.isUSB ? getUSBSpeed(devicePath) : 0;
     
     return info;
 }
@@ -369,6 +371,24 @@ bool DeviceManager::isUSBDevice(const QString &devicePath)
     return false;
 }
 
+int DeviceManager::getUSBSpeed(const QString &devicePath)
+{
+    QString deviceName = QFileInfo(devicePath).fileName();
+    
+    // The USB device the disk hangs off is the nearest ancestor in sysfs with a
+    // speed attribute, in Mbit/s ("480", "5000", "1.5")
+    QString path = QFileInfo(QString("/sys/block/%1/device").arg(deviceName)).canonicalFilePath();
+    while (path.startsWith("/sys/devices/")) {
+        QFile speed(path + "/speed");
+        if (speed.open(QIODevice::ReadOnly)) {
+            return int(speed.readAll().trimmed().toDouble());
+        }
+        path = QFileInfo(path).path();
+    }
+    
+    return 0;
+}
+
 bool DeviceManager::isMMCDevice(const QString &devicePath)
 {
     QString deviceName = QFileInfo(devicePath).fileName();
@@ -404,6 +424,7 @@ QList<DeviceInfo> DeviceManager::parseLsblkOutput(const QByteArray &output, bool
         info.name = device["name"].toString();
         info.model = device["model"].toString();
         info.vendor = device["vendor"].toString();
+        info.serial = device["serial"].toString();
         
         // Handle both boolean and string values for rm field
         QJsonValue rmValue = device["rm"];
@@ -429,6 +450,7 @@ QList<DeviceInfo> DeviceManager::parseLsblkOutput(const QByteArray &output, bool
         QString deviceName = device["name"].toString();
         info.isUSB = (transport == "usb") || deviceName.startsWith("sd");
         info.isMMC = deviceName.startsWith("mmcblk");
+        info.usbSpeed = info.isUSB ? getUSBSpeed(info.path) : 0;
         
         // Get mount points without requiring device access
         QStringList mountPoints;
@@ -12,6 +12,7 @@ struct DeviceInfo {
     QString name;           // Human readable name
     QString model;          // Device model
     QString vendor;         // Device vendor
+    QString serial;         // Serial number, when the device reports one
     qint64 size;           // Size in bytes
     QString sizeString;     // Human readable size
     bool isRemovable;       // Is removable device
@@ -21,6 +22,7 @@ struct DeviceInfo {
     QString uuid;           // Device UUID
     bool isUSB;            // Is USB device
     bool isMMC;            // Is MMC/SD card
+    int usbSpeed = 0;      // USB link speed in Mbit/s, 0 when unknown
 };
 
 class DeviceManager : public QObject
@@ -80,6 +82,7 @@ private:
     QString getFileSystemType(const QString &devicePath);
     QString getDeviceUUID(const QString &devicePath);
     bool isUSBDevice(const QString &devicePath);
+    int getUSBSpeed(const QString &devicePath);
     bool isMMCDevice(const QString &devicePath);
 };
 
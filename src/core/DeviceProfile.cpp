@@ -0,0 +1,220 @@
+#include "DeviceProfile.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+// Burns kept in a device's history; older ones are dropped
+static const int MaxHistory = 100;
+
+// Burns averaged at either end of the history to tell a trend
+static const int TrendBurns = 3;
+
+static QJsonObject recordToJson(const DeviceProfile::BurnRecord &record)
+{
+    QJsonObject object;
+    object["date"] = record.date.toString(Qt::ISODate);
+    object["image"] = record.imageName;
+    object["bytes"] = record.bytes;
+    object["writeThroughput"] = record.writeThroughput;
+    object["readThroughput"] = record.readThroughput;
+    object["success"] = record.success;
+    return object;
+}
+
+static DeviceProfile::BurnRecord recordFromJson(const QJsonObject &object)
+{
+    DeviceProfile::BurnRecord record;
+    record.date = QDateTime::fromString(object["date"].toString(), Qt::ISODate);
+    record.imageName = object["image"].toString();
+    record.bytes = object["bytes"].toInteger();
+    record.writeThroughput = object["writeThroughput"].toInteger();
+    record.readThroughput = object["readThroughput"].toInteger();
+    record.success = object["success"].toBool();
+    return record;
+}
+
+DeviceProfile::DeviceProfile()
+    : m_blockSize(0)
+    , m_queueDepth(0)
+    , m_tunedThroughput(0)
+    , m_writeThroughput(0)
+    , m_readThroughput(0)
+    , m_cliffOffset(0)
+    , m_cacheThroughput(0)
+    , m_cliffThroughput(0)
+{
+}
+
+DeviceProfile::DeviceProfile(const DeviceInfo &device)
+    : DeviceProfile()
+{
+    // Without even a model name there is nothing to recognise the device by
+    if (device.vendor.isEmpty() && device.model.isEmpty()) {
+        return;
+    }
+    
+    m_deviceIdentity = identityOf(device);
+    QByteArray key = QCryptographicHash::hash(m_deviceIdentity.toUtf8(), QCryptographicHash::Sha1).toHex();
+    m_path = profileDirectory() + "/" + QString::fromLatin1(key) + ".json";
+}
+
+bool DeviceProfile::load()
+{
+    QFile file(m_path);
+    if (!isValid() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    QJsonObject profile = QJsonDocument::fromJson(file.readAll()).object();
+    if (profile["deviceIdentity"].toString() != m_deviceIdentity) {
+        qDebug() << "Ignoring device profile for another device" << m_path;
+        return false;
+    }
+    
+    QJsonObject tuning = profile["tuning"].toObject();
+    m_blockSize = tuning["blockSize"].toInt();
+    m_queueDepth = tuning["queueDepth"].toInt();
+    m_tunedThroughput = tuning["bytesPerSecond"].toInteger();
+    
+    m_writeThroughput = profile["writeThroughput"].toInteger();
+    m_readThroughput = profile["readThroughput"].toInteger();
+    
+    QJsonObject cliff = profile["cliff"].toObject();
+    m_cliffOffset = cliff["offset"].toInteger();
+    m_cacheThroughput = cliff["before"].toInteger();
+    m_cliffThroughput = cliff["after"].toInteger();
+    
+    m_history.clear();
+    for (const QJsonValue &value : profile["history"].toArray()) {
+        m_history.append(recordFromJson(value.toObject()));
+    }
+    return true;
+}
+
+bool DeviceProfile::save() const
+{
+    if (!isValid() || !QDir().mkpath(profileDirectory())) {
+        return false;
+    }
+    
+    QJsonObject profile;
+    profile["deviceIdentity"] = m_deviceIdentity;
+    profile["updated"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    if (isTuned()) {
+        QJsonObject tuning;
+        tuning["blockSize"] = m_blockSize;
+        tuning["queueDepth"] = m_queueDepth;
+        tuning["bytesPerSecond"] = m_tunedThroughput;
+        profile["tuning"] = tuning;
+    }
+    
+    profile["writeThroughput"] = m_writeThroughput;
+    profile["readThroughput"] = m_readThroughput;
+    if (m_cliffOffset > 0) {
+        QJsonObject cliff;
+        cliff["offset"] = m_cliffOffset;
+        cliff["before"] = m_cacheThroughput;
+        cliff["after"] = m_cliffThroughput;
+        profile["cliff"] = cliff;
+    }
+    
+    QJsonArray history;
+    for (const BurnRecord &record : m_history) {
+        history.append(recordToJson(record));
+    }
+    profile["history"] = history;
+    
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write device profile" << m_path;
+        return false;
+    }
+    file.write(QJsonDocument(profile).toJson(QJsonDocument::Compact));
+    return file.commit();
+}
+
+void DeviceProfile::setTuning(int blockSize, int queueDepth, qint64 bytesPerSecond)
+{
+    m_blockSize = blockSize;
+    m_queueDepth = queueDepth;
+    m_tunedThroughput = bytesPerSecond;
+}
+
+void DeviceProfile::setCliff(qint64 offset, qint64 bytesPerSecondBefore, qint64 bytesPerSecondAfter)
+{
+    m_cliffOffset = offset;
+    m_cacheThroughput = bytesPerSecondBefore;
+    m_cliffThroughput = bytesPerSecondAfter;
+}
+
+double DeviceProfile::expectedWriteSeconds(qint64 bytes) const
+{
+    if (m_writeThroughput <= 0) {
+        return -1;
+    }
+    
+    if (m_cliffOffset <= 0 || m_cacheThroughput <= 0 || m_cliffThroughput <= 0) {
+        return double(bytes) / m_writeThroughput;
+    }
+    
+    // Cache speed up to the cliff, sustained speed past it
+    qint64 cached = qMin(bytes, m_cliffOffset);
+    return double(cached) / m_cacheThroughput + double(bytes - cached) / m_cliffThroughput;
+}
+
+void DeviceProfile::recordBurn(const BurnRecord &record)
+{
+    if (record.writeThroughput > 0) {
+        m_writeThroughput = record.writeThroughput;
+    }
+    if (record.readThroughput > 0) {
+        m_readThroughput = record.readThroughput;
+    }
+    
+    m_history.append(record);
+    while (m_history.count() > MaxHistory) {
+        m_history.removeFirst();
+    }
+}
+
+double DeviceProfile::writeTrend() const
+{
+    QList<qint64> throughputs;
+    for (const BurnRecord &record : m_history) {
+        if (record.success && record.writeThroughput > 0) {
+            throughputs.append(record.writeThroughput);
+        }
+    }
+    
+    // Both ends need their own burns, or the trend compares a burn with itself
+    int count = qMin(TrendBurns, int(throughputs.count() / 2));
+    if (count == 0) {
+        return 1.0;
+    }
+    
+    double first = 0;
+    double last = 0;
+    for (int i = 0; i < count; ++i) {
+        first += throughputs[i];
+        last += throughputs[throughputs.count() - 1 - i];
+    }
+    return last / first;
+}
+
+QString DeviceProfile::identityOf(const DeviceInfo &device)
+{
+    return QStringList({device.vendor, device.model, device.serial, QString::number(device.usbSpeed)}).join("|");
+}
+
+QString DeviceProfile::profileDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/profiles";
+}
@@ -0,0 +1,93 @@
+#ifndef DEVICEPROFILE_H
+#define DEVICEPROFILE_H
+
+#include <QString>
+#include <QList>
+#include <QDateTime>
+#include "DeviceManager.h"
+
+// What earlier burns learned about a device, so the next burn to it can start
+// from there instead of finding out again. Unlike checkpoint journals a profile
+// is not tied to an image: devices are recognised by vendor, model, serial and
+// the USB link speed they were plugged in at, since the same stick behind a
+// USB 2 port is a different device performance-wise. Sticks without a serial
+// share the profile of their model.
+//
+// Each burn adds an entry to the device's history, so a stick whose write
+// speed keeps dropping from burn to burn shows up before it fails outright.
+//
+// Profiles live in the user's data directory and are only ever written by the
+// unprivileged side; the helper just reports what it measured.
+class DeviceProfile
+{
+public:
+    struct BurnRecord {
+        QDateTime date;
+        QString imageName;
+        qint64 bytes = 0;               // Written to the device
+        qint64 writeThroughput = 0;     // Bytes per second over the whole write, 0 when not measured
+        qint64 readThroughput = 0;      // Bytes per second reading back, 0 when not verified
+        bool success = false;
+    };
+    
+    DeviceProfile();
+    explicit DeviceProfile(const DeviceInfo &device);
+    
+    bool isValid() const { return !m_path.isEmpty(); }
+    QString path() const { return m_path; }
+    QString deviceIdentity() const { return m_deviceIdentity; }
+    
+    // False when there is no profile for the device yet
+    bool load();
+    bool save() const;
+    
+    // Write settings autotuning settled on, and how fast the device was with them
+    bool isTuned() const { return m_blockSize > 0 && m_queueDepth > 0; }
+    int blockSize() const { return m_blockSize; }
+    int queueDepth() const { return m_queueDepth; }
+    qint64 tunedThroughput() const { return m_tunedThroughput; }
+    void setTuning(int blockSize, int queueDepth, qint64 bytesPerSecond);
+    
+    // Sequential throughput in bytes per second from the latest burn that measured it, or 0
+    qint64 writeThroughput() const { return m_writeThroughput; }
+    qint64 readThroughput() const { return m_readThroughput; }
+    
+    // Where writing slowed down for good in the latest burn that got that far,
+    // typically when the stick's SLC cache filled up; 0 when never seen
+    qint64 cliffOffset() const { return m_cliffOffset; }
+    qint64 cacheThroughput() const { return m_cacheThroughput; }
+    qint64 cliffThroughput() const { return m_cliffThroughput; }
+    void setCliff(qint64 offset, qint64 bytesPerSecondBefore, qint64 bytesPerSecondAfter);
+    
+    // Seconds writing the first bytes of the device takes by what was measured,
+    // slowing down past the cliff; -1 when nothing was measured yet
+    double expectedWriteSeconds(qint64 bytes) const;
+    
+    void recordBurn(const BurnRecord &record);
+    const QList<BurnRecord> &history() const { return m_history; }
+    
+    // Write throughput of the latest successful burns relative to the earliest
+    // ones; 1.0 when there are too few to tell
+    double writeTrend() const;
+    
+    static QString identityOf(const DeviceInfo &device);
+    static QString profileDirectory();
+
+private:
+    QString m_path;
+    QString m_deviceIdentity;
+    
+    int m_blockSize;
+    int m_queueDepth;
+    qint64 m_tunedThroughput;       // Bytes per second
+    
+    qint64 m_writeThroughput;
+    qint64 m_readThroughput;
+    qint64 m_cliffOffset;
+    qint64 m_cacheThroughput;       // Before the cliff
+    qint64 m_cliffThroughput;       // After it
+    
+    QList<BurnRecord> m_history;    // Oldest first
+};
+
+#endif // DEVICEPROFILE_H
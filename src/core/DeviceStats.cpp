@@ -0,0 +1,78 @@
+#include "DeviceStats.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QList>
+#include <QByteArray>
+
+// Fields of /sys/block/<dev>/stat, see Documentation/block/stat.rst
+enum StatField {
+    ReadSectors = 2,
+    WriteSectors = 6,
+    InFlight = 8,
+    IoTicks = 9,
+    TimeInQueue = 10,
+    FieldCount = 11
+};
+
+DeviceStats::DeviceStats()
+    : DeviceStats(QString())
+{
+}
+
+DeviceStats::DeviceStats(const QString &devicePath)
+    : m_sampled(false)
+    , m_firstSectorsRead(0)
+    , m_firstSectorsWritten(0)
+    , m_sectorsRead(0)
+    , m_sectorsWritten(0)
+    , m_ioTicks(0)
+    , m_queueTicks(0)
+    , m_inFlight(0)
+    , m_queueDepth(0.0)
+    , m_utilization(0.0)
+{
+    if (devicePath.isEmpty()) {
+        return;
+    }
+    
+    // Links like /dev/disk/by-id/... name the device by what they point to
+    QString deviceName = QFileInfo(QFileInfo(devicePath).canonicalFilePath()).fileName();
+    QString statPath = QString("/sys/block/%1/stat").arg(deviceName);
+    if (!deviceName.isEmpty() && QFileInfo::exists(statPath)) {
+        m_statPath = statPath;
+    }
+}
+
+bool DeviceStats::sample()
+{
+    QFile file(m_statPath);
+    if (m_statPath.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    QList<QByteArray> fields = file.readAll().simplified().split(' ');
+    if (fields.count() < FieldCount) {
+        return false;
+    }
+    
+    qint64 ioTicks = fields[IoTicks].toLongLong();
+    qint64 queueTicks = fields[TimeInQueue].toLongLong();
+    qint64 elapsed = m_sampled ? m_sampleTimer.restart() : 0;
+    
+    if (!m_sampled) {
+        m_firstSectorsRead = fields[ReadSectors].toLongLong();
+        m_firstSectorsWritten = fields[WriteSectors].toLongLong();
+        m_sampleTimer.start();
+        m_sampled = true;
+    } else if (elapsed > 0) {
+        m_queueDepth = double(queueTicks - m_queueTicks) / elapsed;
+        m_utilization = qMin(1.0, double(ioTicks - m_ioTicks) / elapsed);
+    }
+    
+    m_sectorsRead = fields[ReadSectors].toLongLong();
+    m_sectorsWritten = fields[WriteSectors].toLongLong();
+    m_inFlight = fields[InFlight].toInt();
+    m_ioTicks = ioTicks;
+    m_queueTicks = queueTicks;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef DEVICESTATS_H
+#define DEVICESTATS_H
+
+#include <QString>
+#include <QElapsedTimer>
+
+// The kernel's own I/O counters for a block device, from /sys/block/<dev>/stat.
+// They count what the block layer completed, whatever wrote it, so they tell
+// how much reached the device and how busy its queue is without asking the
+// writer. Readable without root, so the GUI samples them itself.
+class DeviceStats
+{
+public:
+    DeviceStats();
+    explicit DeviceStats(const QString &devicePath);
+    
+    bool isValid() const { return !m_statPath.isEmpty(); }
+    
+    // Reads the counters again; false when they cannot be read
+    bool sample();
+    
+    // Since the first sample
+    qint64 bytesWritten() const { return (m_sectorsWritten - m_firstSectorsWritten) * SectorSize; }
+    qint64 bytesRead() const { return (m_sectorsRead - m_firstSectorsRead) * SectorSize; }
+    
+    // Requests issued to the device and not yet completed
+    int inFlight() const { return m_inFlight; }
+    
+    // Between the last two samples: average number of requests queued, and
+    // the share of the time the device had any
+    double averageQueueDepth() const { return m_queueDepth; }
+    double utilization() const { return m_utilization; }
+
+private:
+    // The stat file counts 512 byte sectors whatever the device's block size
+    static const qint64 SectorSize = 512;
+    
+    QString m_statPath;
+    QElapsedTimer m_sampleTimer;
+    bool m_sampled;
+    
+    qint64 m_firstSectorsRead;
+    qint64 m_firstSectorsWritten;
+    qint64 m_sectorsRead;
+    qint64 m_sectorsWritten;
+    qint64 m_ioTicks;               // Milliseconds with requests outstanding
+    qint64 m_queueTicks;            // Milliseconds weighted by the requests outstanding
+    int m_inFlight;
+    double m_queueDepth;
+    double m_utilization;
+};
+
+#endif // DEVICESTATS_H
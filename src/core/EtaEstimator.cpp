@@ -0,0 +1,192 @@
+#include "EtaEstimator.h"
+#include <QtMath>
+
+// Time constants of the smoothed throughput and of the faster one that spots drops
+static const double SmoothingMs = 5000;
+static const double FastSmoothingMs = 1500;
+
+// A cliff is a drop to 1/CliffRatio of the average before it that lasts
+// CliffHoldMs; the average needs CliffMinimumMs of data to compare against
+static const double CliffRatio = 2.0;
+static const qint64 CliffHoldMs = 5000;
+static const qint64 CliffMinimumMs = 5000;
+
+// Samples take over from the seed within this time
+static const qint64 SeedBlendMs = 10000;
+
+// Relative error assumed for an estimate from the seed alone, or from the first
+// samples without one, and added for a cliff expected from an earlier burn
+static const double SeedUncertainty = 0.25;
+static const double NoSeedUncertainty = 0.5;
+static const double CliffUncertainty = 0.15;
+static const double MaxUncertainty = 0.9;
+
+// Standard deviations either side of the mean for 90% confidence
+static const double Z90 = 1.645;
+
+EtaEstimator::EtaEstimator()
+    : m_seedRate(0)
+    , m_seedCliffOffset(0)
+    , m_seedCliffRate(0)
+    , m_samples(0)
+    , m_lastMs(-1)
+    , m_lastBytes(0)
+    , m_elapsedMs(0)
+    , m_rate(0)
+    , m_variance(0)
+    , m_alpha(1)
+    , m_fastRate(0)
+    , m_regimeMs(0)
+    , m_regimeBytes(0)
+    , m_dropMs(-1)
+    , m_dropBytes(0)
+    , m_cliffOffset(0)
+    , m_cacheRate(0)
+    , m_cacheStartMs(0)
+    , m_cacheStartBytes(0)
+{
+}
+
+void EtaEstimator::seed(double bytesPerSecond, qint64 cliffOffset, double cliffBytesPerSecond)
+{
+    m_seedRate = bytesPerSecond;
+    m_seedCliffOffset = cliffOffset;
+    m_seedCliffRate = cliffBytesPerSecond;
+}
+
+void EtaEstimator::addSample(qint64 elapsedMs, qint64 bytes)
+{
+    if (m_lastMs < 0) {
+        m_lastMs = elapsedMs;
+        m_lastBytes = bytes;
+        m_regimeMs = elapsedMs;
+        m_regimeBytes = bytes;
+        return;
+    }
+    
+    qint64 interval = elapsedMs - m_lastMs;
+    if (interval <= 0 || bytes < m_lastBytes) {
+        return;
+    }
+    
+    double rate = double(bytes - m_lastBytes) * 1000 / interval;
+    qint64 previousMs = m_lastMs;
+    qint64 previousBytes = m_lastBytes;
+    m_elapsedMs += interval;
+    m_lastMs = elapsedMs;
+    m_lastBytes = bytes;
+    
+    if (m_samples == 0) {
+        m_rate = rate;
+        m_fastRate = rate;
+    } else {
+        m_alpha = 1 - qExp(-interval / SmoothingMs);
+        double deviation = rate - m_rate;
+        m_rate += m_alpha * deviation;
+        m_variance = (1 - m_alpha) * (m_variance + m_alpha * deviation * deviation);
+        m_fastRate += (1 - qExp(-interval / FastSmoothingMs)) * (rate - m_fastRate);
+    }
+    ++m_samples;
+    
+    qint64 regimeMs = elapsedMs - m_regimeMs;
+    double regimeRate = regimeMs > 0 ? double(bytes - m_regimeBytes) * 1000 / regimeMs : 0;
+    
+    if (m_cliffOffset > 0) {
+        // Back up to speed: that was a stall, not the cache running out
+        if (regimeMs >= CliffHoldMs && regimeRate > m_cacheRate / CliffRatio) {
+            m_cliffOffset = 0;
+            m_cacheRate = 0;
+            m_regimeMs = m_cacheStartMs;
+            m_regimeBytes = m_cacheStartBytes;
+        }
+        return;
+    }
+    
+    if (regimeMs < CliffMinimumMs || m_fastRate >= regimeRate / CliffRatio) {
+        m_dropMs = -1;
+        return;
+    }
+    
+    // The drop started before the fast average noticed it; one interval is close enough
+    if (m_dropMs < 0) {
+        m_dropMs = previousMs;
+        m_dropBytes = previousBytes;
+        return;
+    }
+    
+    if (elapsedMs - m_dropMs >= CliffHoldMs && m_dropMs > m_regimeMs) {
+        m_cacheRate = double(m_dropBytes - m_regimeBytes) * 1000 / (m_dropMs - m_regimeMs);
+        m_cacheStartMs = m_regimeMs;
+        m_cacheStartBytes = m_regimeBytes;
+        m_cliffOffset = m_dropBytes;
+        
+        // Start over from the new speed; the drop itself keeps the variance up for a while
+        m_regimeMs = m_dropMs;
+        m_regimeBytes = m_dropBytes;
+        m_rate = double(bytes - m_dropBytes) * 1000 / (elapsedMs - m_dropMs);
+        m_fastRate = m_rate;
+        m_dropMs = -1;
+    }
+}
+
+double EtaEstimator::seedWeight() const
+{
+    if (m_samples == 0) {
+        return 0;
+    }
+    return qMin(1.0, double(m_elapsedMs) / SeedBlendMs);
+}
+
+double EtaEstimator::throughput() const
+{
+    // Once the device showed a cliff of its own, the seed's cache speed is beside the point
+    if (m_seedRate <= 0 || m_cliffOffset > 0) {
+        return m_rate;
+    }
+    
+    double weight = seedWeight();
+    return weight * m_rate + (1 - weight) * m_seedRate;
+}
+
+double EtaEstimator::cliffThroughput() const
+{
+    if (m_cliffOffset <= 0 || m_lastMs <= m_regimeMs) {
+        return m_rate;
+    }
+    return double(m_lastBytes - m_regimeBytes) * 1000 / (m_lastMs - m_regimeMs);
+}
+
+bool EtaEstimator::estimate(qint64 totalBytes, double &seconds, double &lowerSeconds, double &upperSeconds) const
+{
+    double rate = throughput();
+    if (totalBytes <= 0 || rate <= 0) {
+        return false;
+    }
+    
+    qint64 done = qMax<qint64>(0, m_lastBytes);
+    qint64 remaining = qMax<qint64>(0, totalBytes - done);
+    
+    // The EWMA's own spread, plus what the seed or too few samples leave open
+    double uncertainty = 0;
+    if (m_samples > 1 && m_rate > 0) {
+        uncertainty += Z90 * qSqrt(m_variance * m_alpha / (2 - m_alpha)) / m_rate;
+    }
+    uncertainty += (1 - seedWeight()) * (m_seedRate > 0 ? SeedUncertainty : NoSeedUncertainty);
+    
+    // A cliff an earlier burn ran into and not seen yet this time. It is still
+    // expected a little past its offset, for as long as confirming it takes.
+    qint64 cliffSlack = qint64(rate * CliffHoldMs / 1000) * 2;
+    if (m_cliffOffset == 0 && m_seedCliffRate > 0 && done < m_seedCliffOffset + cliffSlack
+        && totalBytes > m_seedCliffOffset) {
+        qint64 cached = qMax<qint64>(0, m_seedCliffOffset - done);
+        seconds = cached / rate + (remaining - cached) / m_seedCliffRate;
+        uncertainty += CliffUncertainty;
+    } else {
+        seconds = remaining / rate;
+    }
+    
+    uncertainty = qMin(uncertainty, MaxUncertainty);
+    lowerSeconds = seconds / (1 + uncertainty);
+    upperSeconds = seconds / (1 - uncertainty);
+    return true;
+}
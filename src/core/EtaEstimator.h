@@ -0,0 +1,73 @@
+#ifndef ETAESTIMATOR_H
+#define ETAESTIMATOR_H
+
+#include <QtGlobal>
+
+// Time left for a device from how fast it has been going. The throughput is
+// smoothed with an exponentially weighted moving average, so a few slow or fast
+// progress intervals do not swing the estimate, and its variance gives a
+// confidence interval.
+//
+// Flash drives often write at cache speed until their SLC cache fills and then
+// drop to a fraction of it for the rest of the write. A drop to half or less
+// that lasts is recognised as such a cliff: the average starts over from the
+// new speed instead of slowly sliding down to it, and a drop that recovers is
+// forgotten again.
+//
+// Seeded with what earlier burns measured (see DeviceProfile), the estimate is
+// usable before the first sample, and a cliff seen before is expected at the
+// same offset until the device shows otherwise.
+class EtaEstimator
+{
+public:
+    EtaEstimator();
+    
+    // Expected cache throughput, and where and to what it dropped last time
+    void seed(double bytesPerSecond, qint64 cliffOffset = 0, double cliffBytesPerSecond = 0);
+    
+    // Bytes done after elapsedMs; samples should be at least a few hundred ms apart
+    void addSample(qint64 elapsedMs, qint64 bytes);
+    
+    // Seconds left to reach totalBytes, with the bounds of a 90% confidence
+    // interval; false while there is nothing to go on
+    bool estimate(qint64 totalBytes, double &seconds, double &lowerSeconds, double &upperSeconds) const;
+    
+    // Smoothed throughput in bytes per second
+    double throughput() const;
+    
+    bool isCliffDetected() const { return m_cliffOffset > 0; }
+    qint64 cliffOffset() const { return m_cliffOffset; }
+    double cacheThroughput() const { return m_cacheRate; }
+    double cliffThroughput() const;
+
+private:
+    double seedWeight() const;
+    
+    double m_seedRate;
+    qint64 m_seedCliffOffset;
+    double m_seedCliffRate;
+    
+    int m_samples;
+    qint64 m_lastMs;
+    qint64 m_lastBytes;
+    qint64 m_elapsedMs;             // Since the first sample
+    
+    double m_rate;                  // Smoothed throughput
+    double m_variance;              // Of the per-interval throughput around m_rate
+    double m_alpha;                 // Weight of the latest sample
+    double m_fastRate;              // Smoothed over a shorter time, to spot a drop
+    
+    // Throughput since the last cliff, or since the start
+    qint64 m_regimeMs;
+    qint64 m_regimeBytes;
+    
+    // A drop being watched, and a confirmed one
+    qint64 m_dropMs;
+    qint64 m_dropBytes;
+    qint64 m_cliffOffset;
+    double m_cacheRate;
+    qint64 m_cacheStartMs;
+    qint64 m_cacheStartBytes;
+};
+
+#endif // ETAESTIMATOR_H
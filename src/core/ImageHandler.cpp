@@ -1,4 +1,5 @@
 #include "ImageHandler.h"
+#include "BlockMap.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QProcess>
@@ -24,12 +25,53 @@ ImageInfo ImageHandler::analyzeImage(const QString &imagePath)
     }
     
     QFileInfo fileInfo(imagePath);
-    info.size = fileInfo.size();
-    info.sizeString = formatSize(info.size);
+    info.compression = ImageSource::detectCompression(imagePath);
+    info.compressedSize = fileInfo.size();
+    info.size = ImageSource::imageSize(imagePath);
+    info.mappedBytes = info.size;
+    info.mappedFraction = 1.0;
+    
+    if (!ImageSource::isSupported(info.compression)) {
+        info.errorMessage = QString("%1 compressed images are not supported by this build")
+                            .arg(ImageSource::compressionName(info.compression));
+        return info;
+    }
+    
+    // A block map tells us how much of the image actually holds data, and for
+    // gzip and bzip2 images also how big it is once decompressed
+    QString bmapPath = BlockMap::findForImage(imagePath);
+    if (!bmapPath.isEmpty()) {
+        BlockMap blockMap;
+        if (blockMap.load(bmapPath) && (blockMap.imageSize() == info.size || info.size < 0)) {
+            info.size = blockMap.imageSize();
+            info.bmapPath = bmapPath;
+            info.mappedBytes = blockMap.mappedBytes();
+            info.mappedFraction = blockMap.mappedFraction();
+        } else {
+            qWarning() << "Ignoring block map" << bmapPath << blockMap.errorString();
+        }
+    }
+    
+    if (info.size >= 0) {
+        info.sizeString = formatSize(info.size);
+    } else {
+        info.sizeString = QString("Unknown (%1 compressed)").arg(formatSize(info.compressedSize));
+    }
+    if (info.compression != ImageSource::None) {
+        info.sizeString += QString(", %1").arg(ImageSource::compressionName(info.compression));
+    }
     
     // Detect image type
     info.type = detectImageType(imagePath);
     
+    if (info.compression != ImageSource::None) {
+        // Tools and loop mounts need the plain image; only the boot sector is decoded
+        info.isValid = true;
+        info.isBootable = hasMBRBootloader(imagePath);
+        emit analysisFinished(info);
+        return info;
+    }
+    
     // Analyze based on type
     bool analysisSuccess = false;
     switch (info.type) {
@@ -74,7 +116,9 @@ bool ImageHandler::validateImage(const QString &imagePath)
 
 ImageType ImageHandler::detectImageType(const QString &imagePath)
 {
-    QFileInfo fileInfo(imagePath);
+    // A compressed image is named after what it holds: disk.img.xz
+    ImageSource::Compression compression = ImageSource::detectCompression(imagePath);
+    QFileInfo fileInfo(compression != ImageSource::None ? ImageSource::uncompressedName(imagePath) : imagePath);
     QString extension = fileInfo.suffix().toLower();
     
     if (extension == "iso") {
@@ -91,6 +135,19 @@ ImageType ImageHandler::detectImageType(const QString &imagePath)
         return ImageType::VMDK;
     }
     
+    if (compression != ImageSource::None) {
+        // Decode just far enough to see an ISO 9660 volume descriptor
+        ImageSource source;
+        QByteArray header(32774, 0);
+        if (source.open(imagePath) && source.read(header.data(), header.size()) == header.size()
+            && header.mid(32769, 5) == "CD001") {
+            return ImageType::ISO;
+        }
+        
+        // Anything else compressed is taken for a raw disk image
+        return ImageType::IMG;
+    }
+    
     // Check file signature/magic bytes
     QFile file(imagePath);
     if (file.open(QIODevice::ReadOnly)) {
@@ -130,7 +187,8 @@ QString ImageHandler::imageTypeToString(ImageType type)
 
 QStringList ImageHandler::getSupportedExtensions()
 {
-    return {"*.iso", "*.img", "*.dmg", "*.vhd", "*.vhdx", "*.vmdk"};
+    return QStringList({"*.iso", "*.img", "*.dmg", "*.vhd", "*.vhdx", "*.vmdk"})
+           << ImageSource::compressedExtensions();
 }
 
 bool ImageHandler::isImageBootable(const QString &imagePath)
@@ -435,16 +493,19 @@ bool ImageHandler::hasEFIBootloader(const QString &imagePath)
 
 bool ImageHandler::hasMBRBootloader(const QString &imagePath)
 {
-    QFile file(imagePath);
-    if (!file.open(QIODevice::ReadOnly)) {
+    // Compressed images are decoded as far as the boot sector
+    ImageSource source;
+    if (!source.open(imagePath)) {
         return false;
     }
     
     // Check for MBR signature
-    file.seek(510);
-    QByteArray signature = file.read(2);
+    QByteArray sector(512, 0);
+    if (source.read(sector.data(), sector.size()) != sector.size()) {
+        return false;
+    }
     
-    return signature == QByteArray::fromHex("55AA");
+    return sector.mid(510, 2) == QByteArray::fromHex("55AA");
 }
 
 QString ImageHandler::detectFileSystemFromISO(const QString &imagePath)
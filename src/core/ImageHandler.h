@@ -4,6 +4,7 @@
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include "ImageSource.h"
 
 enum class ImageType {
     Unknown,
@@ -18,7 +19,9 @@ enum class ImageType {
 struct ImageInfo {
     QString filePath;
     ImageType type;
-    qint64 size;
+    qint64 size;                    // Uncompressed; -1 if a gzip or bzip2 image does not say
+    ImageSource::Compression compression;
+    qint64 compressedSize;
     QString sizeString;
     bool isBootable;
     QString label;
@@ -27,6 +30,11 @@ struct ImageInfo {
     QStringList bootLoaders;
     bool isValid;
     QString errorMessage;
+    
+    // Sibling bmaptool block map, if one was found
+    QString bmapPath;
+    qint64 mappedBytes;
+    double mappedFraction;
 };
 
 class ImageHandler : public QObject
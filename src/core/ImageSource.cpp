@@ -0,0 +1,954 @@
+#include "ImageSource.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QMutexLocker>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include <lzma.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <sys/mman.h>
+#endif
+
+// Decoded data is handed to read() in blocks of this size, with at most
+// QueueBytes of it waiting; a slow device holds the decoder back
+static const qint64 BlockSize = 4 * 1024 * 1024;
+static const qint64 QueueBytes = 64 * 1024 * 1024;
+static const qint64 InputSize = 1024 * 1024;
+
+// bzip2 input is collected this much at a time and cut at stream boundaries
+static const qint64 Bzip2BatchInput = 16 * 1024 * 1024;
+// No second stream within this much input means a plain single stream file
+static const qint64 Bzip2SingleStreamLimit = 64 * 1024 * 1024;
+
+ImageSource::ImageSource()
+    : m_fd(-1)
+    , m_compression(None)
+    , m_compressedSize(0)
+    , m_size(-1)
+    , m_position(0)
+    , m_compressedPosition(0)
+    , m_decodedBytes(0)
+    , m_decoder(nullptr)
+    , m_queuedBytes(0)
+    , m_decodeFinished(false)
+    , m_stopped(false)
+    , m_currentOffset(0)
+{
+}
+
+ImageSource::~ImageSource()
+{
+    close();
+}
+
+bool ImageSource::open(const QString &path)
+{
+    close();
+    
+    m_compression = detectCompression(path);
+    if (!isSupported(m_compression)) {
+        m_errorString = QString("%1 compressed images are not supported by this build")
+                        .arg(compressionName(m_compression));
+        return false;
+    }
+    
+    QByteArray localPath = path.toLocal8Bit();
+    m_fd = ::open(localPath.constData(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        m_errorString = QString("Cannot open image: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        m_errorString = QString("Cannot stat image: %1").arg(strerror(errno));
+        close();
+        return false;
+    }
+    m_compressedSize = st.st_size;
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    m_position.storeRelaxed(0);
+    m_compressedPosition.storeRelaxed(0);
+    m_decodedBytes.storeRelaxed(0);
+    m_decodeFinished = false;
+    m_stopped = false;
+    m_errorString.clear();
+    
+    switch (m_compression) {
+        case None:
+            m_size.storeRelaxed(m_compressedSize);
+            return true;
+        case Xz:
+            m_size.storeRelaxed(xzUncompressedSize(m_fd));
+            break;
+        case Zstd:
+            m_size.storeRelaxed(zstdUncompressedSize(m_fd));
+            break;
+        default:
+            m_size.storeRelaxed(-1);
+            break;
+    }
+    
+    m_decoder = QThread::create([this]() { decodeLoop(); });
+    m_decoder->start();
+    return true;
+}
+
+void ImageSource::close()
+{
+    if (m_decoder) {
+        QMutexLocker locker(&m_mutex);
+        m_stopped = true;
+        m_blockTaken.wakeAll();
+        locker.unlock();
+        
+        m_decoder->wait();
+        delete m_decoder;
+        m_decoder = nullptr;
+    }
+    
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    
+    m_blocks.clear();
+    m_queuedBytes = 0;
+    m_current.clear();
+    m_currentOffset = 0;
+}
+
+qint64 ImageSource::read(char *data, qint64 length)
+{
+    if (m_fd < 0) {
+        return -1;
+    }
+    
+    qint64 done = 0;
+    
+    if (m_compression == None) {
+        qint64 position = m_position.loadRelaxed();
+        while (done < length) {
+            ssize_t count = pread(m_fd, data + done, length - done, position + done);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                QMutexLocker locker(&m_mutex);
+                m_errorString = QString("Read error: %1").arg(strerror(errno));
+                return -1;
+            }
+            if (count == 0) {
+                break;
+            }
+            done += count;
+        }
+        
+        // The image is streamed once; keep it from evicting everything else
+        posix_fadvise(m_fd, position, done, POSIX_FADV_DONTNEED);
+        m_position.fetchAndAddRelaxed(done);
+        return done;
+    }
+    
+    while (done < length) {
+        if (m_currentOffset >= m_current.size()) {
+            QMutexLocker locker(&m_mutex);
+            while (m_blocks.isEmpty() && !m_decodeFinished) {
+                m_blockAdded.wait(&m_mutex);
+            }
+            if (m_blocks.isEmpty()) {
+                // A decode error ends the image early; report it once the
+                // blocks decoded before it are used up
+                if (!m_errorString.isEmpty()) {
+                    return -1;
+                }
+                break;
+            }
+            
+            m_current = m_blocks.dequeue();
+            m_queuedBytes -= m_current.size();
+            m_currentOffset = 0;
+            m_blockTaken.wakeAll();
+        }
+        
+        qint64 count = qMin<qint64>(length - done, m_current.size() - m_currentOffset);
+        memcpy(data + done, m_current.constData() + m_currentOffset, count);
+        m_currentOffset += count;
+        done += count;
+    }
+    
+    m_position.fetchAndAddRelaxed(done);
+    return done;
+}
+
+bool ImageSource::skip(qint64 length)
+{
+    if (m_compression == None) {
+        m_position.fetchAndAddRelaxed(length);
+        return true;
+    }
+    
+    // Compressed data can only be skipped by decoding it
+    QByteArray scratch(int(qMin(length, BlockSize)), Qt::Uninitialized);
+    while (length > 0) {
+        qint64 count = read(scratch.data(), qMin<qint64>(length, scratch.size()));
+        if (count <= 0) {
+            return false;
+        }
+        length -= count;
+    }
+    return true;
+}
+
+qint64 ImageSource::estimatedSize() const
+{
+    qint64 size = m_size.loadRelaxed();
+    if (size >= 0) {
+        return size;
+    }
+    
+    // Assume the rest of the file compresses like the part decoded so far
+    qint64 consumed = m_compressedPosition.loadRelaxed();
+    qint64 decoded = m_decodedBytes.loadRelaxed();
+    if (consumed <= 0 || decoded <= 0) {
+        return m_compressedSize;
+    }
+    return qMax(decoded, qint64(double(decoded) * m_compressedSize / consumed));
+}
+
+QString ImageSource::errorString() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_errorString;
+}
+
+ImageSource::Compression ImageSource::detectCompression(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return None;
+    }
+    
+    // Formats are told apart by their magic bytes, not the file name
+    QByteArray magic = file.read(10);
+    if (magic.startsWith("\x1f\x8b")) {
+        return Gzip;
+    }
+    if (magic.startsWith(QByteArray("\xfd" "7zXZ\x00", 6))) {
+        return Xz;
+    }
+    if (magic.startsWith("\x28\xb5\x2f\xfd")) {
+        return Zstd;
+    }
+    if (magic.size() >= 4 && magic.startsWith("BZh") && magic[3] >= '1' && magic[3] <= '9') {
+        return Bzip2;
+    }
+    return None;
+}
+
+QString ImageSource::compressionName(Compression compression)
+{
+    switch (compression) {
+        case Gzip:
+            return "gzip";
+        case Bzip2:
+            return "bzip2";
+        case Xz:
+            return "xz";
+        case Zstd:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+bool ImageSource::isSupported(Compression compression)
+{
+#ifdef HAVE_ZSTD
+    Q_UNUSED(compression);
+    return true;
+#else
+    return compression != Zstd;
+#endif
+}
+
+qint64 ImageSource::imageSize(const QString &path)
+{
+    Compression compression = detectCompression(path);
+    if (compression == None) {
+        return QFileInfo(path).size();
+    }
+    if (compression != Xz && compression != Zstd) {
+        return -1;
+    }
+    
+    QByteArray localPath = path.toLocal8Bit();
+    int fd = ::open(localPath.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    qint64 size = compression == Xz ? xzUncompressedSize(fd) : zstdUncompressedSize(fd);
+    ::close(fd);
+    return size;
+}
+
+QStringList ImageSource::compressedExtensions()
+{
+    QStringList extensions = {"*.xz", "*.gz", "*.bz2"};
+#ifdef HAVE_ZSTD
+    extensions << "*.zst";
+#endif
+    return extensions;
+}
+
+QString ImageSource::uncompressedName(const QString &path)
+{
+    QString name = QFileInfo(path).fileName();
+    const QStringList suffixes = {".xz", ".gz", ".bz2", ".zst", ".zstd"};
+    for (const QString &suffix : suffixes) {
+        if (name.endsWith(suffix, Qt::CaseInsensitive)) {
+            name.chop(suffix.length());
+            break;
+        }
+    }
+    return name;
+}
+
+void ImageSource::decodeLoop()
+{
+    bool ok = false;
+    switch (m_compression) {
+        case Gzip:
+            ok = decodeGzip();
+            break;
+        case Bzip2:
+            ok = decodeBzip2();
+            break;
+        case Xz:
+            ok = decodeXz();
+            break;
+        case Zstd:
+            ok = decodeZstd();
+            break;
+        default:
+            break;
+    }
+    
+    QMutexLocker locker(&m_mutex);
+    if (ok && !m_stopped) {
+        qint64 decoded = m_decodedBytes.loadRelaxed();
+        qint64 expected = m_size.loadRelaxed();
+        if (expected >= 0 && expected != decoded) {
+            m_errorString = QString("Image decompressed to %1 bytes, but its header says %2")
+                            .arg(decoded).arg(expected);
+        } else {
+            m_size.storeRelaxed(decoded);
+        }
+    }
+    m_decodeFinished = true;
+    m_blockAdded.wakeAll();
+}
+
+bool ImageSource::decodeGzip()
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    
+    // 32 on top of the window bits accepts gzip as well as zlib headers
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        setDecodeError("Cannot start the gzip decoder");
+        return false;
+    }
+    
+    QByteArray input(int(InputSize), Qt::Uninitialized);
+    QByteArray output(int(BlockSize), Qt::Uninitialized);
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = uInt(output.size());
+    
+    bool endOfInput = false;
+    bool streamEnded = false;
+    bool ok = true;
+    
+    while (ok) {
+        if (stream.avail_in == 0 && !endOfInput) {
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                ok = false;
+                break;
+            }
+            endOfInput = count == 0;
+            stream.next_in = reinterpret_cast<Bytef *>(input.data());
+            stream.avail_in = uInt(count);
+        }
+        if (stream.avail_in == 0 && endOfInput) {
+            if (!streamEnded) {
+                setDecodeError("Compressed image is truncated");
+                ok = false;
+            }
+            break;
+        }
+        
+        int ret = inflate(&stream, Z_NO_FLUSH);
+        streamEnded = ret == Z_STREAM_END;
+        if (streamEnded) {
+            // Concatenated gzip members (pigz, split archives) make up one image
+            inflateReset(&stream);
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            setDecodeError(QString("Corrupt gzip data: %1").arg(stream.msg ? stream.msg : "unknown error"));
+            ok = false;
+            break;
+        }
+        
+        if (stream.avail_out == 0) {
+            ok = pushBlock(output, output.size());
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = uInt(output.size());
+        }
+    }
+    
+    if (ok) {
+        ok = pushBlock(output, output.size() - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    return ok;
+}
+
+bool ImageSource::decodeXz()
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+
+#if LZMA_VERSION >= 50040002
+    // Files compressed with xz -T are made of independent blocks, which the
+    // threaded decoder spreads over all cores; single block files decode on one
+    lzma_mt options;
+    memset(&options, 0, sizeof(options));
+    options.flags = LZMA_CONCATENATED;
+    options.threads = uint32_t(qMax(1, QThread::idealThreadCount()));
+    quint64 memory = lzma_physmem();
+    options.memlimit_threading = memory > 0 ? memory / 4 : UINT64_MAX;
+    options.memlimit_stop = UINT64_MAX;
+    lzma_ret ret = lzma_stream_decoder_mt(&stream, &options);
+#else
+    lzma_ret ret = lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED);
+#endif
+    if (ret != LZMA_OK) {
+        setDecodeError("Cannot start the xz decoder");
+        return false;
+    }
+    
+    QByteArray input(int(InputSize), Qt::Uninitialized);
+    QByteArray output(int(BlockSize), Qt::Uninitialized);
+    stream.next_out = reinterpret_cast<uint8_t *>(output.data());
+    stream.avail_out = size_t(output.size());
+    
+    lzma_action action = LZMA_RUN;
+    bool ok = true;
+    
+    while (true) {
+        if (stream.avail_in == 0 && action == LZMA_RUN) {
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                ok = false;
+                break;
+            }
+            if (count == 0) {
+                action = LZMA_FINISH;
+            }
+            stream.next_in = reinterpret_cast<const uint8_t *>(input.constData());
+            stream.avail_in = size_t(count);
+        }
+        
+        ret = lzma_code(&stream, action);
+        
+        if (stream.avail_out == 0 || ret == LZMA_STREAM_END) {
+            if (!pushBlock(output, output.size() - stream.avail_out)) {
+                ok = false;
+                break;
+            }
+            stream.next_out = reinterpret_cast<uint8_t *>(output.data());
+            stream.avail_out = size_t(output.size());
+        }
+        
+        if (ret == LZMA_STREAM_END) {
+            break;
+        }
+        if (ret != LZMA_OK) {
+            switch (ret) {
+                case LZMA_BUF_ERROR:
+                    setDecodeError("Compressed image is truncated");
+                    break;
+                case LZMA_MEM_ERROR:
+                case LZMA_MEMLIMIT_ERROR:
+                    setDecodeError("Not enough memory to decode the xz image");
+                    break;
+                default:
+                    setDecodeError("Corrupt xz data");
+                    break;
+            }
+            ok = false;
+            break;
+        }
+    }
+    
+    lzma_end(&stream);
+    return ok;
+}
+
+bool ImageSource::decodeZstd()
+{
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *stream = ZSTD_createDCtx();
+    if (!stream) {
+        setDecodeError("Cannot start the zstd decoder");
+        return false;
+    }
+    
+    // Images compressed with --long need a bigger window than the default limit
+    ZSTD_DCtx_setParameter(stream, ZSTD_d_windowLogMax, 31);
+    
+    QByteArray input(int(InputSize), Qt::Uninitialized);
+    QByteArray output(int(BlockSize), Qt::Uninitialized);
+    ZSTD_inBuffer in = {input.constData(), 0, 0};
+    ZSTD_outBuffer out = {output.data(), size_t(output.size()), 0};
+    
+    bool endOfInput = false;
+    bool ok = true;
+    
+    while (true) {
+        if (in.pos == in.size && !endOfInput) {
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                ok = false;
+                break;
+            }
+            endOfInput = count == 0;
+            in = {input.constData(), size_t(count), 0};
+        }
+        
+        size_t ret = ZSTD_decompressStream(stream, &out, &in);
+        if (ZSTD_isError(ret)) {
+            setDecodeError(QString("Corrupt zstd data: %1").arg(ZSTD_getErrorName(ret)));
+            ok = false;
+            break;
+        }
+        
+        // A full output buffer may leave more decoded data inside zstd
+        bool outputFull = out.pos == out.size;
+        if (outputFull) {
+            if (!pushBlock(output, out.pos)) {
+                ok = false;
+                break;
+            }
+            out = {output.data(), size_t(output.size()), 0};
+        }
+        
+        if (endOfInput && in.pos == in.size && !outputFull) {
+            // Anything but 0 means the last frame was cut short
+            if (ret != 0) {
+                setDecodeError("Compressed image is truncated");
+                ok = false;
+            }
+            break;
+        }
+    }
+    
+    if (ok) {
+        ok = pushBlock(output, out.pos);
+    }
+    ZSTD_freeDCtx(stream);
+    return ok;
+#else
+    setDecodeError("zstd support was not built in");
+    return false;
+#endif
+}
+
+bool ImageSource::decodeBzip2()
+{
+    // pbzip2 writes every block of input as a stream of its own; those are
+    // decoded a batch at a time on all cores. Files made by plain bzip2 are one
+    // stream, which can only be decoded from front to back.
+    int batchStreams = 4 * qMax(1, QThread::idealThreadCount());
+    QByteArray input;
+    bool endOfInput = false;
+    
+    while (!endOfInput) {
+        qint64 start = input.size();
+        input.resize(start + Bzip2BatchInput);
+        qint64 count = readInput(input.data() + start, Bzip2BatchInput);
+        if (count < 0) {
+            return false;
+        }
+        input.resize(start + count);
+        endOfInput = count < Bzip2BatchInput;
+        
+        QList<int> bounds = bzip2StreamStarts(input);
+        if (bounds.isEmpty() || bounds.first() != 0) {
+            bounds.prepend(0);
+        }
+        if (bounds.count() < 2 && !endOfInput) {
+            if (input.size() >= Bzip2SingleStreamLimit) {
+                return decodeBzip2Streams(input, true);
+            }
+            continue;
+        }
+        
+        // The last stream found may go on in input not read yet
+        int end = input.size();
+        if (!endOfInput) {
+            end = bounds.takeLast();
+        }
+        bounds.append(end);
+        
+        for (int first = 0; first + 1 < bounds.count(); first += batchStreams) {
+            int last = qMin(first + batchStreams, int(bounds.count()) - 1);
+            QVector<QByteArray> outputs;
+            if (!decodeBzip2Batch(input, bounds.mid(first, last - first + 1), outputs)) {
+                // "BZh" and the block magic can turn up inside compressed data
+                // too; then the pieces are not streams and order has to win
+                qWarning() << "bzip2 streams do not decode separately - decoding sequentially";
+                return decodeBzip2Streams(input.mid(bounds[first]), true);
+            }
+            for (QByteArray &output : outputs) {
+                if (!pushBlock(output, output.size())) {
+                    return false;
+                }
+            }
+        }
+        input.remove(0, end);
+    }
+    
+    return true;
+}
+
+bool ImageSource::decodeBzip2Streams(QByteArray input, bool readMore)
+{
+    bz_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+        setDecodeError("Cannot start the bzip2 decoder");
+        return false;
+    }
+    
+    QByteArray output(int(BlockSize), Qt::Uninitialized);
+    stream.next_in = input.data();
+    stream.avail_in = uint(input.size());
+    stream.next_out = output.data();
+    stream.avail_out = uint(output.size());
+    
+    bool endOfInput = !readMore;
+    bool streamEnded = false;
+    bool ok = true;
+    
+    while (ok) {
+        if (stream.avail_in == 0 && !endOfInput) {
+            input.resize(InputSize);
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                ok = false;
+                break;
+            }
+            endOfInput = count == 0;
+            stream.next_in = input.data();
+            stream.avail_in = uint(count);
+        }
+        if (stream.avail_in == 0 && endOfInput) {
+            if (!streamEnded) {
+                setDecodeError("Compressed image is truncated");
+                ok = false;
+            }
+            break;
+        }
+        
+        int ret = BZ2_bzDecompress(&stream);
+        streamEnded = ret == BZ_STREAM_END;
+        if (streamEnded) {
+            // Concatenated streams make up one image; bzlib has no reset, so
+            // start a new decoder on the remaining input
+            char *nextIn = stream.next_in;
+            uint availIn = stream.avail_in;
+            char *nextOut = stream.next_out;
+            uint availOut = stream.avail_out;
+            BZ2_bzDecompressEnd(&stream);
+            memset(&stream, 0, sizeof(stream));
+            if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+                setDecodeError("Cannot start the bzip2 decoder");
+                return false;
+            }
+            stream.next_in = nextIn;
+            stream.avail_in = availIn;
+            stream.next_out = nextOut;
+            stream.avail_out = availOut;
+        } else if (ret != BZ_OK) {
+            setDecodeError("Corrupt bzip2 data");
+            ok = false;
+            break;
+        }
+        
+        if (stream.avail_out == 0) {
+            ok = pushBlock(output, output.size());
+            stream.next_out = output.data();
+            stream.avail_out = uint(output.size());
+        }
+    }
+    
+    if (ok) {
+        ok = pushBlock(output, output.size() - stream.avail_out);
+    }
+    BZ2_bzDecompressEnd(&stream);
+    return ok;
+}
+
+bool ImageSource::decodeBzip2Batch(const QByteArray &input, const QList<int> &bounds,
+                                   QVector<QByteArray> &outputs)
+{
+    // Stream i runs from bounds[i] to bounds[i + 1]
+    int count = bounds.count() - 1;
+    outputs.resize(count);
+    QAtomicInt next(0);
+    QAtomicInt failed(0);
+    
+    auto worker = [&]() {
+        int stream;
+        while (!failed.loadRelaxed() && (stream = next.fetchAndAddRelaxed(1)) < count) {
+            int start = bounds[stream];
+            if (!decodeBzip2Stream(input.constData() + start, bounds[stream + 1] - start, outputs[stream])) {
+                failed.storeRelaxed(1);
+            }
+        }
+    };
+    
+    // The decoder thread takes a share of the streams too
+    QList<QThread *> workers;
+    int threads = qMin(count, qMax(1, QThread::idealThreadCount()));
+    for (int i = 1; i < threads; ++i) {
+        QThread *thread = QThread::create(worker);
+        thread->start();
+        workers.append(thread);
+    }
+    worker();
+    for (QThread *thread : workers) {
+        thread->wait();
+        delete thread;
+    }
+    
+    return !failed.loadRelaxed();
+}
+
+QList<int> ImageSource::bzip2StreamStarts(const QByteArray &input)
+{
+    // A stream starts with "BZh", the block size digit and the block header magic
+    static const QByteArray blockMagic("\x31\x41\x59\x26\x53\x59", 6);
+    
+    QList<int> starts;
+    for (int position = input.indexOf("BZh"); position >= 0; position = input.indexOf("BZh", position + 1)) {
+        if (position + 10 > input.size()) {
+            break;
+        }
+        char level = input[position + 3];
+        if (level >= '1' && level <= '9'
+                && memcmp(input.constData() + position + 4, blockMagic.constData(), 6) == 0) {
+            starts.append(position);
+        }
+    }
+    return starts;
+}
+
+bool ImageSource::decodeBzip2Stream(const char *data, qint64 length, QByteArray &output)
+{
+    bz_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (BZ2_bzDecompressInit(&stream, 0, 0) != BZ_OK) {
+        return false;
+    }
+    
+    // pbzip2 streams hold 900 kB of input each; grow as needed beyond that
+    output.resize(int(qMax<qint64>(length * 4, 1024 * 1024)));
+    stream.next_in = const_cast<char *>(data);
+    stream.avail_in = uint(length);
+    qint64 used = 0;
+    int ret = BZ_OK;
+    
+    while (ret == BZ_OK) {
+        if (used == output.size()) {
+            output.resize(output.size() * 2);
+        }
+        stream.next_out = output.data() + used;
+        stream.avail_out = uint(output.size() - used);
+        ret = BZ2_bzDecompress(&stream);
+        used = output.size() - stream.avail_out;
+        if (ret == BZ_OK && stream.avail_in == 0 && stream.avail_out > 0) {
+            break;
+        }
+    }
+    BZ2_bzDecompressEnd(&stream);
+    
+    // Only a stream that ends exactly where the next one starts was a real one
+    output.resize(int(used));
+    return ret == BZ_STREAM_END && stream.avail_in == 0;
+}
+
+qint64 ImageSource::readInput(char *data, qint64 length)
+{
+    qint64 position = m_compressedPosition.loadRelaxed();
+    qint64 done = 0;
+    
+    while (done < length) {
+        ssize_t count = pread(m_fd, data + done, length - done, position + done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            setDecodeError(QString("Read error in compressed image: %1").arg(strerror(errno)));
+            return -1;
+        }
+        if (count == 0) {
+            break;
+        }
+        done += count;
+    }
+    
+    posix_fadvise(m_fd, position, done, POSIX_FADV_DONTNEED);
+    m_compressedPosition.fetchAndAddRelaxed(done);
+    return done;
+}
+
+bool ImageSource::pushBlock(QByteArray &block, qint64 used)
+{
+    if (used > 0) {
+        if (used < block.size()) {
+            block.truncate(int(used));
+        }
+        
+        QMutexLocker locker(&m_mutex);
+        while (m_queuedBytes >= QueueBytes && !m_stopped) {
+            m_blockTaken.wait(&m_mutex);
+        }
+        if (m_stopped) {
+            return false;
+        }
+        
+        m_blocks.enqueue(block);
+        m_queuedBytes += used;
+        m_decodedBytes.fetchAndAddRelaxed(used);
+        m_blockAdded.wakeAll();
+    }
+    
+    // The queued block now belongs to read(); decode on into a fresh one
+    block = QByteArray(int(BlockSize), Qt::Uninitialized);
+    return true;
+}
+
+void ImageSource::setDecodeError(const QString &message)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_errorString.isEmpty()) {
+        m_errorString = message;
+        qWarning() << "ImageSource:" << message;
+    }
+}
+
+qint64 ImageSource::xzUncompressedSize(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    
+    // Walk the streams from the back: each ends in a footer giving the size of
+    // its index, and the index gives the stream's sizes
+    qint64 position = st.st_size;
+    qint64 total = 0;
+    
+    while (position > 0) {
+        uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+        if (position < 2 * LZMA_STREAM_HEADER_SIZE
+                || pread(fd, footer, LZMA_STREAM_HEADER_SIZE, position - LZMA_STREAM_HEADER_SIZE) != LZMA_STREAM_HEADER_SIZE) {
+            return -1;
+        }
+        
+        // Stream padding between streams comes in multiples of four zero bytes
+        static const uint8_t padding[4] = {0, 0, 0, 0};
+        if (memcmp(footer + LZMA_STREAM_HEADER_SIZE - 4, padding, 4) == 0) {
+            position -= 4;
+            continue;
+        }
+        
+        lzma_stream_flags flags;
+        if (lzma_stream_footer_decode(&flags, footer) != LZMA_OK) {
+            return -1;
+        }
+        qint64 indexSize = qint64(flags.backward_size);
+        qint64 indexOffset = position - LZMA_STREAM_HEADER_SIZE - indexSize;
+        if (indexOffset < LZMA_STREAM_HEADER_SIZE) {
+            return -1;
+        }
+        
+        QByteArray indexData(int(indexSize), Qt::Uninitialized);
+        if (pread(fd, indexData.data(), indexSize, indexOffset) != indexSize) {
+            return -1;
+        }
+        
+        lzma_index *index = nullptr;
+        uint64_t memlimit = UINT64_MAX;
+        size_t inPosition = 0;
+        if (lzma_index_buffer_decode(&index, &memlimit, nullptr,
+                                     reinterpret_cast<const uint8_t *>(indexData.constData()),
+                                     &inPosition, size_t(indexSize)) != LZMA_OK) {
+            return -1;
+        }
+        total += qint64(lzma_index_uncompressed_size(index));
+        position -= qint64(lzma_index_file_size(index));
+        lzma_index_end(index, nullptr);
+    }
+    
+    return position == 0 ? total : -1;
+}
+
+qint64 ImageSource::zstdUncompressedSize(int fd)
+{
+#ifdef HAVE_ZSTD
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        return -1;
+    }
+    
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    
+    // zstd writes the content size into every frame header unless it was
+    // streaming from a pipe; add up the frames, skippable ones count as 0
+    const char *bytes = static_cast<const char *>(data);
+    qint64 position = 0;
+    qint64 total = 0;
+    while (total >= 0 && position < st.st_size) {
+        size_t remaining = size_t(st.st_size - position);
+        unsigned long long contentSize = ZSTD_getFrameContentSize(bytes + position, remaining);
+        size_t frameSize = ZSTD_findFrameCompressedSize(bytes + position, remaining);
+        if (contentSize == ZSTD_CONTENTSIZE_UNKNOWN || contentSize == ZSTD_CONTENTSIZE_ERROR
+                || ZSTD_isError(frameSize)) {
+            total = -1;
+            break;
+        }
+        total += qint64(contentSize);
+        position += qint64(frameSize);
+    }
+    
+    munmap(data, st.st_size);
+    return total;
+#else
+    Q_UNUSED(fd);
+    return -1;
+#endif
+}
@@ -0,0 +1,117 @@
+#ifndef IMAGESOURCE_H
+#define IMAGESOURCE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QQueue>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+
+class QThread;
+
+// Sequential reader for image files, compressed or not. Compressed images
+// (gzip, bzip2, xz and, when built with libzstd, zstd) are decoded on a thread
+// of their own into a bounded queue of blocks, so decompression overlaps with
+// writing instead of needing a decompressed copy on disk.
+//
+// xz goes through liblzma's multi-threaded decoder, which decodes the blocks of
+// multi-block files (xz -T) in parallel. bzip2 files made of many streams, as
+// pbzip2 writes them, are decoded a batch of streams at a time on all cores.
+//
+// The uncompressed size comes from the xz index or the zstd frame headers.
+// gzip and bzip2 do not record it, so it is only known once the end is reached.
+class ImageSource
+{
+public:
+    enum Compression {
+        None,
+        Gzip,
+        Bzip2,
+        Xz,
+        Zstd
+    };
+    
+    ImageSource();
+    ~ImageSource();
+    
+    bool open(const QString &path);
+    void close();
+    
+    Compression compression() const { return m_compression; }
+    bool isCompressed() const { return m_compression != None; }
+    
+    // Uncompressed size, or -1 while it is not known
+    qint64 size() const { return m_size.loadRelaxed(); }
+    
+    // Reads up to length bytes; less only at the end of the image. -1 on errors.
+    qint64 read(char *data, qint64 length);
+    bool skip(qint64 length);
+    
+    // Uncompressed bytes consumed so far
+    qint64 position() const { return m_position.loadRelaxed(); }
+    
+    // size() when known, otherwise extrapolated from how much of the file was decoded
+    qint64 estimatedSize() const;
+    
+    QString errorString() const;
+    
+    static Compression detectCompression(const QString &path);
+    static QString compressionName(Compression compression);
+    static bool isSupported(Compression compression);
+    
+    // Uncompressed size of an image file without decoding it, or -1
+    static qint64 imageSize(const QString &path);
+    
+    // Name filters for the compressed formats this build can read
+    static QStringList compressedExtensions();
+    
+    // The image's own file name with a compression suffix removed
+    static QString uncompressedName(const QString &path);
+
+private:
+    // Decoder thread
+    void decodeLoop();
+    bool decodeGzip();
+    bool decodeXz();
+    bool decodeZstd();
+    bool decodeBzip2();
+    bool decodeBzip2Streams(QByteArray input, bool readMore);
+    bool decodeBzip2Batch(const QByteArray &input, const QList<int> &bounds, QVector<QByteArray> &outputs);
+    static QList<int> bzip2StreamStarts(const QByteArray &input);
+    static bool decodeBzip2Stream(const char *data, qint64 length, QByteArray &output);
+    
+    qint64 readInput(char *data, qint64 length);
+    bool pushBlock(QByteArray &block, qint64 used);
+    void setDecodeError(const QString &message);
+    
+    static qint64 xzUncompressedSize(int fd);
+    static qint64 zstdUncompressedSize(int fd);
+    
+    int m_fd;
+    Compression m_compression;
+    qint64 m_compressedSize;
+    QAtomicInteger<qint64> m_size;
+    QAtomicInteger<qint64> m_position;
+    QAtomicInteger<qint64> m_compressedPosition;
+    QAtomicInteger<qint64> m_decodedBytes;
+    
+    // Decoded blocks on their way from the decoder thread to read()
+    QThread *m_decoder;
+    QQueue<QByteArray> m_blocks;
+    qint64 m_queuedBytes;
+    bool m_decodeFinished;
+    bool m_stopped;
+    mutable QMutex m_mutex;
+    QWaitCondition m_blockAdded;
+    QWaitCondition m_blockTaken;
+    
+    QByteArray m_current;           // Block read() is working through
+    int m_currentOffset;
+    
+    QString m_errorString;          // Guarded by m_mutex
+};
+
+#endif // IMAGESOURCE_H
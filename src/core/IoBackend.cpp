@@ -0,0 +1,389 @@
+#include "IoBackend.h"
+#include <QDebug>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Blocks O_DIRECT reads are rounded up to
+static const qint64 DirectIOBlockSize = 4096;
+
+static int ioUringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return int(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return int(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int ringFd, unsigned opcode, void *arg, unsigned count)
+{
+    return int(syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+IoBackend *IoBackend::create(WriteBackend type, int fd, int queueDepth)
+{
+    if (type != WriteBackend::Pwrite && queueDepth > 1) {
+        IoUringBackend *backend = new IoUringBackend(fd, queueDepth);
+        if (backend->isValid()) {
+            return backend;
+        }
+        
+        qWarning() << "io_uring unavailable, falling back to pwrite:" << backend->errorString();
+        delete backend;
+    }
+    
+    return new PwriteBackend(fd);
+}
+
+bool IoBackend::readFully(int fd, char *data, qint64 length, qint64 offset)
+{
+    while (length > 0) {
+        ssize_t result = pread(fd, data, length, offset);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (result == 0) {
+            errno = EIO; // Source shrank while we were reading it
+            return false;
+        }
+        data += result;
+        offset += result;
+        length -= result;
+    }
+    return true;
+}
+
+bool IoBackend::readAligned(int fd, char *data, qint64 length, qint64 offset, bool directIO)
+{
+    // O_DIRECT only reads whole blocks; the block holding the end of the
+    // image is still part of the device, so the rounded up read stays inside it
+    qint64 readLength = directIO ? (length + DirectIOBlockSize - 1) / DirectIOBlockSize * DirectIOBlockSize : length;
+    qint64 done = 0;
+    while (done < length) {
+        ssize_t count = pread(fd, data + done, readLength - done, offset + done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return false;
+        }
+        if (count == 0) {
+            errno = ENODATA;
+            return false;
+        }
+        done += count;
+    }
+    
+    // Without O_DIRECT the pages are only needed until they are compared; a
+    // long read back should not push the rest of the desktop out of memory
+    if (!directIO) {
+        posix_fadvise(fd, offset, done, POSIX_FADV_DONTNEED);
+    }
+    return true;
+}
+
+void IoBackend::dropDirectIO(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+    
+    // Buffered reads must not be answered from pages the write left behind, so
+    // flush the device's buffer cache first; readAligned() drops what it reads
+    if (ioctl(fd, BLKFLSBUF, 0) != 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+}
+
+bool IoBackend::writeFully(int fd, const char *data, qint64 length, qint64 offset)
+{
+    while (length > 0) {
+        ssize_t result = pwrite(fd, data, length, offset);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (result == 0) {
+            errno = ENOSPC;
+            return false;
+        }
+        data += result;
+        offset += result;
+        length -= result;
+    }
+    return true;
+}
+
+PwriteBackend::PwriteBackend(int fd)
+    : m_fd(fd)
+{
+}
+
+bool PwriteBackend::submitWrite(const IoRequest &request, QList<IoRequest> &completed)
+{
+    if (!writeFully(m_fd, request.data, request.length, request.offset)) {
+        m_errorString = QString("Write error at offset %1: %2").arg(request.offset).arg(strerror(errno));
+        return false;
+    }
+    
+    completed.append(request);
+    return true;
+}
+
+bool PwriteBackend::drain(QList<IoRequest> &completed)
+{
+    Q_UNUSED(completed)
+    return true;
+}
+
+IoUringBackend::IoUringBackend(int fd, int queueDepth)
+    : m_fd(fd)
+    , m_ringFd(-1)
+    , m_queueDepth(queueDepth)
+    , m_queueLimit(queueDepth)
+    , m_inFlight(0)
+    , m_sqRing(MAP_FAILED)
+    , m_cqRing(MAP_FAILED)
+    , m_sqes(MAP_FAILED)
+    , m_sqRingSize(0)
+    , m_cqRingSize(0)
+    , m_sqesSize(0)
+    , m_sqTail(nullptr)
+    , m_sqMask(nullptr)
+    , m_sqArray(nullptr)
+    , m_cqHead(nullptr)
+    , m_cqTail(nullptr)
+    , m_cqMask(nullptr)
+    , m_cqes(nullptr)
+{
+    if (!setupRing()) {
+        destroyRing();
+    }
+}
+
+IoUringBackend::~IoUringBackend()
+{
+    QList<IoRequest> completed;
+    if (m_ringFd >= 0) {
+        drain(completed);
+    }
+    destroyRing();
+}
+
+bool IoUringBackend::setupRing()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    
+    m_ringFd = ioUringSetup(m_queueDepth, &params);
+    if (m_ringFd < 0) {
+        m_errorString = QString("io_uring_setup: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    // IORING_OP_WRITE needs Linux 5.6; older kernels only have the vectored opcodes
+    QByteArray probeData(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe *>(probeData.data());
+    if (ioUringRegister(m_ringFd, IORING_REGISTER_PROBE, probe, 256) < 0
+        || probe->last_op < IORING_OP_WRITE
+        || !(probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED)) {
+        m_errorString = "kernel does not support IORING_OP_WRITE";
+        return false;
+    }
+    
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        m_sqRingSize = m_cqRingSize = qMax(m_sqRingSize, m_cqRingSize);
+    }
+    
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_ringFd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_errorString = QString("mmap SQ ring: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_ringFd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_errorString = QString("mmap CQ ring: %1").arg(strerror(errno));
+            return false;
+        }
+    }
+    
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  m_ringFd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+        m_errorString = QString("mmap SQEs: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    char *sq = static_cast<char *>(m_sqRing);
+    m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    
+    char *cq = static_cast<char *>(m_cqRing);
+    m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+    
+    // The kernel may round the ring up; never queue more than was asked for
+    m_queueDepth = qMin<int>(m_queueDepth, params.sq_entries);
+    m_slots.clear();
+    m_freeSlots.clear();
+    for (int i = 0; i < m_queueDepth; ++i) {
+        IoRequest request = {-1, nullptr, 0, 0};
+        m_slots.append(request);
+        m_freeSlots.append(i);
+    }
+    
+    return true;
+}
+
+void IoUringBackend::destroyRing()
+{
+    if (m_sqes != MAP_FAILED) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = MAP_FAILED;
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = MAP_FAILED;
+    if (m_sqRing != MAP_FAILED) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = MAP_FAILED;
+    }
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+        m_ringFd = -1;
+    }
+}
+
+bool IoUringBackend::submitWrite(const IoRequest &request, QList<IoRequest> &completed)
+{
+    // Reap without blocking first, then wait only if the queue is full
+    if (!reapCompletions(completed)) {
+        return false;
+    }
+    while (m_freeSlots.isEmpty() || m_inFlight >= m_queueLimit) {
+        if (!waitForCompletions(1, completed)) {
+            return false;
+        }
+    }
+    
+    int slot = m_freeSlots.takeLast();
+    m_slots[slot] = request;
+    
+    unsigned tail = *m_sqTail;
+    unsigned index = tail & *m_sqMask;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(m_sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = m_fd;
+    sqe->addr = reinterpret_cast<quint64>(request.data);
+    sqe->len = quint32(request.length);
+    sqe->off = quint64(request.offset);
+    sqe->user_data = quint64(slot);
+    m_sqArray[index] = index;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    
+    int result;
+    do {
+        result = ioUringEnter(m_ringFd, 1, 0, 0);
+    } while (result < 0 && errno == EINTR);
+    
+    if (result < 0) {
+        m_errorString = QString("io_uring_enter: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    ++m_inFlight;
+    return true;
+}
+
+bool IoUringBackend::drain(QList<IoRequest> &completed)
+{
+    while (m_inFlight > 0) {
+        if (!waitForCompletions(1, completed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IoUringBackend::waitForCompletions(unsigned minimum, QList<IoRequest> &completed)
+{
+    int result;
+    do {
+        result = ioUringEnter(m_ringFd, 0, minimum, IORING_ENTER_GETEVENTS);
+    } while (result < 0 && errno == EINTR);
+    
+    if (result < 0) {
+        m_errorString = QString("io_uring_enter: %1").arg(strerror(errno));
+        return false;
+    }
+    
+    return reapCompletions(completed);
+}
+
+bool IoUringBackend::reapCompletions(QList<IoRequest> &completed)
+{
+    bool ok = true;
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = static_cast<const struct io_uring_cqe *>(m_cqes) + (head & *m_cqMask);
+        int slot = int(cqe->user_data);
+        qint64 result = cqe->res;
+        ++head;
+        
+        IoRequest request = m_slots[slot];
+        m_freeSlots.append(slot);
+        --m_inFlight;
+        
+        if (result < 0) {
+            if (ok) {
+                m_errorString = QString("Write error at offset %1: %2").arg(request.offset).arg(strerror(int(-result)));
+            }
+            ok = false;
+            continue;
+        }
+        
+        // Short writes are rare on block devices; finish the remainder synchronously
+        if (result < request.length
+            && !writeFully(m_fd, request.data + result, request.length - result, request.offset + result)) {
+            if (ok) {
+                m_errorString = QString("Write error at offset %1: %2")
+                                .arg(request.offset + result).arg(strerror(errno));
+            }
+            ok = false;
+            continue;
+        }
+        
+        completed.append(request);
+    }
+    
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return ok;
+}
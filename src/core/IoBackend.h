@@ -0,0 +1,120 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <QList>
+#include <QString>
+#include "Burner.h"
+
+struct IoRequest {
+    int tag;        // Caller's buffer index, handed back on completion
+    char *data;
+    qint64 offset;
+    qint64 length;
+};
+
+// Device write path used by WriteEngine. Backends may keep several requests
+// in flight; completed requests are handed back so their buffers can be reused.
+class IoBackend
+{
+public:
+    virtual ~IoBackend() {}
+    
+    // Falls back to pwrite when io_uring is requested but unavailable
+    static IoBackend *create(WriteBackend type, int fd, int queueDepth);
+    
+    // Blocking helpers that retry on EINTR and short transfers
+    static bool readFully(int fd, char *data, qint64 length, qint64 offset);
+    static bool writeFully(int fd, const char *data, qint64 length, qint64 offset);
+    
+    // Reads a device back, through O_DIRECT when directIO says the descriptor
+    // has it; data must then be aligned and have room for length rounded up to
+    // 4 KiB. Fails with EINVAL when the device wants other alignment, and with
+    // ENODATA when it ends before the range does.
+    static bool readAligned(int fd, char *data, qint64 length, qint64 offset, bool directIO);
+    
+    // For readAligned() after EINVAL: reads through the page cache from then on
+    static void dropDirectIO(int fd);
+    
+    virtual QString name() const = 0;
+    virtual int queueDepth() const = 0;
+    
+    // Keep at most limit writes in flight, at most queueDepth(); used to try
+    // shallower queues on the same ring
+    virtual void setQueueLimit(int limit) { Q_UNUSED(limit) }
+    virtual int queueLimit() const { return queueDepth(); }
+    
+    // Queue a write, blocking while the queue is full
+    virtual bool submitWrite(const IoRequest &request, QList<IoRequest> &completed) = 0;
+    
+    // Wait until every queued write has completed
+    virtual bool drain(QList<IoRequest> &completed) = 0;
+    
+    QString errorString() const { return m_errorString; }
+
+protected:
+    QString m_errorString;
+};
+
+// Synchronous pwrite, one request at a time
+class PwriteBackend : public IoBackend
+{
+public:
+    explicit PwriteBackend(int fd);
+    
+    QString name() const override { return "pwrite"; }
+    int queueDepth() const override { return 1; }
+    bool submitWrite(const IoRequest &request, QList<IoRequest> &completed) override;
+    bool drain(QList<IoRequest> &completed) override;
+
+private:
+    int m_fd;
+};
+
+// io_uring through the raw syscalls, so no liburing dependency is needed
+class IoUringBackend : public IoBackend
+{
+public:
+    IoUringBackend(int fd, int queueDepth);
+    ~IoUringBackend();
+    
+    bool isValid() const { return m_ringFd >= 0; }
+    QString name() const override { return "io_uring"; }
+    int queueDepth() const override { return m_queueDepth; }
+    void setQueueLimit(int limit) override { m_queueLimit = qBound(1, limit, m_queueDepth); }
+    int queueLimit() const override { return m_queueLimit; }
+    bool submitWrite(const IoRequest &request, QList<IoRequest> &completed) override;
+    bool drain(QList<IoRequest> &completed) override;
+
+private:
+    bool setupRing();
+    void destroyRing();
+    bool waitForCompletions(unsigned minimum, QList<IoRequest> &completed);
+    bool reapCompletions(QList<IoRequest> &completed);
+    
+    int m_fd;
+    int m_ringFd;
+    int m_queueDepth;
+    int m_queueLimit;
+    int m_inFlight;
+    
+    // Shared ring memory
+    void *m_sqRing;
+    void *m_cqRing;
+    void *m_sqes;
+    size_t m_sqRingSize;
+    size_t m_cqRingSize;
+    size_t m_sqesSize;
+    
+    unsigned *m_sqTail;
+    unsigned *m_sqMask;
+    unsigned *m_sqArray;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned *m_cqMask;
+    void *m_cqes;
+    
+    QList<IoRequest> m_slots;
+    QList<int> m_freeSlots;
+};
+
+#endif // IOBACKEND_H
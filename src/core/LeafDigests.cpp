@@ -0,0 +1,67 @@
+#include "LeafDigests.h"
+
+void LeafDigests::append(const QByteArray &digest, qint64 length)
+{
+    m_leaves.append(digest);
+    m_size += length;
+}
+
+ByteRangeList LeafDigests::differences(const LeafDigests &other) const
+{
+    ByteRangeList ranges;
+    qint64 commonSize = qMin(m_size, other.m_size);
+    
+    int commonLeaves = qMin(count(), other.count());
+    for (int i = 0; i < commonLeaves; ++i) {
+        if (m_leaves[i] != other.m_leaves[i]) {
+            qint64 offset = i * LeafSize;
+            ranges.add(offset, qMin(LeafSize, commonSize - offset));
+        }
+    }
+    
+    // A shorter last leaf differs in its digest as well, so this only adds
+    // what lies past the end of the shorter stream
+    ranges.add(commonSize, qMax(m_size, other.m_size) - commonSize);
+    return ranges;
+}
+
+QString LeafDigests::describeMismatches(const ByteRangeList &ranges)
+{
+    const qint64 mb = 1024 * 1024;
+    return QString("Device content differs from the image in %1 %2, %3 MB in all")
+           .arg(ranges.count())
+           .arg(ranges.count() == 1 ? "place" : "places")
+           .arg((ranges.totalLength() + mb - 1) / mb);
+}
+
+LeafHasher::LeafHasher(VerifyHash algorithm)
+    : m_leaf(algorithm)
+    , m_leafLength(0)
+{
+}
+
+void LeafHasher::addData(const char *data, qint64 length)
+{
+    while (length > 0) {
+        qint64 take = qMin(LeafDigests::LeafSize - m_leafLength, length);
+        m_leaf.addData(data, take);
+        m_leafLength += take;
+        data += take;
+        length -= take;
+        
+        if (m_leafLength == LeafDigests::LeafSize) {
+            m_digests.append(m_leaf.result(), m_leafLength);
+            m_leaf.reset();
+            m_leafLength = 0;
+        }
+    }
+}
+
+LeafDigests LeafHasher::result() const
+{
+    LeafDigests digests = m_digests;
+    if (m_leafLength > 0) {
+        digests.append(m_leaf.result(), m_leafLength);
+    }
+    return digests;
+}
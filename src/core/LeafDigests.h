@@ -0,0 +1,56 @@
+#ifndef LEAFDIGESTS_H
+#define LEAFDIGESTS_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+#include "ByteRange.h"
+#include "StreamDigest.h"
+
+// Digests of consecutive 4 MiB leaves of an image or a device, hex like
+// StreamDigest. A digest of the whole stream only says whether a device
+// matches the image; comparing leaves also says where it does not, so a
+// failed verification can name the ranges that differ and a repair rewrite
+// just those.
+class LeafDigests
+{
+public:
+    static const qint64 LeafSize = 4 * 1024 * 1024;
+    
+    LeafDigests() : m_size(0) {}
+    
+    bool isEmpty() const { return m_leaves.isEmpty(); }
+    int count() const { return m_leaves.count(); }
+    qint64 size() const { return m_size; }      // Bytes the leaves cover
+    
+    void append(const QByteArray &digest, qint64 length);
+    
+    // Leaves whose digests differ, and whatever only one of the two covers
+    ByteRangeList differences(const LeafDigests &other) const;
+    
+    // How a verification that found these ranges different reports it
+    static QString describeMismatches(const ByteRangeList &ranges);
+
+private:
+    QVector<QByteArray> m_leaves;
+    qint64 m_size;
+};
+
+// Cuts a stream into leaves as it is added, in order from offset 0
+class LeafHasher
+{
+public:
+    explicit LeafHasher(VerifyHash algorithm);
+    
+    void addData(const char *data, qint64 length);
+    
+    // Leaves of everything added so far, the last one possibly shorter
+    LeafDigests result() const;
+
+private:
+    StreamDigest m_leaf;
+    qint64 m_leafLength;
+    LeafDigests m_digests;
+};
+
+#endif // LEAFDIGESTS_H
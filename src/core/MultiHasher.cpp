@@ -0,0 +1,262 @@
+#include "MultiHasher.h"
+#include "Blake3.h"
+#include "Sha256.h"
+#include <QThread>
+#include <QFile>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <string.h>
+
+// Enough buffers that the reader is not waiting for the slowest algorithm to
+// finish one before it can fill the next
+static const int BufferCount = 4;
+static const qint64 BufferSize = 4 * 1024 * 1024;
+
+static const int EndOfStream = -1;
+
+static QCryptographicHash::Algorithm cryptographicAlgorithm(MultiHasher::Algorithm algorithm)
+{
+    switch (algorithm) {
+        case MultiHasher::Md5: return QCryptographicHash::Md5;
+        case MultiHasher::Sha1: return QCryptographicHash::Sha1;
+        default: return QCryptographicHash::Sha512;
+    }
+}
+
+MultiHasher::MultiHasher(const QList<Algorithm> &algorithms)
+    : m_current(-1)
+    , m_finished(false)
+{
+    for (int i = 0; i < BufferCount; ++i) {
+        m_buffers.append(QByteArray(int(BufferSize), 0));
+        m_lengths.append(0);
+        m_bufferRefs.append(0);
+        m_freeBuffers.enqueue(i);
+    }
+    
+    for (Algorithm algorithm : algorithms) {
+        bool duplicate = false;
+        for (Worker *worker : m_workers) {
+            duplicate = duplicate || worker->algorithm == algorithm;
+        }
+        if (duplicate) {
+            continue;
+        }
+        
+        Worker *worker = new Worker;
+        worker->algorithm = algorithm;
+        worker->thread = QThread::create([this, worker]() { workerLoop(worker); });
+        m_workers.append(worker);
+        worker->thread->start();
+    }
+}
+
+MultiHasher::~MultiHasher()
+{
+    finish();
+    qDeleteAll(m_workers);
+}
+
+void MultiHasher::addData(const char *data, qint64 length)
+{
+    if (m_finished) {
+        return;
+    }
+    
+    while (length > 0) {
+        if (m_current < 0) {
+            m_current = takeFreeBuffer();
+            m_lengths[m_current] = 0;
+        }
+        
+        qint64 take = qMin(length, BufferSize - m_lengths[m_current]);
+        memcpy(m_buffers[m_current].data() + m_lengths[m_current], data, size_t(take));
+        m_lengths[m_current] += take;
+        data += take;
+        length -= take;
+        
+        if (m_lengths[m_current] == BufferSize) {
+            publishBuffer(m_current);
+            m_current = -1;
+        }
+    }
+}
+
+bool MultiHasher::addFile(const QString &path)
+{
+    QFile file(path);
+    if (m_finished || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    // Whatever addData left in a buffer goes first, then the file is read straight into the ring
+    if (m_current >= 0) {
+        publishBuffer(m_current);
+        m_current = -1;
+    }
+    
+    forever {
+        int index = takeFreeBuffer();
+        qint64 count = file.read(m_buffers[index].data(), BufferSize);
+        if (count <= 0) {
+            QMutexLocker locker(&m_mutex);
+            m_freeBuffers.enqueue(index);
+            return count == 0;
+        }
+        m_lengths[index] = count;
+        publishBuffer(index);
+    }
+}
+
+QByteArray MultiHasher::result(Algorithm algorithm)
+{
+    finish();
+    
+    for (Worker *worker : m_workers) {
+        if (worker->algorithm == algorithm) {
+            return worker->digest;
+        }
+    }
+    return QByteArray();
+}
+
+void MultiHasher::finish()
+{
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    
+    if (m_current >= 0) {
+        publishBuffer(m_current);
+        m_current = -1;
+    }
+    
+    {
+        QMutexLocker locker(&m_mutex);
+        for (Worker *worker : m_workers) {
+            worker->filledBuffers.enqueue(EndOfStream);
+        }
+        m_bufferFilled.wakeAll();
+    }
+    
+    for (Worker *worker : m_workers) {
+        worker->thread->wait();
+        delete worker->thread;
+        worker->thread = nullptr;
+    }
+}
+
+void MultiHasher::workerLoop(Worker *worker)
+{
+    // SHA-256 goes through Sha256 for the CPU's SHA instructions, and
+    // QCryptographicHash has no BLAKE3 (see Blake3)
+    QCryptographicHash hash(cryptographicAlgorithm(worker->algorithm));
+    ::Sha256 sha256;
+    ::Blake3 blake3;
+    
+    int index;
+    while ((index = takeFilledBuffer(worker)) != EndOfStream) {
+        const char *data = m_buffers[index].constData();
+        qint64 length = m_lengths[index];
+        switch (worker->algorithm) {
+            case Sha256: sha256.addData(data, length); break;
+            case Blake3: blake3.addDataParallel(data, length); break;
+            default: hash.addData(QByteArray::fromRawData(data, int(length))); break;
+        }
+        releaseBuffer(index);
+    }
+    
+    switch (worker->algorithm) {
+        case Sha256: worker->digest = sha256.result().toHex(); break;
+        case Blake3: worker->digest = blake3.result().toHex(); break;
+        default: worker->digest = hash.result().toHex(); break;
+    }
+}
+
+int MultiHasher::takeFreeBuffer()
+{
+    QMutexLocker locker(&m_mutex);
+    
+    while (m_freeBuffers.isEmpty()) {
+        m_bufferFreed.wait(&m_mutex);
+    }
+    return m_freeBuffers.dequeue();
+}
+
+int MultiHasher::takeFilledBuffer(Worker *worker)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    while (worker->filledBuffers.isEmpty()) {
+        m_bufferFilled.wait(&m_mutex);
+    }
+    return worker->filledBuffers.dequeue();
+}
+
+void MultiHasher::publishBuffer(int index)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    for (Worker *worker : m_workers) {
+        worker->filledBuffers.enqueue(index);
+    }
+    m_bufferRefs[index] = m_workers.count();
+    if (m_workers.isEmpty()) {
+        m_freeBuffers.enqueue(index);
+    }
+    m_bufferFilled.wakeAll();
+}
+
+void MultiHasher::releaseBuffer(int index)
+{
+    QMutexLocker locker(&m_mutex);
+    
+    if (--m_bufferRefs[index] == 0) {
+        m_freeBuffers.enqueue(index);
+        m_bufferFreed.wakeAll();
+    }
+}
+
+QString MultiHasher::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm) {
+        case Md5: return "md5";
+        case Sha1: return "sha1";
+        case Sha256: return "sha256";
+        case Sha512: return "sha512";
+        case Blake3: return "blake3";
+    }
+    return QString();
+}
+
+bool MultiHasher::algorithmFromName(const QString &name, Algorithm &algorithm)
+{
+    for (Algorithm candidate : allAlgorithms()) {
+        if (algorithmName(candidate) == name.toLower().remove('-')) {
+            algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+QList<MultiHasher::Algorithm> MultiHasher::allAlgorithms()
+{
+    return { Md5, Sha1, Sha256, Sha512, Blake3 };
+}
+
+QMap<MultiHasher::Algorithm, QByteArray> MultiHasher::hashFile(const QString &path,
+                                                               const QList<Algorithm> &algorithms)
+{
+    QMap<Algorithm, QByteArray> digests;
+    MultiHasher hasher(algorithms);
+    if (!hasher.addFile(path)) {
+        return digests;
+    }
+    
+    for (Algorithm algorithm : algorithms) {
+        digests.insert(algorithm, hasher.result(algorithm));
+    }
+    return digests;
+}
@@ -0,0 +1,81 @@
+#ifndef MULTIHASHER_H
+#define MULTIHASHER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QQueue>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+
+// Several digests of the same data from a single read. Release pages publish
+// MD5 for some images and SHA-256 or SHA-512 for others, and checking more than
+// one of them should not mean reading a multi-gigabyte image more than once.
+//
+// Data goes into a small ring of buffers that every algorithm hashes on a
+// thread of its own, so the digests are computed in parallel and the slowest
+// algorithm sets the pace instead of all of them added up.
+class MultiHasher
+{
+public:
+    enum Algorithm {
+        Md5,
+        Sha1,
+        Sha256,
+        Sha512,
+        Blake3
+    };
+    
+    explicit MultiHasher(const QList<Algorithm> &algorithms);
+    ~MultiHasher();
+    
+    void addData(const char *data, qint64 length);
+    
+    // Reads the file to the end into every digest; false when it cannot be read
+    bool addFile(const QString &path);
+    
+    // Hex digest of everything added, empty for an algorithm not asked for.
+    // Nothing can be added after the first result.
+    QByteArray result(Algorithm algorithm);
+    
+    // Lower case names as in sha256sum and friends
+    static QString algorithmName(Algorithm algorithm);
+    static bool algorithmFromName(const QString &name, Algorithm &algorithm);
+    static QList<Algorithm> allAlgorithms();
+    
+    // Hex digests of a file read once; empty when it cannot be read
+    static QMap<Algorithm, QByteArray> hashFile(const QString &path, const QList<Algorithm> &algorithms);
+
+private:
+    struct Worker {
+        Algorithm algorithm;
+        QThread *thread;
+        QQueue<int> filledBuffers;      // Guarded by m_mutex
+        QByteArray digest;
+    };
+    
+    void workerLoop(Worker *worker);
+    int takeFreeBuffer();
+    int takeFilledBuffer(Worker *worker);
+    void publishBuffer(int index);
+    void releaseBuffer(int index);
+    void finish();
+    
+    QVector<QByteArray> m_buffers;
+    QVector<qint64> m_lengths;
+    QVector<int> m_bufferRefs;          // Workers still hashing each buffer
+    QQueue<int> m_freeBuffers;
+    QList<Worker *> m_workers;
+    QMutex m_mutex;
+    QWaitCondition m_bufferFilled;
+    QWaitCondition m_bufferFreed;
+    
+    int m_current;                      // Buffer addData is filling, or -1
+    bool m_finished;
+};
+
+#endif // MULTIHASHER_H
@@ -0,0 +1,263 @@
+#include "Sha256.h"
+#include <QtEndian>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define SHA256_ARM
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#include <arm_neon.h>
+#endif
+
+static const quint32 InitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const quint32 RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static bool s_accelerationEnabled = true;
+
+#if defined(SHA256_X86)
+
+static bool cpuHasShaInstructions()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool ssse3 = ecx & (1 << 9);
+    bool sse41 = ecx & (1 << 19);
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool sha = ebx & (1 << 29);
+    return ssse3 && sse41 && sha;
+}
+
+// Four rounds per step with the message schedule four words ahead; the state
+// is kept as ABEF and CDGH, the layout sha256rnds2 works on
+__attribute__((target("sha,sse4.1")))
+static void compressBlocks(quint32 *state, const quint8 *data, qint64 blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+    
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i savedState0 = state0;
+        __m128i savedState1 = state1;
+        __m128i message[4];
+        
+        // Unrolled, so message[] stays in registers
+#pragma GCC unroll 16
+        for (int step = 0; step < 16; ++step) {
+            __m128i &current = message[step % 4];
+            __m128i &next = message[(step + 1) % 4];
+            __m128i &previous = message[(step + 3) % 4];
+            
+            if (step < 4) {
+                current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * step)),
+                                           byteSwap);
+            }
+            
+            __m128i words = _mm_add_epi32(current,
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(RoundConstants + 4 * step)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            if (step >= 3 && step < 15) {
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(words, 0x0E));
+            if (step >= 1 && step < 13) {
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+        
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+    }
+    
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+#elif defined(SHA256_ARM)
+
+static bool cpuHasShaInstructions()
+{
+    return getauxval(AT_HWCAP) & HWCAP_SHA2;
+}
+
+#if defined(__clang__)
+__attribute__((target("crypto")))
+#else
+__attribute__((target("+crypto")))
+#endif
+static void compressBlocks(quint32 *state, const quint8 *data, qint64 blocks)
+{
+    uint32x4_t state0 = vld1q_u32(state);
+    uint32x4_t state1 = vld1q_u32(state + 4);
+    
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32x4_t savedState0 = state0;
+        uint32x4_t savedState1 = state1;
+        uint32x4_t message[4];
+        for (int i = 0; i < 4; ++i) {
+            message[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+        
+        // Each step uses four words and schedules the four that come sixteen later
+        for (int step = 0; step < 16; ++step) {
+            uint32x4_t &current = message[step % 4];
+            uint32x4_t words = vaddq_u32(current, vld1q_u32(RoundConstants + 4 * step));
+            if (step < 12) {
+                current = vsha256su1q_u32(vsha256su0q_u32(current, message[(step + 1) % 4]),
+                                          message[(step + 2) % 4], message[(step + 3) % 4]);
+            }
+            
+            uint32x4_t previousState0 = state0;
+            state0 = vsha256hq_u32(state0, state1, words);
+            state1 = vsha256h2q_u32(state1, previousState0, words);
+        }
+        
+        state0 = vaddq_u32(state0, savedState0);
+        state1 = vaddq_u32(state1, savedState1);
+    }
+    
+    vst1q_u32(state, state0);
+    vst1q_u32(state + 4, state1);
+}
+
+#else
+
+static bool cpuHasShaInstructions()
+{
+    return false;
+}
+
+static void compressBlocks(quint32 *, const quint8 *, qint64)
+{
+}
+
+#endif
+
+Sha256::Sha256()
+    : m_accelerated(isAccelerated())
+    , m_fallback(QCryptographicHash::Sha256)
+{
+    reset();
+}
+
+void Sha256::reset()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+    m_blockLength = 0;
+    m_length = 0;
+    m_fallback.reset();
+}
+
+void Sha256::addData(const char *data, qint64 length)
+{
+    if (!m_accelerated) {
+        m_fallback.addData(QByteArray::fromRawData(data, int(length)));
+        return;
+    }
+    
+    const quint8 *input = reinterpret_cast<const quint8 *>(data);
+    m_length += quint64(length);
+    
+    if (m_blockLength > 0) {
+        int take = int(qMin<qint64>(64 - m_blockLength, length));
+        memcpy(m_block + m_blockLength, input, take);
+        m_blockLength += take;
+        input += take;
+        length -= take;
+        if (m_blockLength < 64) {
+            return;
+        }
+        compressBlocks(m_state, m_block, 1);
+        m_blockLength = 0;
+    }
+    
+    // Whole blocks straight from the caller's buffer
+    qint64 blocks = length / 64;
+    if (blocks > 0) {
+        compressBlocks(m_state, input, blocks);
+        input += blocks * 64;
+        length -= blocks * 64;
+    }
+    
+    memcpy(m_block, input, size_t(length));
+    m_blockLength = int(length);
+}
+
+QByteArray Sha256::result() const
+{
+    if (!m_accelerated) {
+        return m_fallback.result();
+    }
+    
+    // Padding: a one bit, zeros, and the length in bits, on a copy of the state
+    quint32 state[8];
+    memcpy(state, m_state, sizeof(state));
+    quint8 padding[128] = {};
+    memcpy(padding, m_block, m_blockLength);
+    padding[m_blockLength] = 0x80;
+    int paddedLength = m_blockLength < 56 ? 64 : 128;
+    qToBigEndian<quint64>(m_length * 8, padding + paddedLength - 8);
+    compressBlocks(state, padding, paddedLength / 64);
+    
+    QByteArray digest(DigestLength, 0);
+    for (int i = 0; i < 8; ++i) {
+        qToBigEndian<quint32>(state[i], digest.data() + 4 * i);
+    }
+    return digest;
+}
+
+QByteArray Sha256::hash(const QByteArray &data)
+{
+    Sha256 sha256;
+    sha256.addData(data);
+    return sha256.result();
+}
+
+bool Sha256::isAccelerated()
+{
+    static const bool supported = cpuHasShaInstructions();
+    return supported && s_accelerationEnabled;
+}
+
+QString Sha256::implementationName()
+{
+    if (!isAccelerated()) {
+        return "QCryptographicHash";
+    }
+#if defined(SHA256_X86)
+    return "SHA-NI";
+#else
+    return "ARMv8 SHA2";
+#endif
+}
+
+void Sha256::setAccelerationEnabled(bool enabled)
+{
+    s_accelerationEnabled = enabled;
+}
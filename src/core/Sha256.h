@@ -0,0 +1,46 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <QByteArray>
+#include <QString>
+#include <QCryptographicHash>
+
+// SHA-256 on the CPU's SHA instructions where it has them: SHA-NI on x86-64,
+// the ARMv8 cryptography extensions on AArch64. Verification hashes the whole
+// image and everything read back from the devices, and QCryptographicHash
+// alone cannot keep up with fast enclosures. Which path is taken is decided
+// once at runtime, so the same binary runs on CPUs without them, through
+// QCryptographicHash.
+class Sha256
+{
+public:
+    static const int DigestLength = 32;
+    
+    Sha256();
+    
+    void reset();
+    void addData(const char *data, qint64 length);
+    void addData(const QByteArray &data) { addData(data.constData(), data.size()); }
+    
+    // Raw digest of everything added, as QCryptographicHash::result()
+    QByteArray result() const;
+    
+    static QByteArray hash(const QByteArray &data);
+    
+    // Whether this CPU has SHA instructions, and which path is in use
+    static bool isAccelerated();
+    static QString implementationName();
+    
+    // Use QCryptographicHash even on a CPU with SHA instructions, to compare
+    static void setAccelerationEnabled(bool enabled);
+
+private:
+    bool m_accelerated;
+    quint32 m_state[8];
+    quint8 m_block[64];
+    int m_blockLength;
+    quint64 m_length;
+    QCryptographicHash m_fallback;
+};
+
+#endif // SHA256_H
@@ -0,0 +1,31 @@
+#include "StreamDigest.h"
+
+StreamDigest::StreamDigest(VerifyHash algorithm)
+    : m_algorithm(algorithm)
+{
+}
+
+void StreamDigest::reset()
+{
+    m_sha256.reset();
+    m_blake3.reset();
+}
+
+void StreamDigest::addData(const char *data, qint64 length)
+{
+    if (m_algorithm == VerifyHash::Blake3) {
+        m_blake3.addDataParallel(data, length);
+    } else {
+        m_sha256.addData(data, length);
+    }
+}
+
+QByteArray StreamDigest::result() const
+{
+    return m_algorithm == VerifyHash::Blake3 ? m_blake3.result().toHex() : m_sha256.result().toHex();
+}
+
+QString StreamDigest::algorithmName(VerifyHash algorithm)
+{
+    return algorithm == VerifyHash::Blake3 ? "blake3" : "sha256";
+}
@@ -0,0 +1,38 @@
+#ifndef STREAMDIGEST_H
+#define STREAMDIGEST_H
+
+#include <QByteArray>
+#include <QString>
+#include "Sha256.h"
+#include "Blake3.h"
+
+enum class VerifyHash {
+    Sha256,          // One stream, on the CPU's SHA instructions when it has them
+    Blake3           // Tree hash spread over every core
+};
+
+// The digest an image and the devices written from it are compared by.
+// SHA-256 is a single stream and so limited to one core; BLAKE3 hashes each
+// buffer's subtrees on all of them, which keeps hashing from being what
+// limits verification on hosts writing many devices at once.
+class StreamDigest
+{
+public:
+    explicit StreamDigest(VerifyHash algorithm);
+    
+    void reset();
+    void addData(const char *data, qint64 length);
+    
+    // Hex digest of everything added
+    QByteArray result() const;
+    
+    // As in the helper's digest events
+    static QString algorithmName(VerifyHash algorithm);
+
+private:
+    VerifyHash m_algorithm;
+    Sha256 m_sha256;
+    Blake3 m_blake3;
+};
+
+#endif // STREAMDIGEST_H
@@ -0,0 +1,455 @@
+#include "Verifier.h"
+#include "ImageSource.h"
+#include "VerifySample.h"
+#include "ZeroScan.h"
+#include "IoBackend.h"
+#include <QDebug>
+#include <QCryptographicHash>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+// The device is read back in pieces of this size; cancel() waits for at most one
+static const qint64 VerifyChunkSize = 8 * 1024 * 1024;
+static const qint64 BufferAlignment = 4096;
+static const qint64 ProgressIntervalMs = 100;
+
+Verifier::Verifier(const QString &imagePath, const QString &devicePath, QObject *parent)
+    : QThread(parent)
+    , m_imagePath(imagePath)
+    , m_devicePath(devicePath)
+    , m_digestAlgorithm(VerifyHash::Sha256)
+    , m_imageSize(-1)
+    , m_sampleFraction(0.0)
+    , m_sampleSeed(0)
+    , m_sampledBytes(0)
+    , m_sampleBaseBytes(0)
+    , m_sampleDetectableDamage(1.0)
+    , m_deviceFd(-1)
+    , m_directIO(false)
+    , m_buffer(nullptr)
+    , m_totalBytes(0)
+    , m_bytesVerified(0)
+    , m_success(false)
+{
+}
+
+Verifier::~Verifier()
+{
+    cancel();
+    wait();
+}
+
+void Verifier::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+    m_stopped.storeRelaxed(1);
+}
+
+void Verifier::run()
+{
+    m_progressTimer.start();
+    
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, BufferAlignment, VerifyChunkSize) != 0) {
+        fail("Failed to allocate verification buffer");
+        return;
+    }
+    m_buffer = static_cast<char *>(buffer);
+    
+    // Repaired ranges are checked in full, sample or not
+    bool verified = openDevice();
+    if (verified && !m_ranges.isEmpty()) {
+        verified = verifyMappedRanges();
+    } else if (verified && m_sampleFraction > 0) {
+        verified = verifySample();
+    } else if (verified) {
+        verified = m_bmapPath.isEmpty() ? verifyImage() : verifyMappedRanges();
+    }
+    
+    if (m_deviceFd >= 0) {
+        close(m_deviceFd);
+        m_deviceFd = -1;
+    }
+    free(m_buffer);
+    m_buffer = nullptr;
+    
+    if (isCancelled()) {
+        m_errorString = "Verification cancelled";
+        return;
+    }
+    m_success = verified;
+}
+
+bool Verifier::openDevice()
+{
+    QByteArray devicePath = m_devicePath.toLocal8Bit();
+    
+    // Reading around the page cache is what makes this a check of the device
+    m_deviceFd = open(devicePath.constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    m_directIO = m_deviceFd >= 0;
+    if (m_deviceFd < 0 && errno == EINVAL) {
+        m_deviceFd = open(devicePath.constData(), O_RDONLY | O_CLOEXEC);
+    }
+    if (m_deviceFd < 0) {
+        return fail(QString("Cannot open %1: %2").arg(m_devicePath).arg(strerror(errno)));
+    }
+    
+    if (!m_directIO) {
+        qWarning() << "O_DIRECT not supported on" << m_devicePath << "- dropping its cached pages instead";
+        dropDirectIO();
+    }
+    
+    // Tell the kernel the device is read once, front to back
+    posix_fadvise(m_deviceFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+void Verifier::dropDirectIO()
+{
+    IoBackend::dropDirectIO(m_deviceFd);
+    m_directIO = false;
+}
+
+bool Verifier::verifyImage()
+{
+    QByteArray imageDigest = m_imageDigest;
+    LeafDigests imageLeaves = m_imageLeaves;
+    m_totalBytes = m_imageSize >= 0 ? m_imageSize : ImageSource::imageSize(m_imagePath);
+    
+    // gzip and bzip2 images only tell their size once decoded, so that comes first
+    if (m_totalBytes < 0) {
+        emit statusChanged("Decompressing image to find its size...");
+        imageDigest = hashImage(&m_totalBytes, &imageLeaves);
+        if (isCancelled()) {
+            return false;
+        }
+    }
+    if (m_totalBytes <= 0) {
+        return fail("Cannot read image " + m_imagePath);
+    }
+    
+    emit statusChanged(QString("Verifying %1...").arg(m_devicePath));
+    advance(0, true);
+    
+    // The image is only hashed here when the write could not do it on the way.
+    // A cached digest of the whole image tells whether the device matches, and
+    // only a device that does not needs the image's leaves to say where.
+    bool compareWhole = imageLeaves.isEmpty() && !imageDigest.isEmpty();
+    QThread *imageHasher = nullptr;
+    if (imageLeaves.isEmpty() && !compareWhole) {
+        imageHasher = QThread::create([this, &imageDigest, &imageLeaves]() {
+            imageDigest = hashImage(nullptr, &imageLeaves);
+        });
+        imageHasher->start();
+    }
+    
+    LeafHasher deviceLeaves(m_digestAlgorithm);
+    StreamDigest deviceDigest(m_digestAlgorithm);
+    auto hash = [&](const char *data, qint64 length) {
+        deviceLeaves.addData(data, length);
+        if (compareWhole) {
+            deviceDigest.addData(data, length);
+        }
+    };
+    QByteArray zeros(int(VerifyChunkSize), 0);
+    qint64 position = 0;
+    bool ok = true;
+    
+    // Walk the device up to each skipped range, then stand in zeros for the range itself
+    QVector<ByteRange> ranges = m_zeroRanges.ranges();
+    ranges.append({m_totalBytes, 0});
+    
+    for (const ByteRange &zero : ranges) {
+        qint64 zeroStart = qMin(zero.offset, m_totalBytes);
+        qint64 zeroEnd = qMin(zero.end(), m_totalBytes);
+        
+        while (ok && position < zeroStart) {
+            qint64 chunk = qMin(VerifyChunkSize, zeroStart - position);
+            ok = readDevice(position, chunk);
+            if (ok) {
+                hash(m_buffer, chunk);
+                position += chunk;
+                advance(chunk);
+            }
+        }
+        
+        while (ok && position < zeroEnd) {
+            qint64 chunk = qMin(VerifyChunkSize, zeroEnd - position);
+            hash(zeros.constData(), chunk);
+            position += chunk;
+            advance(chunk);
+        }
+    }
+    
+    // The walk took the skipped ranges on trust; a seeded sample of them is
+    // read back to catch a discard that left old data behind
+    ByteRangeList image;
+    image.add(0, m_totalBytes);
+    VerifySample skipped(VerifySample::SkippedShare, m_sampleSeed);
+    skipped.sampleChunks(m_zeroRanges.intersected(image));
+    for (const ByteRange &range : skipped.ranges().ranges()) {
+        for (qint64 done = 0; ok && done < range.length; ) {
+            qint64 chunk = qMin(VerifyChunkSize, range.length - done);
+            ok = readDevice(range.offset + done, chunk);
+            if (ok && !ZeroScan::isZero(m_buffer, chunk)) {
+                addMismatches(range.offset + done, zeros.constData(), chunk);
+            }
+            done += chunk;
+        }
+    }
+    
+    if (imageHasher) {
+        // A failed device read stops the image hash early too
+        if (!ok) {
+            m_stopped.storeRelaxed(1);
+        }
+        imageHasher->wait();
+        delete imageHasher;
+    }
+    
+    if (!ok || isCancelled()) {
+        return false;
+    }
+    
+    advance(0, true);
+    bool matched = compareWhole && deviceDigest.result() == imageDigest;
+    if (compareWhole && !matched) {
+        emit statusChanged(QString("%1 differs from the image, finding where...").arg(m_devicePath));
+        hashImage(nullptr, &imageLeaves);
+        if (isCancelled()) {
+            return false;
+        }
+    }
+    if (!matched) {
+        if (imageLeaves.isEmpty()) {
+            return fail("Cannot read image " + m_imagePath);
+        }
+        m_imageDigest = imageDigest;
+        for (const ByteRange &range : imageLeaves.differences(deviceLeaves.result()).ranges()) {
+            m_mismatches.add(range);
+        }
+    }
+    if (!m_mismatches.isEmpty()) {
+        return fail(LeafDigests::describeMismatches(m_mismatches));
+    }
+    return true;
+}
+
+bool Verifier::verifyMappedRanges()
+{
+    if (m_ranges.isEmpty()) {
+        BlockMap blockMap;
+        if (!blockMap.load(m_bmapPath)) {
+            return fail("Cannot load block map: " + blockMap.errorString());
+        }
+        return verifyRanges(blockMap.ranges(), "mapped", blockMap.checksumAlgorithm());
+    }
+    
+    // A repair is checked where it wrote, against the image itself
+    QVector<BlockMap::Range> ranges;
+    qint64 imageSize = m_imageSize >= 0 ? m_imageSize : ImageSource::imageSize(m_imagePath);
+    for (const ByteRange &range : m_ranges.ranges()) {
+        qint64 length = imageSize >= 0 ? qMin(range.end(), imageSize) - range.offset : range.length;
+        if (length > 0) {
+            BlockMap::Range repaired = {range.offset, length, QByteArray()};
+            ranges.append(repaired);
+        }
+    }
+    return verifyRanges(ranges, "rewritten");
+}
+
+bool Verifier::verifySample()
+{
+    qint64 imageSize = m_imageSize >= 0 ? m_imageSize : ImageSource::imageSize(m_imagePath);
+    if (imageSize < 0) {
+        emit statusChanged("Decompressing image to find its size...");
+        hashImage(&imageSize);
+        if (isCancelled()) {
+            return false;
+        }
+    }
+    if (imageSize <= 0) {
+        return fail("Cannot read image " + m_imagePath);
+    }
+    
+    // Only what was written can be sampled. Ranges sparse writing skipped are
+    // zeros in the image too, so they stay in and show a discard that left old data
+    ByteRangeList candidates;
+    if (m_bmapPath.isEmpty()) {
+        candidates.add(0, imageSize);
+    } else {
+        BlockMap blockMap;
+        if (!blockMap.load(m_bmapPath)) {
+            return fail("Cannot load block map: " + blockMap.errorString());
+        }
+        candidates = blockMap.byteRanges();
+    }
+    emit statusChanged("Choosing what to sample...");
+    VerifySample sample(m_sampleFraction, m_sampleSeed);
+    if (!sample.plan(m_imagePath, imageSize, candidates)) {
+        return fail("Cannot read image " + m_imagePath);
+    }
+    m_sampledBytes = sample.ranges().totalLength();
+    m_sampleBaseBytes = candidates.totalLength();
+    m_sampleDetectableDamage = sample.detectableDamage();
+    
+    // Sampled ranges are compared with the image even under a block map, as
+    // its checksums cover whole mapped ranges
+    QVector<BlockMap::Range> ranges;
+    for (const ByteRange &range : sample.ranges().ranges()) {
+        BlockMap::Range sampled = {range.offset, range.length, QByteArray()};
+        ranges.append(sampled);
+    }
+    return verifyRanges(ranges, "sampled");
+}
+
+bool Verifier::verifyRanges(const QVector<BlockMap::Range> &ranges, const QString &description,
+                            QCryptographicHash::Algorithm checksumAlgorithm)
+{
+    ImageSource image;
+    if (!image.open(m_imagePath)) {
+        return fail("Cannot open image " + m_imagePath);
+    }
+    QByteArray imageData(int(VerifyChunkSize), 0);
+    
+    m_totalBytes = 0;
+    for (const BlockMap::Range &range : ranges) {
+        m_totalBytes += range.length;
+    }
+    emit statusChanged(QString("Verifying %1 ranges of %2...").arg(description).arg(m_devicePath));
+    advance(0, true);
+    
+    for (const BlockMap::Range &range : ranges) {
+        QCryptographicHash deviceHash(checksumAlgorithm);
+        bool compareImage = range.checksum.isEmpty();
+        
+        // Ranges come in order, so even a compressed image only moves forward
+        if (compareImage && !image.skip(range.offset - image.position())) {
+            return fail("Cannot read image " + m_imagePath);
+        }
+        
+        // Ranges without a checksum are compared against the image itself
+        for (qint64 done = 0; done < range.length; ) {
+            qint64 length = qMin(VerifyChunkSize, range.length - done);
+            if (!readDevice(range.offset + done, length)) {
+                return false;
+            }
+            if (compareImage) {
+                if (image.read(imageData.data(), length) != length) {
+                    return fail("Cannot read image " + m_imagePath);
+                }
+                if (memcmp(imageData.constData(), m_buffer, length) != 0) {
+                    addMismatches(range.offset + done, imageData.constData(), length);
+                }
+            } else {
+                deviceHash.addData(QByteArray::fromRawData(m_buffer, int(length)));
+            }
+            done += length;
+            advance(length);
+        }
+        
+        if (!compareImage && deviceHash.result().toHex() != range.checksum) {
+            m_mismatches.add(range.offset, range.length);
+        }
+    }
+    
+    advance(0, true);
+    if (!m_mismatches.isEmpty()) {
+        return fail(LeafDigests::describeMismatches(m_mismatches));
+    }
+    return true;
+}
+
+bool Verifier::readDevice(qint64 offset, qint64 length)
+{
+    if (isCancelled()) {
+        return false;
+    }
+    
+    while (!IoBackend::readAligned(m_deviceFd, m_buffer, length, offset, m_directIO)) {
+        if (errno == EINVAL && m_directIO) {
+            // The offset is not aligned to the device's logical block size
+            qWarning() << "Unaligned read on" << m_devicePath << "- continuing without O_DIRECT";
+            dropDirectIO();
+            continue;
+        }
+        if (errno == ENODATA) {
+            return fail(QString("%1 ends before the image does").arg(m_devicePath));
+        }
+        return fail(QString("Read error on %1 at offset %2: %3").arg(m_devicePath).arg(offset).arg(strerror(errno)));
+    }
+    return true;
+}
+
+void Verifier::addMismatches(qint64 offset, const char *image, qint64 length)
+{
+    // Narrowed down to the leaves that differ, as verifyImage() reports them
+    for (qint64 done = 0; done < length; ) {
+        qint64 leafEnd = ((offset + done) / LeafDigests::LeafSize + 1) * LeafDigests::LeafSize;
+        qint64 piece = qMin(leafEnd - (offset + done), length - done);
+        if (memcmp(image + done, m_buffer + done, piece) != 0) {
+            m_mismatches.add(offset + done, piece);
+        }
+        done += piece;
+    }
+}
+
+QByteArray Verifier::hashImage(qint64 *imageSize, LeafDigests *leaves)
+{
+    // ImageSource drops the pages it read, so the image does not evict everything else
+    ImageSource image;
+    if (!image.open(m_imagePath)) {
+        return QByteArray();
+    }
+    
+    StreamDigest hash(m_digestAlgorithm);
+    LeafHasher leafHash(m_digestAlgorithm);
+    QByteArray data(int(VerifyChunkSize), 0);
+    qint64 count;
+    do {
+        if (m_stopped.loadRelaxed()) {
+            return QByteArray();
+        }
+        count = image.read(data.data(), data.size());
+        if (count < 0) {
+            return QByteArray();
+        }
+        hash.addData(data.constData(), count);
+        if (leaves) {
+            leafHash.addData(data.constData(), count);
+        }
+    } while (count == data.size());
+    
+    if (imageSize) {
+        *imageSize = image.position();
+    }
+    if (leaves) {
+        *leaves = leafHash.result();
+    }
+    return hash.result();
+}
+
+void Verifier::advance(qint64 bytes, bool force)
+{
+    m_bytesVerified += bytes;
+    
+    if (!force && m_progressTimer.elapsed() < ProgressIntervalMs) {
+        return;
+    }
+    m_progressTimer.restart();
+    
+    emit progressChanged(m_bytesVerified, m_totalBytes);
+}
+
+bool Verifier::fail(const QString &message)
+{
+    // Keep the first error; later ones are usually consequences of it
+    if (m_errorString.isEmpty()) {
+        m_errorString = message;
+        qWarning() << "Verifier:" << message;
+    }
+    return false;
+}
@@ -0,0 +1,127 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QString>
+#include <QByteArray>
+#include "ByteRange.h"
+#include "StreamDigest.h"
+#include "LeafDigests.h"
+#include "BlockMap.h"
+
+// Reads a written device back and checks it against the image. Runs inside the
+// burn helper, which is the side allowed to open the device, on a thread of its
+// own. Device reads use O_DIRECT so the data comes from the device and not from
+// the page cache the write left behind. Where O_DIRECT cannot be used the
+// device's buffer cache is flushed instead and every chunk dropped once read.
+//
+// The device is read in chunks and cancel() takes effect before the next one.
+// Device and image are compared leaf by leaf (see LeafDigests), so a failure
+// also lists the ranges that differ. Without leaves from the write the image is
+// hashed alongside on a second thread; with only a cached digest of the whole
+// image, its leaves are hashed once the device turned out different. Given a
+// block map or repair ranges, only those ranges are checked, and a quick
+// verification only checks a random sample of them (see VerifySample).
+// Compressed images are decoded through an ImageSource; when their size is
+// unknown the image is hashed first to learn how much of the device to read.
+class Verifier : public QThread
+{
+    Q_OBJECT
+
+public:
+    Verifier(const QString &imagePath, const QString &devicePath, QObject *parent = nullptr);
+    ~Verifier();
+    
+    // Digest of the image as hex, when the write already hashed it or it was
+    // cached; afterwards also the digest verification computed itself
+    void setImageDigest(const QByteArray &digest) { m_imageDigest = digest; }
+    QByteArray imageDigest() const { return m_imageDigest; }
+    void setDigestAlgorithm(VerifyHash algorithm) { m_digestAlgorithm = algorithm; }
+    VerifyHash digestAlgorithm() const { return m_digestAlgorithm; }
+    
+    // Leaf digests of the image, when the write hashed them on the way
+    void setImageLeaves(const LeafDigests &leaves) { m_imageLeaves = leaves; }
+    
+    // Uncompressed size, when the write found it out while decoding
+    void setImageSize(qint64 size) { m_imageSize = size; }
+    
+    // Ranges the write discarded or zeroed; compared as zeros, not read back
+    void setZeroRanges(const ByteRangeList &ranges) { m_zeroRanges = ranges; }
+    
+    void setBlockMap(const QString &bmapPath) { m_bmapPath = bmapPath; }
+    
+    // Ranges a repair rewrote; only those are checked, block map or not
+    void setRanges(const ByteRangeList &ranges) { m_ranges = ranges; }
+    
+    // Only compare a sample of this fraction of the image, drawn from the seed
+    void setSample(double fraction, quint32 seed) { m_sampleFraction = fraction; m_sampleSeed = seed; }
+    
+    // What a sampled verification compared, out of how much could have been,
+    // and the share of damage it would have found with 95% confidence
+    qint64 sampledBytes() const { return m_sampledBytes; }
+    qint64 sampleBaseBytes() const { return m_sampleBaseBytes; }
+    double sampleDetectableDamage() const { return m_sampleDetectableDamage; }
+    
+    void cancel();
+    
+    bool isSuccessful() const { return m_success; }
+    bool isCancelled() const { return m_cancelled.loadRelaxed() != 0; }
+    QString errorString() const { return m_errorString; }
+    QString devicePath() const { return m_devicePath; }
+    
+    // Ranges of the device found different from the image, when it failed on content
+    const ByteRangeList &mismatches() const { return m_mismatches; }
+
+signals:
+    void progressChanged(qint64 bytesVerified, qint64 totalBytes);
+    void statusChanged(const QString &status);
+
+protected:
+    void run() override;
+
+private:
+    bool openDevice();
+    void dropDirectIO();
+    bool verifyImage();
+    bool verifyMappedRanges();
+    bool verifySample();
+    bool verifyRanges(const QVector<BlockMap::Range> &ranges, const QString &description,
+                      QCryptographicHash::Algorithm checksumAlgorithm = QCryptographicHash::Sha256);
+    bool readDevice(qint64 offset, qint64 length);
+    void addMismatches(qint64 offset, const char *image, qint64 length);
+    QByteArray hashImage(qint64 *imageSize = nullptr, LeafDigests *leaves = nullptr);
+    void advance(qint64 bytes, bool force = false);
+    bool fail(const QString &message);
+    
+    QString m_imagePath;
+    QString m_devicePath;
+    QString m_bmapPath;
+    QByteArray m_imageDigest;
+    LeafDigests m_imageLeaves;
+    VerifyHash m_digestAlgorithm;
+    qint64 m_imageSize;
+    ByteRangeList m_zeroRanges;
+    ByteRangeList m_ranges;
+    ByteRangeList m_mismatches;
+    double m_sampleFraction;
+    quint32 m_sampleSeed;
+    qint64 m_sampledBytes;
+    qint64 m_sampleBaseBytes;
+    double m_sampleDetectableDamage;
+    
+    int m_deviceFd;
+    bool m_directIO;
+    char *m_buffer;                 // Aligned for O_DIRECT
+    qint64 m_totalBytes;
+    qint64 m_bytesVerified;
+    QElapsedTimer m_progressTimer;
+    
+    QAtomicInt m_cancelled;
+    QAtomicInt m_stopped;           // Tells the image hasher to give up
+    QString m_errorString;
+    bool m_success;
+};
+
+#endif // VERIFIER_H
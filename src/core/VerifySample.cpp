@@ -0,0 +1,194 @@
+#include "VerifySample.h"
+#include "ImageSource.h"
+#include <QVector>
+#include <QByteArray>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <cmath>
+
+// Always compared besides the sample: boot code and partition table at the
+// start, and the backup GPT and the end of the last partition at the end
+static const qint64 EdgeSize = 1024 * 1024;
+
+static const qint64 SectorSize = 512;
+
+// Bounds walking a corrupt chain of extended boot records
+static const int MaxLogicalPartitions = 128;
+
+// Largest GPT entry array read; 128 entries of 128 bytes is usual
+static const qint64 MaxEntryArraySize = 1024 * 1024;
+
+static bool readAt(ImageSource &image, const QString &path, qint64 offset, QByteArray &data)
+{
+    // Compressed images only read forward; going back means decoding from the start again
+    if (offset < image.position() && !image.open(path)) {
+        return false;
+    }
+    return image.skip(offset - image.position()) && image.read(data.data(), data.size()) == data.size();
+}
+
+VerifySample::VerifySample(double fraction, quint32 seed)
+    : m_fraction(fraction)
+    , m_seed(seed)
+    , m_totalChunks(0)
+    , m_sampledChunks(0)
+{
+}
+
+bool VerifySample::plan(const QString &imagePath, qint64 imageSize, const ByteRangeList &candidates)
+{
+    m_ranges.clear();
+    m_totalChunks = 0;
+    m_sampledChunks = 0;
+    if (imageSize <= 0) {
+        return false;
+    }
+    
+    ByteRangeList picked = partitionTables(imagePath, imageSize);
+    picked.add(0, qMin(EdgeSize, imageSize));
+    picked.add(qMax<qint64>(0, imageSize - EdgeSize), qMin(EdgeSize, imageSize));
+    
+    sampleChunks(candidates);
+    for (const ByteRange &range : picked.intersected(candidates).ranges()) {
+        m_ranges.add(range);
+    }
+    return !m_ranges.isEmpty();
+}
+
+void VerifySample::sampleChunks(const ByteRangeList &candidates)
+{
+    m_ranges.clear();
+    m_totalChunks = 0;
+    m_sampledChunks = 0;
+    
+    // The chunks anything can be compared in
+    QVector<qint64> chunks;
+    for (const ByteRange &range : candidates.ranges()) {
+        qint64 first = range.offset / ChunkSize;
+        if (!chunks.isEmpty() && chunks.last() >= first) {
+            first = chunks.last() + 1;
+        }
+        for (qint64 chunk = first; chunk * ChunkSize < range.end(); ++chunk) {
+            chunks.append(chunk);
+        }
+    }
+    m_totalChunks = chunks.count();
+    if (m_totalChunks == 0) {
+        return;
+    }
+    
+    // Selection sampling: each chunk is taken with the chance that leaves the
+    // right number for the ones after it, so they come out in order
+    ByteRangeList picked;
+    qint64 wanted = qBound<qint64>(1, qint64(std::ceil(m_fraction * m_totalChunks)), m_totalChunks);
+    QRandomGenerator random(m_seed);
+    for (qint64 i = 0; i < m_totalChunks && m_sampledChunks < wanted; ++i) {
+        if (random.generateDouble() * double(m_totalChunks - i) < double(wanted - m_sampledChunks)) {
+            picked.add(chunks[i] * ChunkSize, ChunkSize);
+            ++m_sampledChunks;
+        }
+    }
+    
+    m_ranges = picked.intersected(candidates);
+}
+
+double VerifySample::detectableDamage(double confidence) const
+{
+    if (m_totalChunks <= 0) {
+        return 1.0;
+    }
+    
+    // The chance that none of the damaged chunks were sampled falls with each
+    // one more; count how many it takes to get below what may be missed
+    double missed = 1.0;
+    qint64 damaged = 0;
+    while (damaged < m_totalChunks && missed > 1.0 - confidence) {
+        missed *= double(m_totalChunks - m_sampledChunks - damaged) / double(m_totalChunks - damaged);
+        ++damaged;
+    }
+    return double(damaged) / double(m_totalChunks);
+}
+
+QString VerifySample::describe(qint64 sampledBytes, qint64 imageBytes, double detectableDamage)
+{
+    return QString("sampled %1% of the image; damage to %2% of it or more would have shown with 95% confidence")
+           .arg(100.0 * sampledBytes / qMax<qint64>(1, imageBytes), 0, 'f', 1)
+           .arg(100.0 * detectableDamage, 0, 'f', detectableDamage < 0.01 ? 2 : 1);
+}
+
+ByteRangeList VerifySample::partitionTables(const QString &imagePath, qint64 imageSize)
+{
+    ByteRangeList tables;
+    ImageSource image;
+    QByteArray sector(int(SectorSize), 0);
+    if (!image.open(imagePath) || !readAt(image, imagePath, 0, sector)
+        || quint8(sector[510]) != 0x55 || quint8(sector[511]) != 0xAA) {
+        return tables;
+    }
+    tables.add(0, SectorSize);
+    
+    bool gpt = false;
+    qint64 extendedStart = 0;
+    for (int i = 0; i < 4; ++i) {
+        const uchar *entry = reinterpret_cast<const uchar *>(sector.constData()) + 446 + 16 * i;
+        if (entry[4] == 0xEE) {
+            gpt = true;
+        } else if (entry[4] == 0x05 || entry[4] == 0x0F || entry[4] == 0x85) {
+            extendedStart = qFromLittleEndian<quint32>(entry + 8);
+        }
+    }
+    
+    // Logical partitions are a chain of boot records, each linking to the next
+    // relative to the start of the extended partition
+    qint64 record = extendedStart;
+    for (int i = 0; record > 0 && i < MaxLogicalPartitions; ++i) {
+        qint64 offset = record * SectorSize;
+        if (offset >= imageSize || !readAt(image, imagePath, offset, sector)
+            || quint8(sector[510]) != 0x55 || quint8(sector[511]) != 0xAA) {
+            break;
+        }
+        tables.add(offset, SectorSize);
+        
+        const uchar *link = reinterpret_cast<const uchar *>(sector.constData()) + 446 + 16;
+        quint32 next = qFromLittleEndian<quint32>(link + 8);
+        record = (link[4] == 0x05 || link[4] == 0x0F) && next > 0 ? extendedStart + next : 0;
+    }
+    
+    if (!gpt) {
+        return tables;
+    }
+    
+    // The header is in the second logical block, which images for 4Kn disks make 4096 bytes in
+    for (qint64 blockSize : {SectorSize, qint64(4096)}) {
+        QByteArray header(int(SectorSize), 0);
+        if (blockSize >= imageSize || !readAt(image, imagePath, blockSize, header) || !header.startsWith("EFI PART")) {
+            continue;
+        }
+        
+        const uchar *data = reinterpret_cast<const uchar *>(header.constData());
+        qint64 backupLba = qint64(qFromLittleEndian<quint64>(data + 32));
+        qint64 entriesLba = qint64(qFromLittleEndian<quint64>(data + 72));
+        qint64 entriesSize = qMin(MaxEntryArraySize, qint64(qFromLittleEndian<quint32>(data + 80))
+                                                     * qFromLittleEndian<quint32>(data + 84));
+        tables.add(blockSize, SectorSize);
+        if (entriesLba > 0 && entriesLba < imageSize / blockSize) {
+            tables.add(entriesLba * blockSize, entriesSize);
+        }
+        
+        // The backup header sits in the image's last block, its entries just before
+        QByteArray backup(int(SectorSize), 0);
+        qint64 backupOffset = backupLba * blockSize;
+        if (backupLba > 0 && backupLba < imageSize / blockSize && readAt(image, imagePath, backupOffset, backup)
+            && backup.startsWith("EFI PART")) {
+            tables.add(backupOffset, SectorSize);
+            qint64 backupEntriesLba = qint64(qFromLittleEndian<quint64>(
+                reinterpret_cast<const uchar *>(backup.constData()) + 72));
+            if (backupEntriesLba > 0 && backupEntriesLba < imageSize / blockSize) {
+                tables.add(backupEntriesLba * blockSize, entriesSize);
+            }
+        }
+        break;
+    }
+    
+    return tables;
+}
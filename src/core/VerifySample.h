@@ -0,0 +1,52 @@
+#ifndef VERIFYSAMPLE_H
+#define VERIFYSAMPLE_H
+
+#include <QString>
+#include "ByteRange.h"
+
+// What a quick verification reads instead of the whole device: the first and
+// last MiB of the image, its partition tables (MBR and extended boot records,
+// both GPT headers and entry arrays), and a random sample of 1 MiB chunks of
+// the rest. A dead stick, or a counterfeit one whose real capacity ends early,
+// differs almost everywhere, so a sample of a percent or two finds it in
+// seconds; only a full verification shows every byte arrived.
+//
+// Chunks are drawn from a seed, so a sample can be repeated exactly.
+class VerifySample
+{
+public:
+    static const qint64 ChunkSize = 1024 * 1024;
+    
+    // Share of the ranges sparse writing skipped that a full verification
+    // reads back, to see a discard or zero-out really left zeros there
+    static constexpr double SkippedShare = 0.05;
+    
+    VerifySample(double fraction, quint32 seed);
+    
+    // Plans the sample over the ranges of the image that can be compared with
+    // the device, reading the image's partition tables on the way
+    bool plan(const QString &imagePath, qint64 imageSize, const ByteRangeList &candidates);
+    
+    // Only the random chunks, for ranges with no tables or edges worth adding
+    void sampleChunks(const ByteRangeList &candidates);
+    
+    const ByteRangeList &ranges() const { return m_ranges; }
+    
+    // Smallest share of the chunks that, if that many differed on the device,
+    // the random chunks would include one of with the given confidence
+    double detectableDamage(double confidence = 0.95) const;
+    
+    // "sampled 2.0% of the image; ..." for the result of a burn
+    static QString describe(qint64 sampledBytes, qint64 imageBytes, double detectableDamage);
+
+private:
+    static ByteRangeList partitionTables(const QString &imagePath, qint64 imageSize);
+    
+    double m_fraction;
+    quint32 m_seed;
+    qint64 m_totalChunks;
+    qint64 m_sampledChunks;
+    ByteRangeList m_ranges;
+};
+
+#endif // VERIFYSAMPLE_H
@@ -0,0 +1,1992 @@
+#include "WriteEngine.h"
+#include "IoBackend.h"
+#include "ZeroScan.h"
+#include "ImageSource.h"
+#include "StreamDigest.h"
+#include "VerifySample.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QStringList>
+#include <QFile>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <linux/fs.h>
+#include <limits>
+
+// Block size limits; requests outside the range are clamped
+static const qint64 MinBlockSize = 64 * 1024;
+static const qint64 MaxBlockSize = 64 * 1024 * 1024;
+static const qint64 BufferAlignment = 4096;
+static const qint64 ProgressIntervalMs = 100;
+
+// Sparse writing looks at the image in blocks of this size
+static const qint64 ZeroBlockSize = 64 * 1024;
+
+// Emulated BLKZEROOUT writes zeros itself, so keep each call short enough for cancel
+static const qint64 MaxZeroRange = 64 * 1024 * 1024;
+
+// With several targets the ring gets this much slack for devices of uneven speed
+static const qint64 FanOutRingBytes = 64 * 1024 * 1024;
+
+// How long the reader waits on a full ring before detaching the slowest device
+static const int DetachDelayMs = 2000;
+static const int DetachPollMs = 250;
+
+// Devices are flushed and a checkpoint reported after this much data
+static const qint64 CheckpointBytes = 256 * 1024 * 1024;
+
+// Reading back while writing trails the writer by at least this much, so the
+// device is flushed about this often
+static const qint64 VerifyLagBytes = 64 * 1024 * 1024;
+static const qint64 VerifyReadSize = 8 * 1024 * 1024;
+
+// Without O_DIRECT the device is written through the page cache; each window
+// of this size is pushed out to the device with sync_file_range as the next
+// one is written, so dirty pages never pile up into one long final flush.
+// bufferedWrites sizes the windows from dirtyLimit instead.
+static const qint64 WritebackWindow = 32 * 1024 * 1024;
+
+// Share of the system's dirty memory a device may use with bufferedWrites, on
+// kernels whose BDI takes no byte limit
+static const char *const FallbackMaxRatio = "1";
+
+// Resuming compares this much of the image before the checkpoint with the device;
+// fixed, so a checkpoint stays usable with any block size
+static const qint64 ResumeWindow = 64 * 1024;
+
+// Autotuning writes this much with each setting it tries: every request size
+// at the configured queue depth, then every queue depth with the fastest size.
+// Buffers hold the largest size and are split into smaller requests.
+static const qint64 TrialBytes = 32 * 1024 * 1024;
+static const qint64 MinimumTrialBytes = 8 * 1024 * 1024;     // For one cut short by the end of the image
+static const qint64 TuneRequestSizes[] = {128 * 1024, 512 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024};
+static const int TuneQueueDepths[] = {1, 2, 4, 8, 16};
+static const int TuneSizeCount = sizeof(TuneRequestSizes) / sizeof(TuneRequestSizes[0]);
+static const int TuneDepthCount = sizeof(TuneQueueDepths) / sizeof(TuneQueueDepths[0]);
+static const int MinTuneBuffers = 4;
+
+// Special results of takeFilledBuffer()
+static const int EndOfStream = -1;
+static const int DetachedFromRing = -2;
+
+static qint64 fileDescriptorSize(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    
+    if (S_ISBLK(st.st_mode)) {
+        quint64 size = 0;
+        if (ioctl(fd, BLKGETSIZE64, &size) != 0) {
+            return -1;
+        }
+        return qint64(size);
+    }
+    
+    return st.st_size;
+}
+
+// Start of the next data region at or after offset, or size when only a hole is left
+static qint64 nextDataOffset(int fd, qint64 offset, qint64 size)
+{
+    off_t result = lseek(fd, offset, SEEK_DATA);
+    if (result < 0) {
+        // ENXIO means the rest is a hole; anything else means no hole support
+        return errno == ENXIO ? size : offset;
+    }
+    return result;
+}
+
+static QByteArray readAttribute(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.readAll().trimmed();
+}
+
+static bool writeAttribute(const QString &path, const QByteArray &value)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(value) == value.size();
+}
+
+static QList<IoRequest> splitRequests(const QList<IoRequest> &requests, qint64 maxLength)
+{
+    QList<IoRequest> pieces;
+    for (const IoRequest &request : requests) {
+        for (qint64 done = 0; done < request.length; done += maxLength) {
+            pieces.append({request.tag, request.data + done, request.offset + done,
+                           qMin(maxLength, request.length - done)});
+        }
+    }
+    return pieces;
+}
+
+static QString targetStateName(int state)
+{
+    switch (state) {
+        case 1: return "detached";
+        case 2: return "flushing";
+        case 3: return "done";
+        case 4: return "failed";
+        default: return "writing";
+    }
+}
+
+WriteEngine::WriteEngine(const BurnOptions &options, QObject *parent)
+    : QThread(parent)
+    , m_options(options)
+    , m_imageFd(-1)
+    , m_stream(nullptr)
+    , m_totalBytes(0)
+    , m_bytesToWrite(0)
+    , m_chunkSize(0)
+    , m_writebackWindow(WritebackWindow)
+    , m_resumeOffset(0)
+    , m_publishedChunks(0)
+    , m_hashImage(false)
+    , m_verifyWhileWriting(false)
+    , m_cancelled(0)
+    , m_stopped(0)
+    , m_success(false)
+{
+    QStringList devicePaths;
+    devicePaths << options.devicePath << options.additionalDevicePaths;
+    
+    for (const QString &devicePath : devicePaths) {
+        Target *target = new Target;
+        target->index = m_targets.count();
+        target->devicePath = devicePath;
+        target->fd = -1;
+        target->directIO = false;
+        target->backend = nullptr;
+        target->thread = nullptr;
+        target->sparseMode = options.sparseMode;
+        target->pendingZero = {0, 0};
+        target->privateBuffer = {nullptr, 0, 0, 0, false};
+        target->compareBuffer = nullptr;
+        target->submittedEnd = 0;
+        target->checkpointOffset = 0;
+        target->writtenBackEnd = 0;
+        target->requestSize = 0;
+        target->tuneStep = -1;
+        target->trialBytes = 0;
+        target->trialStalledNs = 0;
+        target->bestRate = 0;
+        target->bestRequestSize = 0;
+        target->bestQueueLimit = 0;
+        target->attached = false;
+        target->waitingForData = false;
+        target->resumeChunk = 0;
+        target->state.storeRelaxed(TargetWriting);
+        target->bytesWritten.storeRelaxed(0);
+        target->cachedBytes.storeRelaxed(0);
+        target->changedBytes.storeRelaxed(0);
+        target->verifyThread = nullptr;
+        target->verifyEnd = 0;
+        target->writerFinished = false;
+        m_targets.append(target);
+    }
+}
+
+WriteEngine::~WriteEngine()
+{
+    cancel();
+    wait();
+    closeFiles();
+    freeBuffers();
+    qDeleteAll(m_targets);
+    delete m_stream;
+}
+
+void WriteEngine::cancel()
+{
+    m_cancelled.storeRelaxed(1);
+    stop();
+}
+
+QString WriteEngine::errorString() const
+{
+    QMutexLocker locker(&m_errorMutex);
+    
+    if (!m_errorString.isEmpty()) {
+        return m_errorString;
+    }
+    
+    // A single device keeps its own message; with several, name the ones that failed
+    QStringList failures;
+    for (const Target *target : m_targets) {
+        if (!target->errorString.isEmpty()) {
+            failures << (m_targets.count() == 1 ? target->errorString
+                                                : target->devicePath + ": " + target->errorString);
+        }
+    }
+    
+    if (failures.isEmpty() || m_targets.count() == 1) {
+        return failures.join("; ");
+    }
+    return QString("%1 of %2 devices failed: %3").arg(failures.count()).arg(m_targets.count()).arg(failures.join("; "));
+}
+
+const ByteRangeList &WriteEngine::skippedRanges() const
+{
+    // Every target skips the same zero blocks of the image
+    for (const Target *target : m_targets) {
+        if (target->state.loadRelaxed() == TargetDone) {
+            return target->skippedRanges;
+        }
+    }
+    return m_targets.first()->skippedRanges;
+}
+
+void WriteEngine::run()
+{
+    m_success = false;
+    m_imageDigest = m_options.imageDigest;
+    m_imageLeaves = LeafDigests();
+    m_stopped.storeRelaxed(m_cancelled.loadRelaxed());
+    
+    if (!openImage() || !planRanges() || !openTargets() || !checkResumePoint() || !allocateBuffers()) {
+        closeFiles();
+        freeBuffers();
+        return;
+    }
+    
+    const Target *first = m_targets.first();
+    QString settings = QString("queue depth %1, %2 KB blocks")
+                       .arg(first->backend ? first->backend->queueLimit() : 1)
+                       .arg(first->requestSize / 1024);
+    if (first->tuneStep >= 0) {
+        settings = "tuning block size and queue depth";
+    }
+    emit statusChanged(QString("%1 image to %2 (%3, %4)...")
+                       .arg(isDeltaWrite() ? "Comparing and writing" : "Writing")
+                       .arg(m_targets.count() == 1 ? QString("device") : QString("%1 devices").arg(m_targets.count()))
+                       .arg(first->backend ? first->backend->name() : QString("pwrite"))
+                       .arg(settings));
+    m_progressTimer.start();
+    reportProgress(true);
+    
+    // Only a digest over every byte of the image can replace hashing it again
+    // later, or be compared with a device read back while writing. A known
+    // digest spares that, but not the leaves a full verification compares.
+    bool wholeImage = m_options.bmapPath.isEmpty() && m_options.repairRanges.isEmpty() && m_resumeOffset == 0;
+    bool fullVerify = m_options.verifyAfterBurn && m_options.verifySample <= 0;
+    m_hashImage = wholeImage && (m_imageDigest.isEmpty() || fullVerify);
+    m_verifyWhileWriting = wholeImage && fullVerify && m_options.verifyWhileWriting;
+    
+    for (Target *target : m_targets) {
+        if (target->state.loadRelaxed() == TargetFailed) {
+            continue;
+        }
+        target->thread = QThread::create([this, target]() { writerLoop(target); });
+        target->thread->start();
+        if (m_verifyWhileWriting) {
+            target->verifyThread = QThread::create([this, target]() { verifyLoop(target); });
+            target->verifyThread->start();
+        }
+    }
+    
+    QThread *hasher = nullptr;
+    if (m_hashImage) {
+        hasher = QThread::create([this]() { hasherLoop(); });
+        hasher->start();
+    }
+    
+    readerLoop();
+    
+    if (hasher) {
+        hasher->wait();
+        delete hasher;
+    }
+    
+    for (Target *target : m_targets) {
+        if (target->thread) {
+            target->thread->wait();
+            delete target->thread;
+            target->thread = nullptr;
+        }
+    }
+    
+    if (m_verifyWhileWriting) {
+        finishVerification();
+    }
+    
+    bool allDone = true;
+    for (const Target *target : m_targets) {
+        allDone = allDone && target->state.loadRelaxed() == TargetDone;
+    }
+    m_success = allDone && !m_stopped.loadRelaxed();
+    
+    if (m_success && !skippedRanges().isEmpty()) {
+        emit statusChanged(QString("Skipped %1 MB of empty blocks")
+                           .arg(skippedRanges().totalLength() / (1024 * 1024)));
+    }
+    
+    if (m_success && isDeltaWrite()) {
+        qint64 changed = 0;
+        for (const Target *target : m_targets) {
+            changed = qMax(changed, target->changedBytes.loadRelaxed());
+        }
+        const qint64 mb = 1024 * 1024;
+        emit statusChanged(changed == 0 ? QString("Device already up to date")
+                                        : QString("Rewrote %1 of %2 MB that differed from the image")
+                                          .arg((changed + mb - 1) / mb).arg((m_totalBytes + mb - 1) / mb));
+    }
+    
+    reportProgress(true);
+    closeFiles();
+    freeBuffers();
+}
+
+bool WriteEngine::openImage()
+{
+    if (ImageSource::detectCompression(m_options.imagePath) != ImageSource::None) {
+        delete m_stream;
+        m_stream = new ImageSource;
+        if (!m_stream->open(m_options.imagePath)) {
+            fail(m_stream->errorString());
+            return false;
+        }
+        
+        m_totalBytes = m_stream->size();
+        if (m_totalBytes == 0) {
+            fail("Image is empty");
+            return false;
+        }
+        emit statusChanged(QString("Decompressing %1 image while writing").arg(ImageSource::compressionName(m_stream->compression())));
+        return true;
+    }
+    
+    QByteArray imagePath = m_options.imagePath.toLocal8Bit();
+    
+    m_imageFd = open(imagePath.constData(), O_RDONLY | O_CLOEXEC);
+    if (m_imageFd < 0) {
+        fail(QString("Cannot open image: %1").arg(strerror(errno)));
+        return false;
+    }
+    
+    m_totalBytes = fileDescriptorSize(m_imageFd);
+    if (m_totalBytes <= 0) {
+        fail("Image is empty or its size cannot be determined");
+        return false;
+    }
+    posix_fadvise(m_imageFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    
+    return true;
+}
+
+bool WriteEngine::planRanges()
+{
+    m_writeRanges.clear();
+    m_chunks.clear();
+    
+    if (!m_options.repairRanges.isEmpty()) {
+        // A repair rewrites what verification found different and nothing else
+        if (m_totalBytes < 0) {
+            fail("The image's size is not known, so it cannot be repaired in place");
+            return false;
+        }
+        qint64 bytes = 0;
+        for (const ByteRange &range : m_options.repairRanges.ranges()) {
+            qint64 length = qMin(range.end(), m_totalBytes) - range.offset;
+            if (length > 0) {
+                BlockMap::Range repair = {range.offset, length, QByteArray()};
+                m_writeRanges.append(repair);
+                bytes += length;
+            }
+        }
+        m_bytesToWrite.storeRelaxed(bytes);
+        for (Target *target : m_targets) {
+            target->sparseMode = SparseMode::Off;
+        }
+        
+        emit statusChanged(QString("Rewriting %1 MB in %2 ranges that differed from the image")
+                           .arg((bytes + 1024 * 1024 - 1) / (1024 * 1024)).arg(m_writeRanges.count()));
+    } else if (m_options.bmapPath.isEmpty()) {
+        // A compressed image of unknown size is one open ended range
+        qint64 length = m_totalBytes >= 0 ? m_totalBytes : std::numeric_limits<qint64>::max();
+        BlockMap::Range whole = {0, length, QByteArray()};
+        m_writeRanges.append(whole);
+        m_bytesToWrite.storeRelaxed(m_totalBytes);
+    } else {
+        if (!m_blockMap.load(m_options.bmapPath)) {
+            fail(QString("Invalid block map: %1").arg(m_blockMap.errorString()));
+            return false;
+        }
+        if (m_totalBytes < 0) {
+            // The block map knows the size a gzip or bzip2 image decompresses to
+            m_totalBytes = m_blockMap.imageSize();
+        }
+        if (m_blockMap.imageSize() != m_totalBytes) {
+            fail(QString("Block map describes a %1 byte image, but the image has %2 bytes")
+                 .arg(m_blockMap.imageSize()).arg(m_totalBytes));
+            return false;
+        }
+        
+        // The map already says which blocks matter; unmapped space is left untouched
+        m_writeRanges = m_blockMap.ranges();
+        m_bytesToWrite.storeRelaxed(m_blockMap.mappedBytes());
+        for (Target *target : m_targets) {
+            target->sparseMode = SparseMode::Off;
+        }
+        
+        emit statusChanged(QString("Block map lists %1 MB of data in a %2 MB image")
+                           .arg(m_bytesToWrite.loadRelaxed() / (1024 * 1024)).arg(m_totalBytes / (1024 * 1024)));
+    }
+    
+    m_chunkSize = qBound(MinBlockSize, qint64(m_options.blockSize), MaxBlockSize);
+    if (m_options.autotune) {
+        m_chunkSize = qMax(m_chunkSize, TuneRequestSizes[TuneSizeCount - 1]);
+    }
+    m_chunkSize -= m_chunkSize % BufferAlignment;
+    
+    // One window being written back while the next one fills stays within dirtyLimit
+    if (m_options.bufferedWrites) {
+        m_writebackWindow = qMax(m_chunkSize, m_options.dirtyLimit / 2);
+    }
+    
+    // Cut the ranges into buffer sized chunks; every target walks the same list.
+    // Without a size the reader adds chunks through planNextChunk() instead.
+    for (int range = 0; range < m_writeRanges.count() && m_totalBytes >= 0; ++range) {
+        qint64 end = m_writeRanges[range].offset + m_writeRanges[range].length;
+        for (qint64 offset = m_writeRanges[range].offset; offset < end; offset += m_chunkSize) {
+            Chunk chunk = {offset, qMin(m_chunkSize, end - offset), range};
+            m_chunks.append(chunk);
+        }
+    }
+    
+    return true;
+}
+
+bool WriteEngine::planNextChunk()
+{
+    // Only the reader touches the chunk list once writing started
+    if (m_totalBytes >= 0) {
+        return false;
+    }
+    
+    qint64 offset = m_chunks.isEmpty() ? m_resumeOffset : m_chunks.last().offset + m_chunks.last().length;
+    Chunk chunk = {offset, m_chunkSize, 0};
+    m_chunks.append(chunk);
+    return true;
+}
+
+bool WriteEngine::checkResumePoint()
+{
+    m_resumeOffset = 0;
+    if (m_options.resumeOffset <= 0) {
+        return true;
+    }
+    
+    ByteRange window = resumeWindow(m_options.resumeOffset);
+    if (window.length <= 0 || (m_totalBytes >= 0 && m_options.resumeOffset > m_totalBytes)) {
+        emit statusChanged("Checkpoint does not fit this image; starting from the beginning");
+        return true;
+    }
+    
+    // A compressed image is decoded up to the window; the reader carries on from there
+    QByteArray imageData(int(window.length), 0);
+    QByteArray imageHash;
+    if (!m_stream) {
+        imageHash = windowHash(m_imageFd, imageData.data(), window);
+    } else if (m_stream->skip(window.offset) && m_stream->read(imageData.data(), window.length) == window.length) {
+        imageHash = Sha256::hash(imageData).toHex();
+    }
+    if (imageHash != m_options.resumeHash) {
+        emit statusChanged("Image changed since the checkpoint; starting from the beginning");
+        return rewindImage();
+    }
+    
+    // Every device has to still hold what was written before the checkpoint
+    for (Target *target : m_targets) {
+        if (target->state.loadRelaxed() == TargetFailed) {
+            continue;
+        }
+        if (!allocatePrivateBuffer(target)) {
+            return false;
+        }
+        if (windowHash(target->fd, target->privateBuffer.data, window) != m_options.resumeHash) {
+            emit statusChanged(QString("%1 no longer matches the checkpoint; starting from the beginning")
+                               .arg(target->devicePath));
+            return rewindImage();
+        }
+    }
+    
+    m_resumeOffset = m_options.resumeOffset;
+    skipResumedChunks();
+    emit statusChanged(QString("Resuming at %1 MB").arg(m_resumeOffset / (1024 * 1024)));
+    return true;
+}
+
+void WriteEngine::skipResumedChunks()
+{
+    qint64 resumedBytes = 0;
+    
+    QVector<Chunk> remaining;
+    for (Chunk chunk : m_chunks) {
+        qint64 end = chunk.offset + chunk.length;
+        if (end <= m_resumeOffset) {
+            resumedBytes += chunk.length;
+            continue;
+        }
+        // Checkpoints fall on chunk ends, but the block size may have changed since
+        if (chunk.offset < m_resumeOffset) {
+            resumedBytes += m_resumeOffset - chunk.offset;
+            chunk.length = end - m_resumeOffset;
+            chunk.offset = m_resumeOffset;
+        }
+        remaining.append(chunk);
+    }
+    m_chunks = remaining;
+    
+    // Chunks of an image of unknown size are not planned yet, but all of them
+    // up to the checkpoint were written
+    if (m_totalBytes < 0) {
+        resumedBytes = m_resumeOffset;
+    }
+    
+    for (Target *target : m_targets) {
+        target->bytesWritten.storeRelaxed(resumedBytes);
+        target->submittedEnd = m_resumeOffset;
+        target->checkpointOffset = m_resumeOffset;
+    }
+}
+
+bool WriteEngine::openTargets()
+{
+    int opened = 0;
+    for (Target *target : m_targets) {
+        if (openTarget(target)) {
+            ++opened;
+        }
+    }
+    
+    // Nothing to do if no device could be opened; errorString() has the reasons
+    return opened > 0;
+}
+
+bool WriteEngine::openTarget(Target *target)
+{
+    QByteArray devicePath = target->devicePath.toLocal8Bit();
+    
+    // O_EXCL on a block device fails if any partition is still mounted
+    int directFlag = m_options.bufferedWrites ? 0 : O_DIRECT;
+    target->fd = open(devicePath.constData(), O_RDWR | directFlag | O_EXCL | O_CLOEXEC);
+    target->directIO = target->fd >= 0 && directFlag;
+    if (target->fd < 0 && errno == EINVAL && directFlag) {
+        target->fd = open(devicePath.constData(), O_RDWR | O_EXCL | O_CLOEXEC);
+    }
+    if (target->fd < 0) {
+        failTarget(target, QString("Cannot open device: %1").arg(strerror(errno)));
+        return false;
+    }
+    
+    qint64 deviceSize = fileDescriptorSize(target->fd);
+    struct stat st;
+    // Without a size a compressed image that does not fit fails when writing past the end
+    if (fstat(target->fd, &st) == 0 && S_ISBLK(st.st_mode) && deviceSize < m_totalBytes) {
+        failTarget(target, QString("Image (%1 bytes) is larger than the device (%2 bytes)")
+                   .arg(m_totalBytes).arg(deviceSize));
+        return false;
+    }
+    
+    if (m_options.bufferedWrites) {
+        limitDirtyData(target);
+    } else if (!target->directIO) {
+        qWarning() << "O_DIRECT not supported on" << target->devicePath << "- using buffered writes";
+    }
+    
+    // Tuning needs a ring deep enough for the deepest queue it tries
+    int queueDepth = m_options.queueDepth;
+    if (m_options.autotune && m_options.writeBackend != WriteBackend::Pwrite) {
+        queueDepth = qMax(queueDepth, TuneQueueDepths[TuneDepthCount - 1]);
+    }
+    target->backend = IoBackend::create(m_options.writeBackend, target->fd, queueDepth);
+    target->backend->setQueueLimit(m_options.queueDepth);
+    target->requestSize = m_chunkSize;
+    target->attached = true;
+    
+    // Tuning measures the device, which buffered writes and delta reads hide,
+    // and decoding a compressed image holds back more than any setting would
+    if (m_options.autotune && target->directIO && !isDeltaWrite() && !m_stream) {
+        target->tuneStep = 0;
+        startTrial(target);
+    }
+    return true;
+}
+
+void WriteEngine::closeFiles()
+{
+    for (Target *target : m_targets) {
+        // Deleting the backend waits for anything still in flight
+        delete target->backend;
+        target->backend = nullptr;
+        
+        restoreDirtyData(target);
+        if (target->fd >= 0) {
+            close(target->fd);
+            target->fd = -1;
+        }
+    }
+    
+    if (m_imageFd >= 0) {
+        close(m_imageFd);
+        m_imageFd = -1;
+    }
+    if (m_stream) {
+        m_stream->close();
+    }
+}
+
+bool WriteEngine::allocateBuffers()
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    m_freeBuffers.clear();
+    m_hashBuffers.clear();
+    m_publishedChunks = 0;
+    m_ringStall.invalidate();
+    
+    // One buffer per queued write, one being submitted and one being read
+    int bufferCount = m_options.queueDepth + 2;
+    if (m_options.autotune) {
+        // Split into requests, a few large buffers already fill a deep queue
+        bufferCount = qMax(MinTuneBuffers, int(FanOutRingBytes / m_chunkSize));
+    }
+    if (m_targets.count() > 1) {
+        bufferCount = qMax(bufferCount, int(FanOutRingBytes / m_chunkSize));
+    }
+    
+    for (int i = 0; i < bufferCount; ++i) {
+        void *data = nullptr;
+        if (posix_memalign(&data, BufferAlignment, m_chunkSize) != 0) {
+            locker.unlock();
+            fail("Failed to allocate write buffers");
+            return false;
+        }
+        
+        Buffer buffer;
+        buffer.data = static_cast<char *>(data);
+        buffer.offset = 0;
+        buffer.length = 0;
+        buffer.chunk = -1;
+        buffer.hole = false;
+        m_buffers.append(buffer);
+        m_bufferRefs.append(0);
+        m_freeBuffers.enqueue(i);
+    }
+    
+    // The extra tag past the ring stands for a target's private buffer
+    for (Target *target : m_targets) {
+        target->pendingWrites.fill(0, bufferCount + 1);
+    }
+    
+    return true;
+}
+
+void WriteEngine::freeBuffers()
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    for (const Buffer &buffer : m_buffers) {
+        free(buffer.data);
+    }
+    m_buffers.clear();
+    m_bufferRefs.clear();
+    m_freeBuffers.clear();
+    
+    for (Target *target : m_targets) {
+        free(target->privateBuffer.data);
+        target->privateBuffer.data = nullptr;
+        free(target->compareBuffer);
+        target->compareBuffer = nullptr;
+        target->filledBuffers.clear();
+    }
+}
+
+void WriteEngine::readerLoop()
+{
+    QCryptographicHash rangeHash(m_blockMap.checksumAlgorithm());
+    qint64 nextData = 0;
+    
+    for (int chunk = 0; (chunk < m_chunks.count() || planNextChunk()) && !m_stopped.loadRelaxed(); ++chunk) {
+        const BlockMap::Range &range = m_writeRanges[m_chunks[chunk].range];
+        
+        // Block map checksums are checked as the data streams past; a range cut
+        // short by resuming cannot be
+        bool checkRange = !range.checksum.isEmpty() && range.offset >= m_resumeOffset;
+        if (m_chunks[chunk].offset == range.offset) {
+            rangeHash.reset();
+        }
+        
+        int index = takeFreeBuffer();
+        if (index < 0) {
+            break;
+        }
+        
+        Buffer &buffer = m_buffers[index];
+        if (!readChunk(chunk, buffer, nextData)) {
+            fail(QString("Read error at offset %1: %2").arg(buffer.offset).arg(readErrorString()));
+            releaseBuffer(index);
+            break;
+        }
+        if (buffer.length == 0) {
+            // A compressed image without a recorded size ended on a chunk boundary
+            releaseBuffer(index);
+            break;
+        }
+        
+        if (checkRange) {
+            rangeHash.addData(QByteArray::fromRawData(buffer.data, int(buffer.length)));
+        }
+        
+        publishBuffer(index);
+        
+        if (checkRange && buffer.offset + buffer.length == range.offset + range.length
+            && rangeHash.result().toHex() != range.checksum) {
+            fail(QString("Image data at offset %1 does not match its block map checksum").arg(range.offset));
+        }
+    }
+    
+    // Writers still attached learn that nothing more is coming
+    publishEnd();
+}
+
+void WriteEngine::hasherLoop()
+{
+    StreamDigest hash(m_options.verifyHash);
+    LeafHasher leaves(m_options.verifyHash);
+    bool hashWhole = m_imageDigest.isEmpty();
+    bool hashLeaves = m_options.verifyAfterBurn && m_options.verifySample <= 0;
+    qint64 hashed = 0;
+    bool inOrder = true;
+    
+    int index;
+    while ((index = takeHashBuffer()) != EndOfStream) {
+        const Buffer &buffer = m_buffers[index];
+        inOrder = inOrder && buffer.offset == hashed;
+        
+        if (hashWhole) {
+            hash.addData(buffer.data, buffer.length);
+        }
+        if (hashLeaves) {
+            leaves.addData(buffer.data, buffer.length);
+        }
+        hashed += buffer.length;
+        releaseBuffer(index);
+    }
+    
+    if (inOrder && hashed == m_totalBytes && !m_stopped.loadRelaxed()) {
+        if (hashWhole) {
+            m_imageDigest = hash.result();
+        }
+        if (hashLeaves) {
+            m_imageLeaves = leaves.result();
+        }
+    }
+}
+
+int WriteEngine::takeHashBuffer()
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    while (m_hashBuffers.isEmpty() && !m_stopped.loadRelaxed()) {
+        m_bufferFilled.wait(&m_ringMutex);
+    }
+    
+    if (m_stopped.loadRelaxed()) {
+        return EndOfStream;
+    }
+    return m_hashBuffers.dequeue();
+}
+
+bool WriteEngine::readChunk(int chunk, Buffer &buffer, qint64 &nextData)
+{
+    buffer.offset = m_chunks[chunk].offset;
+    buffer.length = m_chunks[chunk].length;
+    buffer.chunk = chunk;
+    buffer.hole = false;
+    
+    if (m_stream) {
+        return readStream(buffer);
+    }
+    
+    // SEEK_DATA lets whole chunks of a sparse image file go unread
+    if (m_options.sparseMode != SparseMode::Off && m_options.bmapPath.isEmpty()) {
+        if (buffer.offset >= nextData) {
+            nextData = nextDataOffset(m_imageFd, buffer.offset, m_totalBytes);
+        }
+        // A partial last block is always written, so it has to hold real zeros
+        buffer.hole = nextData >= buffer.offset + buffer.length && buffer.length % BufferAlignment == 0;
+    }
+    
+    // Holes are not read, but a device with sparse writing off still writes them
+    if (buffer.hole) {
+        memset(buffer.data, 0, buffer.length);
+        return true;
+    }
+    return IoBackend::readFully(m_imageFd, buffer.data, buffer.length, buffer.offset);
+}
+
+bool WriteEngine::readStream(Buffer &buffer)
+{
+    // Chunks come in order; only block map gaps and resuming move the stream ahead
+    qint64 gap = buffer.offset - m_stream->position();
+    if (gap < 0 || !m_stream->skip(gap)) {
+        return false;
+    }
+    
+    qint64 count = m_stream->read(buffer.data, buffer.length);
+    if (count < 0) {
+        return false;
+    }
+    if (count == buffer.length) {
+        return true;
+    }
+    if (m_totalBytes >= 0) {
+        errno = EIO;
+        return false;
+    }
+    
+    // The end of an image of unknown size; now the totals are known
+    m_totalBytes = buffer.offset + count;
+    m_bytesToWrite.storeRelaxed(m_totalBytes);
+    buffer.length = count;
+    if (count > 0) {
+        m_chunks[buffer.chunk].length = count;
+    } else {
+        m_chunks.removeLast();
+    }
+    return true;
+}
+
+bool WriteEngine::rewindImage()
+{
+    // A stream cannot seek back, so a burn that cannot resume decodes from the start
+    if (m_stream && m_stream->position() > 0 && !m_stream->open(m_options.imagePath)) {
+        fail(m_stream->errorString());
+        return false;
+    }
+    return true;
+}
+
+QString WriteEngine::readErrorString() const
+{
+    if (m_stream && !m_stream->errorString().isEmpty()) {
+        return m_stream->errorString();
+    }
+    if (m_stream && errno == EIO) {
+        return "Image ends before its recorded size";
+    }
+    return strerror(errno);
+}
+
+void WriteEngine::writerLoop(Target *target)
+{
+    bool ok = prepareSparseWrite(target);
+    bool detached = false;
+    
+    // Write buffers in the order the reader produced them until it signals the end
+    while (ok) {
+        int index = takeFilledBuffer(target);
+        if (index == EndOfStream) {
+            break;
+        }
+        if (index == DetachedFromRing) {
+            detached = true;
+            break;
+        }
+        
+        // Submitted buffers come back through recycleBuffers() once the device has them
+        if (isStopped(target)) {
+            releaseBuffer(index);
+            continue;
+        }
+        
+        qint64 end = m_buffers[index].offset + m_buffers[index].length;
+        ok = writeBuffer(target, index);
+        if (ok) {
+            target->submittedEnd = end;
+            ok = reachFlushPoint(target);
+        }
+    }
+    
+    QList<IoRequest> completed;
+    if (!target->backend->drain(completed) && ok) {
+        failTarget(target, target->backend->errorString());
+        ok = false;
+    }
+    recycleBuffers(target, completed);
+    
+    // Failed writes never complete, so hand their buffers back explicitly
+    releasePendingBuffers(target);
+    
+    if (ok) {
+        checkpointIfCancelled(target);
+    }
+    if (!ok || isStopped(target)) {
+        return;
+    }
+    
+    if (detached && !writePrivately(target)) {
+        return;
+    }
+    
+    // An image too short for every trial settles on the best setting so far,
+    // counting the last trial if it got far enough to say anything
+    if (target->tuneStep >= 0) {
+        if (target->trialBytes >= MinimumTrialBytes && !finishTrial(target)) {
+            return;
+        }
+        settleTuning(target);
+    }
+    
+    if (!flushZeroRange(target)) {
+        return;
+    }
+    
+    // A delta write that found nothing to change has nothing to flush either
+    if (isDeltaWrite() && target->changedBytes.loadRelaxed() == 0) {
+        target->state.storeRelaxed(TargetDone);
+        publishVerifyPoint(target);
+        reportProgress(true);
+        return;
+    }
+    
+    target->state.storeRelaxed(TargetFlushing);
+    if (m_targets.count() == 1) {
+        emit statusChanged("Flushing device cache...");
+    }
+    if (flushDevice(target)) {
+        target->state.storeRelaxed(TargetDone);
+        publishVerifyPoint(target);
+    }
+    reportProgress(true);
+}
+
+bool WriteEngine::writePrivately(Target *target)
+{
+    if (!allocatePrivateBuffer(target)) {
+        return false;
+    }
+    
+    int tag = m_buffers.count();
+    qint64 nextData = 0;
+    
+    for (int chunk = target->resumeChunk; chunk < m_chunks.count(); ++chunk) {
+        if (isStopped(target)) {
+            checkpointIfCancelled(target);
+            return false;
+        }
+        
+        if (!readChunk(chunk, target->privateBuffer, nextData)) {
+            failTarget(target, QString("Read error at offset %1: %2")
+                       .arg(target->privateBuffer.offset).arg(strerror(errno)));
+            return false;
+        }
+        
+        // One private buffer, so every chunk has to land before the next is read
+        QList<IoRequest> completed;
+        bool ok = writeBuffer(target, tag) && target->backend->drain(completed);
+        recycleBuffers(target, completed);
+        if (!ok) {
+            if (target->state.loadRelaxed() != TargetFailed) {
+                failTarget(target, target->backend->errorString());
+            }
+            return false;
+        }
+        
+        target->submittedEnd = m_chunks[chunk].offset + m_chunks[chunk].length;
+        if (!reachFlushPoint(target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteEngine::writeBuffer(Target *target, int tag)
+{
+    const Buffer &buffer = bufferFor(target, tag);
+    qint64 alignedLength = buffer.length;
+    if (target->directIO) {
+        alignedLength -= buffer.length % BufferAlignment;
+    }
+    
+    // Chunks the device already holds count as written without touching it
+    if (isDeltaWrite()) {
+        if (deviceMatches(target, buffer)) {
+            completeBuffer(target, tag);
+            return true;
+        }
+        target->changedBytes.fetchAndAddRelaxed(buffer.length);
+    }
+    
+    if (alignedLength != buffer.length) {
+        return writeTail(target, tag, alignedLength);
+    }
+    
+    QList<IoRequest> requests;
+    if (target->sparseMode == SparseMode::Off) {
+        requests.append({tag, buffer.data, buffer.offset, buffer.length});
+    } else if (!planSparseWrite(target, tag, requests)) {
+        target->pendingWrites[tag] = 1;     // Still ours; releasePendingBuffers() returns it
+        return false;
+    }
+    
+    if (requests.isEmpty()) {
+        completeBuffer(target, tag);
+        return true;
+    }
+    
+    if (target->requestSize < buffer.length) {
+        requests = splitRequests(requests, target->requestSize);
+    }
+    
+    // The buffer is recycled once its last request completes
+    target->pendingWrites[tag] = requests.count();
+    
+    QList<IoRequest> completed;
+    for (const IoRequest &request : requests) {
+        target->trialBytes += request.length;
+        bool ok = target->backend->submitWrite(request, completed);
+        recycleBuffers(target, completed);
+        if (!ok) {
+            failTarget(target, target->backend->errorString());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteEngine::writeTail(Target *target, int tag, qint64 alignedLength)
+{
+    const Buffer &buffer = bufferFor(target, tag);
+    target->pendingWrites[tag] = 1;
+    
+    // O_DIRECT cannot write a partial block, so the image tail goes through the
+    // page cache once everything before it has reached the device
+    QList<IoRequest> completed;
+    bool ok = target->backend->drain(completed);
+    recycleBuffers(target, completed);
+    if (!ok) {
+        failTarget(target, target->backend->errorString());
+        return false;
+    }
+    
+    if (alignedLength > 0 && !IoBackend::writeFully(target->fd, buffer.data, alignedLength, buffer.offset)) {
+        failTarget(target, QString("Write error at offset %1: %2").arg(buffer.offset).arg(strerror(errno)));
+        return false;
+    }
+    
+    int flags = fcntl(target->fd, F_GETFL);
+    fcntl(target->fd, F_SETFL, flags & ~O_DIRECT);
+    target->directIO = false;
+    
+    qint64 tailLength = buffer.length - alignedLength;
+    if (!IoBackend::writeFully(target->fd, buffer.data + alignedLength, tailLength, buffer.offset + alignedLength)) {
+        failTarget(target, QString("Write error at offset %1: %2")
+                   .arg(buffer.offset + alignedLength).arg(strerror(errno)));
+        return false;
+    }
+    
+    target->pendingWrites[tag] = 0;
+    completeBuffer(target, tag);
+    return true;
+}
+
+void WriteEngine::recycleBuffers(Target *target, QList<IoRequest> &completed)
+{
+    for (const IoRequest &request : completed) {
+        if (--target->pendingWrites[request.tag] == 0) {
+            completeBuffer(target, request.tag);
+        }
+    }
+    completed.clear();
+}
+
+void WriteEngine::completeBuffer(Target *target, int tag)
+{
+    // Skipped zero blocks count as written so progress tracks the image; a
+    // buffered write only counts once writeBack() has pushed it to the device
+    qint64 length = bufferFor(target, tag).length;
+    if (target->directIO) {
+        target->bytesWritten.fetchAndAddRelaxed(length);
+    } else {
+        target->cachedBytes.fetchAndAddRelaxed(length);
+    }
+    if (tag < m_buffers.count()) {
+        releaseBuffer(tag);
+    }
+    reportProgress(false);
+}
+
+void WriteEngine::releasePendingBuffers(Target *target)
+{
+    for (int tag = 0; tag < m_buffers.count(); ++tag) {
+        if (target->pendingWrites[tag] > 0) {
+            target->pendingWrites[tag] = 0;
+            releaseBuffer(tag);
+        }
+    }
+    target->pendingWrites[m_buffers.count()] = 0;
+}
+
+bool WriteEngine::flushDevice(Target *target)
+{
+    // Only this device's dirty pages and write cache, never a system-wide sync
+    if (fdatasync(target->fd) != 0) {
+        failTarget(target, QString("Failed to flush device: %1").arg(strerror(errno)));
+        return false;
+    }
+    
+    // Buffered writes leave the image in the page cache; drop the device's copy
+    // (block devices only, a regular file answers ENOTTY)
+    if (!target->directIO) {
+        ioctl(target->fd, BLKFLSBUF, 0);
+    }
+    
+    target->writtenBackEnd = target->submittedEnd;
+    target->bytesWritten.fetchAndAddRelaxed(target->cachedBytes.fetchAndStoreRelaxed(0));
+    return true;
+}
+
+bool WriteEngine::writeBack(Target *target)
+{
+    // The previous window went out while this one was written; wait for it,
+    // start this one and drop what is clean from the page cache
+    QList<IoRequest> completed;
+    bool ok = target->backend->drain(completed);
+    recycleBuffers(target, completed);
+    if (!ok) {
+        failTarget(target, target->backend->errorString());
+        return false;
+    }
+    
+    qint64 start = target->writtenBackEnd;
+    qint64 length = target->submittedEnd - start;
+    ok = sync_file_range(target->fd, start, length, SYNC_FILE_RANGE_WRITE) == 0;
+    
+    // A length of 0 would mean the whole device, so the first window has nothing to wait for
+    if (ok && start > 0) {
+        ok = sync_file_range(target->fd, 0, start, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+                                                  | SYNC_FILE_RANGE_WAIT_AFTER) == 0;
+        posix_fadvise(target->fd, 0, start, POSIX_FADV_DONTNEED);
+    }
+    if (!ok) {
+        failTarget(target, QString("Failed to write back device data: %1").arg(strerror(errno)));
+        return false;
+    }
+    
+    // Only the window now on its way stays in the page cache
+    qint64 inFlight = qMin(length, target->cachedBytes.loadRelaxed());
+    target->bytesWritten.fetchAndAddRelaxed(target->cachedBytes.fetchAndStoreRelaxed(inFlight) - inFlight);
+    target->writtenBackEnd = target->submittedEnd;
+    reportProgress(false);
+    return true;
+}
+
+bool WriteEngine::flushWritten(Target *target)
+{
+    // Wait for everything submitted, then flush it out of the device's cache
+    QList<IoRequest> completed;
+    bool ok = target->backend->drain(completed);
+    recycleBuffers(target, completed);
+    if (!ok) {
+        failTarget(target, target->backend->errorString());
+        return false;
+    }
+    
+    if (!flushZeroRange(target) || !flushDevice(target)) {
+        return false;
+    }
+    publishVerifyPoint(target);
+    return true;
+}
+
+bool WriteEngine::reachFlushPoint(Target *target)
+{
+    // A flush in the middle of a trial would count against its setting, but
+    // between trials the queue is drained anyway, so a checkpoint due goes there
+    if (target->tuneStep >= 0) {
+        if (target->trialBytes < TrialBytes) {
+            return true;
+        }
+        if (!finishTrial(target)) {
+            return false;
+        }
+        bool ok = target->submittedEnd - target->checkpointOffset < CheckpointBytes || writeCheckpoint(target);
+        startTrial(target);
+        return ok;
+    }
+    
+    if (target->submittedEnd - target->checkpointOffset >= CheckpointBytes) {
+        return writeCheckpoint(target);
+    }
+    
+    if (!target->directIO && target->submittedEnd - target->writtenBackEnd >= m_writebackWindow
+        && !writeBack(target)) {
+        return false;
+    }
+    
+    // Reading back can only go as far as the last flush
+    if (m_verifyWhileWriting && target->submittedEnd - target->verifyEnd >= VerifyLagBytes) {
+        return flushWritten(target);
+    }
+    return true;
+}
+
+void WriteEngine::startTrial(Target *target)
+{
+    int configuredLimit = qBound(1, m_options.queueDepth, target->backend->queueDepth());
+    
+    // Settings the buffers or the ring cannot hold are skipped, as is the
+    // configured depth, which the size trials already measured
+    for (; target->tuneStep < TuneSizeCount + TuneDepthCount; ++target->tuneStep) {
+        bool sizeTrial = target->tuneStep < TuneSizeCount;
+        qint64 requestSize = sizeTrial ? TuneRequestSizes[target->tuneStep] : target->bestRequestSize;
+        int queueLimit = sizeTrial ? configuredLimit : TuneQueueDepths[target->tuneStep - TuneSizeCount];
+        if (requestSize > m_chunkSize || queueLimit > target->backend->queueDepth()
+            || (!sizeTrial && queueLimit == configuredLimit)) {
+            continue;
+        }
+        
+        target->requestSize = requestSize;
+        target->backend->setQueueLimit(queueLimit);
+        target->trialBytes = 0;
+        target->trialStalledNs = 0;
+        target->trialTimer.start();
+        return;
+    }
+    
+    // Everything tried; the rest of the burn uses the fastest setting
+    settleTuning(target);
+}
+
+void WriteEngine::settleTuning(Target *target)
+{
+    target->tuneStep = -1;
+    if (target->bestRate <= 0) {
+        return;
+    }
+    target->requestSize = target->bestRequestSize;
+    target->backend->setQueueLimit(target->bestQueueLimit);
+    emit targetTuned(target->index, target->bestRequestSize, target->bestQueueLimit, target->bestRate);
+}
+
+bool WriteEngine::finishTrial(Target *target)
+{
+    // A trial only counts once the device acknowledged all of its writes
+    QList<IoRequest> completed;
+    bool ok = target->backend->drain(completed);
+    recycleBuffers(target, completed);
+    if (!ok) {
+        failTarget(target, target->backend->errorString());
+        return false;
+    }
+    
+    qint64 elapsed = qMax<qint64>(1, target->trialTimer.nsecsElapsed() - target->trialStalledNs);
+    qint64 rate = target->trialBytes * 1000000000 / elapsed;
+    if (rate > target->bestRate) {
+        target->bestRate = rate;
+        target->bestRequestSize = target->requestSize;
+        target->bestQueueLimit = target->backend->queueLimit();
+    }
+    
+    ++target->tuneStep;
+    return true;
+}
+
+bool WriteEngine::writeCheckpoint(Target *target)
+{
+    // Only data the device acknowledged and flushed may count as written
+    if (!flushWritten(target)) {
+        return false;
+    }
+    
+    ByteRange window = resumeWindow(target->submittedEnd);
+    QByteArray hash;
+    if (m_stream) {
+        // The reader is past this part of a compressed image by now, but the
+        // device holds the same bytes once flushed
+        if (allocatePrivateBuffer(target)) {
+            hash = windowHash(target->fd, target->privateBuffer.data, window);
+        }
+    } else {
+        QByteArray data(int(window.length), 0);
+        hash = windowHash(m_imageFd, data.data(), window);
+    }
+    if (!hash.isEmpty()) {
+        target->checkpointOffset = target->submittedEnd;
+        emit checkpointReached(target->index, target->checkpointOffset, hash);
+    }
+    return true;
+}
+
+void WriteEngine::checkpointIfCancelled(Target *target)
+{
+    // Pausing cancels the burn; keep what already reached the device
+    if (m_cancelled.loadRelaxed() && target->state.loadRelaxed() != TargetFailed
+        && target->submittedEnd > target->checkpointOffset) {
+        writeCheckpoint(target);
+    }
+}
+
+ByteRange WriteEngine::resumeWindow(qint64 offset) const
+{
+    // The image data just before the offset, within the last range written there
+    for (int i = m_writeRanges.count() - 1; i >= 0; --i) {
+        const BlockMap::Range &range = m_writeRanges[i];
+        if (range.offset >= offset) {
+            continue;
+        }
+        qint64 end = qMin(offset, range.offset + range.length);
+        end -= end % BufferAlignment;
+        qint64 start = qMax(range.offset, end - ResumeWindow);
+        return {start, qMax<qint64>(0, end - start)};
+    }
+    return {0, 0};
+}
+
+QByteArray WriteEngine::windowHash(int fd, char *data, const ByteRange &window) const
+{
+    if (window.length <= 0 || !IoBackend::readFully(fd, data, window.length, window.offset)) {
+        return QByteArray();
+    }
+    return Sha256::hash(QByteArray::fromRawData(data, int(window.length))).toHex();
+}
+
+WriteEngine::Buffer &WriteEngine::bufferFor(Target *target, int tag)
+{
+    return tag < m_buffers.count() ? m_buffers[tag] : target->privateBuffer;
+}
+
+bool WriteEngine::deviceMatches(Target *target, const Buffer &buffer)
+{
+    if (!target->compareBuffer) {
+        void *data = nullptr;
+        if (posix_memalign(&data, BufferAlignment, m_chunkSize) != 0) {
+            return false;
+        }
+        target->compareBuffer = static_cast<char *>(data);
+    }
+    
+    // Whatever cannot be read back is simply written
+    return IoBackend::readAligned(target->fd, target->compareBuffer, buffer.length, buffer.offset, target->directIO)
+           && memcmp(target->compareBuffer, buffer.data, buffer.length) == 0;
+}
+
+bool WriteEngine::allocatePrivateBuffer(Target *target)
+{
+    if (target->privateBuffer.data) {
+        return true;
+    }
+    
+    void *data = nullptr;
+    if (posix_memalign(&data, BufferAlignment, m_chunkSize) != 0) {
+        failTarget(target, "Failed to allocate write buffer");
+        return false;
+    }
+    target->privateBuffer.data = static_cast<char *>(data);
+    return true;
+}
+
+void WriteEngine::limitDirtyData(Target *target)
+{
+    struct stat st;
+    if (fstat(target->fd, &st) != 0 || !S_ISBLK(st.st_mode)) {
+        return;
+    }
+    
+    // The write-back windows already bound what the engine leaves dirty; the
+    // BDI limits keep the kernel from letting it grow between them.
+    // strict_limit and max_bytes are newer than max_ratio; use what exists.
+    QString bdi = QString("/sys/dev/block/%1:%2/bdi/").arg(major(st.st_rdev)).arg(minor(st.st_rdev));
+    QList<QPair<QString, QByteArray>> limits;
+    limits << qMakePair(QString("strict_limit"), QByteArray("1"));
+    if (QFile::exists(bdi + "max_bytes")) {
+        limits << qMakePair(QString("max_bytes"), QByteArray::number(m_options.dirtyLimit));
+    } else {
+        limits << qMakePair(QString("max_ratio"), QByteArray(FallbackMaxRatio));
+    }
+    
+    // max_bytes is kept as a ratio, so restoring max_ratio undoes either
+    QByteArray maxRatio = readAttribute(bdi + "max_ratio");
+    QByteArray strictLimit = readAttribute(bdi + "strict_limit");
+    
+    for (const auto &limit : limits) {
+        if (!QFile::exists(bdi + limit.first) || !writeAttribute(bdi + limit.first, limit.second)) {
+            qWarning() << "Cannot set" << limit.first << "for" << target->devicePath;
+        }
+    }
+    
+    // Restored in reverse order by restoreDirtyData()
+    if (!maxRatio.isEmpty()) {
+        target->bdiSettings << qMakePair(bdi + "max_ratio", maxRatio);
+    }
+    if (!strictLimit.isEmpty()) {
+        target->bdiSettings << qMakePair(bdi + "strict_limit", strictLimit);
+    }
+}
+
+void WriteEngine::restoreDirtyData(Target *target)
+{
+    while (!target->bdiSettings.isEmpty()) {
+        QPair<QString, QByteArray> setting = target->bdiSettings.takeLast();
+        if (!writeAttribute(setting.first, setting.second)) {
+            qWarning() << "Cannot restore" << setting.first << "to" << setting.second;
+        }
+    }
+}
+
+void WriteEngine::verifyLoop(Target *target)
+{
+    // A descriptor of its own, so the writer dropping O_DIRECT for the tail does not matter
+    QByteArray devicePath = target->devicePath.toLocal8Bit();
+    int fd = open(devicePath.constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    bool directIO = fd >= 0;
+    if (fd < 0 && errno == EINVAL) {
+        fd = open(devicePath.constData(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        target->verifyError = QString("Cannot open %1: %2").arg(target->devicePath).arg(strerror(errno));
+        return;
+    }
+    
+    void *data = nullptr;
+    if (posix_memalign(&data, BufferAlignment, VerifyReadSize) != 0) {
+        target->verifyError = "Failed to allocate verification buffer";
+        close(fd);
+        return;
+    }
+    char *buffer = static_cast<char *>(data);
+    
+    auto readAt = [&](qint64 offset, qint64 length) {
+        while (!IoBackend::readAligned(fd, buffer, length, offset, directIO)) {
+            if (errno == EINVAL && directIO) {
+                qWarning() << "Unaligned read on" << target->devicePath << "- continuing without O_DIRECT";
+                IoBackend::dropDirectIO(fd);
+                directIO = false;
+                continue;
+            }
+            target->verifyError = errno == ENODATA ? QString("%1 ends before the image does").arg(target->devicePath)
+                                                   : QString("Read error on %1 at offset %2: %3")
+                                                     .arg(target->devicePath).arg(offset).arg(strerror(errno));
+            return false;
+        }
+        return true;
+    };
+    
+    LeafHasher leaves(m_options.verifyHash);
+    qint64 position = 0;
+    ByteRangeList zeroRanges;
+    int zeroIndex = 0;
+    
+    while (target->verifyError.isEmpty() && !m_stopped.loadRelaxed()) {
+        qint64 end;
+        {
+            QMutexLocker locker(&target->verifyMutex);
+            while (target->verifyEnd <= position && !target->writerFinished && !m_stopped.loadRelaxed()) {
+                target->verifyReady.wait(&target->verifyMutex);
+            }
+            end = target->verifyEnd;
+            zeroRanges = target->verifyZeroRanges;
+        }
+        if (position >= end) {
+            break;
+        }
+        
+        // Ranges skipped by sparse writing stand in as zeros, like Verifier does
+        const QVector<ByteRange> &zeros = zeroRanges.ranges();
+        while (position < end && target->verifyError.isEmpty() && !m_stopped.loadRelaxed()) {
+            while (zeroIndex < zeros.count() && zeros[zeroIndex].end() <= position) {
+                ++zeroIndex;
+            }
+            
+            if (zeroIndex < zeros.count() && zeros[zeroIndex].offset <= position) {
+                static const QByteArray zeroBlock(int(VerifyReadSize), 0);
+                qint64 length = qMin(zeros[zeroIndex].end(), end) - position;
+                for (qint64 done = 0; done < length; ) {
+                    qint64 count = qMin(length - done, VerifyReadSize);
+                    leaves.addData(zeroBlock.constData(), count);
+                    done += count;
+                }
+                position += length;
+                continue;
+            }
+            
+            qint64 length = qMin(VerifyReadSize, end - position);
+            if (zeroIndex < zeros.count()) {
+                length = qMin(length, zeros[zeroIndex].offset - position);
+            }
+            
+            if (!readAt(position, length)) {
+                break;
+            }
+            
+            leaves.addData(buffer, length);
+            position += length;
+        }
+    }
+    
+    // Skipped ranges were taken on trust; once the writer is done with them, a
+    // seeded sample is read back to catch a discard that left old data behind
+    VerifySample skipped(VerifySample::SkippedShare, m_options.verifySampleSeed);
+    skipped.sampleChunks(zeroRanges);
+    for (const ByteRange &range : skipped.ranges().ranges()) {
+        for (qint64 done = 0; done < range.length && target->verifyError.isEmpty() && !m_stopped.loadRelaxed(); ) {
+            qint64 length = qMin(VerifyReadSize, range.length - done);
+            if (!readAt(range.offset + done, length)) {
+                break;
+            }
+            if (!ZeroScan::isZero(buffer, length)) {
+                target->mismatches.add(range.offset + done, length);
+            }
+            done += length;
+        }
+    }
+    
+    free(buffer);
+    close(fd);
+    
+    if (target->verifyError.isEmpty() && !m_stopped.loadRelaxed()) {
+        target->deviceLeaves = leaves.result();
+    }
+}
+
+void WriteEngine::publishVerifyPoint(Target *target)
+{
+    if (!m_verifyWhileWriting) {
+        return;
+    }
+    
+    QMutexLocker locker(&target->verifyMutex);
+    target->verifyEnd = target->submittedEnd;
+    target->verifyZeroRanges = target->skippedRanges;
+    target->verifyReady.wakeAll();
+}
+
+void WriteEngine::finishVerification()
+{
+    bool waiting = false;
+    for (Target *target : m_targets) {
+        QMutexLocker locker(&target->verifyMutex);
+        target->writerFinished = true;
+        target->verifyReady.wakeAll();
+        waiting = waiting || (target->verifyThread && target->verifyEnd > 0);
+    }
+    
+    // Everything but the last flush window was read back while writing
+    if (waiting && !m_stopped.loadRelaxed()) {
+        emit statusChanged("Verifying the last written blocks...");
+    }
+    
+    for (Target *target : m_targets) {
+        if (target->verifyThread) {
+            target->verifyThread->wait();
+            delete target->verifyThread;
+            target->verifyThread = nullptr;
+        }
+    }
+    
+    // The image's leaves are complete once the hasher finished; compare with each device
+    for (Target *target : m_targets) {
+        if (target->state.loadRelaxed() != TargetDone || !target->verifyError.isEmpty()) {
+            continue;
+        }
+        if (target->verifyEnd != m_totalBytes || target->deviceLeaves.size() != m_totalBytes) {
+            target->verifyError = "Device was not read back completely";
+        } else if (!m_imageLeaves.isEmpty()) {
+            for (const ByteRange &range : m_imageLeaves.differences(target->deviceLeaves).ranges()) {
+                target->mismatches.add(range);
+            }
+        }
+        if (target->verifyError.isEmpty() && !target->mismatches.isEmpty()) {
+            target->verifyError = LeafDigests::describeMismatches(target->mismatches);
+        }
+    }
+}
+
+bool WriteEngine::prepareSparseWrite(Target *target)
+{
+    if (target->sparseMode == SparseMode::Off) {
+        return true;
+    }
+    
+    struct stat st;
+    if (fstat(target->fd, &st) != 0 || !S_ISBLK(st.st_mode)) {
+        qWarning() << target->devicePath << "is not a block device - sparse writing disabled";
+        target->sparseMode = SparseMode::Off;
+        return true;
+    }
+    qDebug() << "Sparse writing on" << target->devicePath << "- zero blocks found with" << ZeroScan::implementation();
+    
+    if (target->sparseMode != SparseMode::Discard) {
+        return true;
+    }
+    
+    // One discard up front covers every block the image leaves out, which
+    // needs the image size; without it skipped blocks are zeroed one by one.
+    // Delta mode needs the old content to compare with, so it zeroes them too.
+    if (m_totalBytes < 0 || isDeltaWrite()) {
+        target->sparseMode = SparseMode::ZeroOut;
+        return true;
+    }
+    if (m_targets.count() == 1) {
+        emit statusChanged("Discarding device blocks...");
+    }
+    // Only the part still to be written; a resumed burn keeps what came before
+    quint64 range[2] = {quint64(m_resumeOffset), quint64(m_totalBytes - m_totalBytes % 512 - m_resumeOffset)};
+    if (ioctl(target->fd, BLKDISCARD, range) == 0 && discardReadsZero(target)) {
+        return true;
+    }
+    
+    if (target->state.loadRelaxed() == TargetFailed) {
+        return false;
+    }
+    
+    qWarning() << "Discard does not zero" << target->devicePath << "- zeroing skipped ranges explicitly";
+    target->sparseMode = SparseMode::ZeroOut;
+    return true;
+}
+
+bool WriteEngine::discardReadsZero(Target *target)
+{
+    if (!allocatePrivateBuffer(target)) {
+        return false;
+    }
+    
+    // Not every device returns zeros after a discard; sample both ends of the range
+    char *data = target->privateBuffer.data;
+    qint64 lastBlock = qMax<qint64>(m_resumeOffset, (m_totalBytes - ZeroBlockSize) & ~(BufferAlignment - 1));
+    
+    for (qint64 offset : {m_resumeOffset, lastBlock}) {
+        qint64 length = qMin(ZeroBlockSize, m_totalBytes - offset);
+        length -= length % BufferAlignment;
+        if (length <= 0) {
+            continue;
+        }
+        if (!IoBackend::readFully(target->fd, data, length, offset) || !ZeroScan::isZero(data, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WriteEngine::planSparseWrite(Target *target, int tag, QList<IoRequest> &requests)
+{
+    const Buffer &buffer = bufferFor(target, tag);
+    
+    for (qint64 position = 0; position < buffer.length; position += ZeroBlockSize) {
+        qint64 length = qMin(ZeroBlockSize, buffer.length - position);
+        qint64 offset = buffer.offset + position;
+        
+        // Only whole sectors can be left to the discard or BLKZEROOUT
+        bool skip = length % BufferAlignment == 0
+                    && (buffer.hole || ZeroScan::isZero(buffer.data + position, length));
+        if (skip) {
+            if (!addZeroRange(target, offset, length)) {
+                return false;
+            }
+            continue;
+        }
+        
+        if (!requests.isEmpty() && requests.last().offset + requests.last().length == offset) {
+            requests.last().length += length;
+        } else {
+            requests.append({tag, buffer.data + position, offset, length});
+        }
+    }
+    return true;
+}
+
+bool WriteEngine::addZeroRange(Target *target, qint64 offset, qint64 length)
+{
+    ByteRange &pending = target->pendingZero;
+    if (pending.length > 0 && pending.end() == offset && pending.length + length <= MaxZeroRange) {
+        pending.length += length;
+        return true;
+    }
+    
+    bool ok = flushZeroRange(target);
+    pending = {offset, length};
+    return ok;
+}
+
+bool WriteEngine::flushZeroRange(Target *target)
+{
+    if (target->pendingZero.length <= 0) {
+        return true;
+    }
+    
+    ByteRange range = target->pendingZero;
+    target->pendingZero = {0, 0};
+    target->skippedRanges.add(range);
+    
+    if (target->sparseMode == SparseMode::ZeroOut) {
+        quint64 arguments[2] = {quint64(range.offset), quint64(range.length)};
+        if (ioctl(target->fd, BLKZEROOUT, arguments) != 0) {
+            failTarget(target, QString("Failed to zero device range at offset %1: %2")
+                       .arg(range.offset).arg(strerror(errno)));
+            return false;
+        }
+    }
+    return true;
+}
+
+int WriteEngine::takeFreeBuffer()
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    // A slow device throttles the reader one buffer at a time, so measure how long
+    // the ring has been full across calls rather than within one wait
+    if (!m_freeBuffers.isEmpty()) {
+        m_ringStall.invalidate();
+    } else if (!m_ringStall.isValid()) {
+        m_ringStall.start();
+    }
+    
+    while (m_freeBuffers.isEmpty() && !m_stopped.loadRelaxed() && attachedTargetCount() > 0) {
+        m_bufferFreed.wait(&m_ringMutex, DetachPollMs);
+        if (m_ringStall.elapsed() >= DetachDelayMs) {
+            detachSlowestTarget();
+            m_ringStall.restart();
+        }
+    }
+    
+    // With every target detached or failed there is nobody left to read for
+    if (m_stopped.loadRelaxed() || attachedTargetCount() == 0) {
+        return -1;
+    }
+    return m_freeBuffers.dequeue();
+}
+
+void WriteEngine::publishBuffer(int index)
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    int references = 0;
+    for (Target *target : m_targets) {
+        if (target->attached) {
+            target->filledBuffers.enqueue(index);
+            ++references;
+        }
+    }
+    if (m_hashImage) {
+        m_hashBuffers.enqueue(index);
+        ++references;
+    }
+    
+    m_bufferRefs[index] = references;
+    if (references == 0) {
+        m_freeBuffers.enqueue(index);
+    }
+    m_publishedChunks = m_buffers[index].chunk + 1;
+    m_bufferFilled.wakeAll();
+}
+
+void WriteEngine::publishEnd()
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    for (Target *target : m_targets) {
+        if (target->attached) {
+            target->filledBuffers.enqueue(EndOfStream);
+        }
+    }
+    if (m_hashImage) {
+        m_hashBuffers.enqueue(EndOfStream);
+    }
+    m_bufferFilled.wakeAll();
+}
+
+int WriteEngine::takeFilledBuffer(Target *target)
+{
+    QMutexLocker locker(&m_ringMutex);
+    
+    // A trial only times the device, so a wait for the reader is left out of it
+    QElapsedTimer stalled;
+    stalled.start();
+    while (target->filledBuffers.isEmpty() && target->attached && !m_stopped.loadRelaxed()) {
+        target->waitingForData = true;
+        m_bufferFilled.wait(&m_ringMutex);
+    }
+    if (target->waitingForData && target->tuneStep >= 0) {
+        target->trialStalledNs += stalled.nsecsElapsed();
+    }
+    target->waitingForData = false;
+    
+    if (m_stopped.loadRelaxed()) {
+        return EndOfStream;
+    }
+    if (!target->filledBuffers.isEmpty()) {
+        return target->filledBuffers.dequeue();
+    }
+    return DetachedFromRing;
+}
+
+void WriteEngine::releaseBuffer(int index)
+{
+    QMutexLocker locker(&m_ringMutex);
+    releaseBufferLocked(index);
+}
+
+void WriteEngine::releaseBufferLocked(int index)
+{
+    if (--m_bufferRefs[index] == 0) {
+        m_freeBuffers.enqueue(index);
+        m_bufferFreed.wakeAll();
+    }
+}
+
+void WriteEngine::detachSlowestTarget()
+{
+    // Only worth it when someone is starved; a uniformly slow set just fills the ring
+    Target *slowest = nullptr;
+    bool anyoneWaiting = false;
+    int attached = 0;
+    
+    for (Target *target : m_targets) {
+        if (!target->attached) {
+            continue;
+        }
+        ++attached;
+        if (target->waitingForData) {
+            anyoneWaiting = true;
+        } else if (!slowest || target->filledBuffers.count() > slowest->filledBuffers.count()) {
+            slowest = target;
+        }
+    }
+    
+    // A compressed image can only be decoded once, so nobody can read on alone
+    if (attached < 2 || !anyoneWaiting || !slowest || m_stream) {
+        return;
+    }
+    
+    qDebug() << "Detaching slow device" << slowest->devicePath << "from the shared buffer ring";
+    slowest->state.storeRelaxed(TargetDetached);
+    detachTarget(slowest);
+}
+
+void WriteEngine::detachTarget(Target *target)
+{
+    // Called with m_ringMutex held
+    target->resumeChunk = m_publishedChunks;
+    if (!target->filledBuffers.isEmpty() && target->filledBuffers.head() >= 0) {
+        target->resumeChunk = m_buffers[target->filledBuffers.head()].chunk;
+    }
+    
+    while (!target->filledBuffers.isEmpty()) {
+        int index = target->filledBuffers.dequeue();
+        if (index >= 0) {
+            releaseBufferLocked(index);
+        }
+    }
+    
+    target->attached = false;
+    m_bufferFilled.wakeAll();
+}
+
+int WriteEngine::attachedTargetCount() const
+{
+    int count = 0;
+    for (const Target *target : m_targets) {
+        if (target->attached) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void WriteEngine::fail(const QString &message)
+{
+    QMutexLocker locker(&m_errorMutex);
+    
+    // Keep the first error; later ones are usually consequences of it
+    if (m_errorString.isEmpty()) {
+        m_errorString = message;
+        qWarning() << "WriteEngine:" << message;
+    }
+    locker.unlock();
+    
+    stop();
+}
+
+void WriteEngine::failTarget(Target *target, const QString &message)
+{
+    QMutexLocker locker(&m_errorMutex);
+    if (!target->errorString.isEmpty()) {
+        return;
+    }
+    target->errorString = message;
+    target->state.storeRelaxed(TargetFailed);
+    qWarning() << "WriteEngine:" << target->devicePath << message;
+    locker.unlock();
+    
+    // The other devices carry on without this one
+    QMutexLocker ringLocker(&m_ringMutex);
+    if (target->attached) {
+        detachTarget(target);
+    }
+    m_bufferFreed.wakeAll();
+    ringLocker.unlock();
+    
+    emit targetFailed(target->index, message);
+}
+
+void WriteEngine::stop()
+{
+    m_stopped.storeRelaxed(1);
+    
+    QMutexLocker locker(&m_ringMutex);
+    m_bufferFreed.wakeAll();
+    m_bufferFilled.wakeAll();
+}
+
+bool WriteEngine::isStopped(const Target *target) const
+{
+    return m_stopped.loadRelaxed() || target->state.loadRelaxed() == TargetFailed;
+}
+
+void WriteEngine::reportProgress(bool force)
+{
+    QMutexLocker locker(&m_progressMutex);
+    
+    if (!force && m_progressTimer.elapsed() < ProgressIntervalMs) {
+        return;
+    }
+    m_progressTimer.restart();
+    
+    // Overall progress is the average over the devices still in the race
+    qint64 total = 0;
+    int live = 0;
+    for (const Target *target : m_targets) {
+        if (target->state.loadRelaxed() != TargetFailed) {
+            total += target->bytesWritten.loadRelaxed();
+            ++live;
+        }
+    }
+    // Until a compressed image of unknown size ends, measure against an estimate
+    qint64 bytesToWrite = m_bytesToWrite.loadRelaxed();
+    if (bytesToWrite < 0) {
+        bytesToWrite = m_stream->estimatedSize();
+    }
+    emit progressChanged(live > 0 ? total / live : 0, bytesToWrite);
+    
+    if (m_targets.count() > 1) {
+        for (const Target *target : m_targets) {
+            emit targetProgressChanged(target->index, target->bytesWritten.loadRelaxed(),
+                                       targetStateName(target->state.loadRelaxed()));
+        }
+    }
+}
@@ -0,0 +1,317 @@
+#ifndef WRITEENGINE_H
+#define WRITEENGINE_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QPair>
+#include "Burner.h"
+#include "ByteRange.h"
+#include "BlockMap.h"
+#include "LeafDigests.h"
+
+class IoBackend;
+class ImageSource;
+struct IoRequest;
+
+// Native image writer. The engine thread reads the image once into a ring of
+// aligned buffers; one writer thread per target device queues them with
+// O_DIRECT, so reading and writing overlap instead of alternating like dd
+// does. With the io_uring backend several writes are in flight at once.
+//
+// With several targets every buffer is shared by all of them. A device that
+// fails drops out on its own, and one that keeps the ring full while others
+// wait is detached and finishes by reading the image itself.
+//
+// The image is hashed from the same buffers on a thread of its own while it is
+// written, so verification only has to read the device back.
+//
+// Every so often each device is flushed and a checkpoint reported, so an
+// interrupted burn can continue from there. Cancelling also reports one for
+// whatever already reached the device.
+//
+// With sparse writing enabled, holes and all-zero blocks of the image are
+// skipped instead of written. Given a block map, only the mapped ranges are
+// read, checked and written, and given repair ranges only those.
+//
+// Compressed images are decoded by an ImageSource while they are written. They
+// can only be read front to back, so no device is detached from the ring, and
+// when the image does not record its size the chunks are planned as the data
+// arrives.
+//
+// In delta mode (BurnMode::DeltaMode) each writer reads the chunk's range of its
+// device before writing it, while the reader fetches the next chunks of the
+// image, and only writes the chunks that differ. Reflashing a device with a
+// slightly changed build of the same image then costs a read of the device plus
+// the changed chunks.
+//
+// With verifyWhileWriting a reader thread per target reads the device back a
+// flush behind the writer: every so often the writer drains its queue and
+// flushes the device, and everything up to there is read back with O_DIRECT
+// into leaf digests that are compared with the image's at the end, which
+// also tells where a device differs.
+//
+// Devices written through the page cache (bufferedWrites, or no O_DIRECT) are
+// written back in sync_file_range windows. With bufferedWrites the windows add
+// up to dirtyLimit, and the device's own write-back limits (strict_limit and
+// max_bytes or max_ratio of its BDI) are tightened for the duration of the
+// burn and restored afterwards.
+//
+// With autotune each O_DIRECT target tries a range of request sizes and queue
+// depths on the first few hundred MB of the image, timing each until the device
+// acknowledged it, and writes the rest with the fastest. The ring then holds
+// the largest size and every buffer is split into requests of the size tried.
+class WriteEngine : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit WriteEngine(const BurnOptions &options, QObject *parent = nullptr);
+    ~WriteEngine();
+    
+    void cancel();
+    
+    // Successful only when every target was written
+    bool isSuccessful() const { return m_success; }
+    bool isCancelled() const { return m_cancelled.loadRelaxed() != 0; }
+    QString errorString() const;
+    qint64 totalBytes() const { return m_bytesToWrite.loadRelaxed(); }
+    
+    // Uncompressed image size; for gzip and bzip2 only known once the write finished
+    qint64 imageSize() const { return m_totalBytes; }
+    const BurnOptions &options() const { return m_options; }
+    
+    int targetCount() const { return m_targets.count(); }
+    QString targetPath(int target) const { return m_targets[target]->devicePath; }
+    bool isTargetDone(int target) const { return m_targets[target]->state.loadRelaxed() == TargetDone; }
+    
+    // Devices read back while writing; empty error when the device matched the image,
+    // otherwise the ranges that differ
+    bool isVerifiedWhileWriting() const { return m_verifyWhileWriting && !m_imageLeaves.isEmpty(); }
+    QString targetVerifyError(int target) const { return m_targets[target]->verifyError; }
+    const ByteRangeList &targetMismatches(int target) const { return m_targets[target]->mismatches; }
+    
+    // Delta mode only writes chunks that differ from what the device holds
+    bool isDeltaWrite() const { return m_options.mode == BurnMode::DeltaMode; }
+    qint64 changedBytes(int target) const { return m_targets[target]->changedBytes.loadRelaxed(); }
+    
+    // Digest of the whole image as hex, hashed from the ring while writing or
+    // given in the options. Empty when not every byte went through the reader
+    // (block map, resumed burn, repair).
+    QByteArray imageDigest() const { return m_imageDigest; }
+    
+    // Leaf digests of the image for verification, hashed alongside when the
+    // devices are verified and every byte went through the reader
+    const LeafDigests &imageLeaves() const { return m_imageLeaves; }
+    
+    // Ranges left to discard or BLKZEROOUT instead of being written; valid once finished
+    const ByteRangeList &skippedRanges() const;
+
+signals:
+    void progressChanged(qint64 bytesWritten, qint64 totalBytes);
+    void targetProgressChanged(int target, qint64 bytesWritten, const QString &state);
+    void targetFailed(int target, const QString &message);
+    void checkpointReached(int target, qint64 offset, const QByteArray &hash);
+    void statusChanged(const QString &status);
+    void targetTuned(int target, qint64 requestSize, int queueDepth, qint64 bytesPerSecond);
+
+protected:
+    void run() override;
+
+private:
+    struct Buffer {
+        char *data;
+        qint64 offset;
+        qint64 length;
+        int chunk;      // Position in m_chunks
+        bool hole;      // Entirely inside a hole of the image; zero filled, not read
+    };
+    
+    struct Chunk {
+        qint64 offset;
+        qint64 length;
+        int range;      // Index into m_writeRanges
+    };
+    
+    enum TargetState {
+        TargetWriting,
+        TargetDetached,
+        TargetFlushing,
+        TargetDone,
+        TargetFailed
+    };
+    
+    struct Target {
+        int index;
+        QString devicePath;
+        int fd;
+        bool directIO;
+        IoBackend *backend;
+        QThread *thread;
+        
+        SparseMode sparseMode;
+        ByteRange pendingZero;
+        ByteRangeList skippedRanges;
+        QVector<int> pendingWrites;     // Requests in flight per buffer tag
+        Buffer privateBuffer;           // Used after detaching from the ring
+        char *compareBuffer;            // Device data read back in delta mode
+        qint64 submittedEnd;            // End of the last chunk handed to the backend
+        qint64 checkpointOffset;        // Everything before this is flushed to the device
+        qint64 writtenBackEnd;          // Buffered writes before this went out to the device
+        QList<QPair<QString, QByteArray>> bdiSettings;  // Original write-back limits to restore
+        qint64 requestSize;             // Longest write handed to the backend
+        
+        // Autotuning; tuneStep is the setting being tried, -1 once settled
+        int tuneStep;
+        qint64 trialBytes;
+        QElapsedTimer trialTimer;
+        qint64 trialStalledNs;          // Spent waiting for the reader, not the device
+        qint64 bestRate;                // Bytes per second
+        qint64 bestRequestSize;
+        int bestQueueLimit;
+        
+        // Guarded by m_ringMutex
+        QQueue<int> filledBuffers;
+        bool attached;
+        bool waitingForData;
+        int resumeChunk;
+        
+        QAtomicInt state;
+        QAtomicInteger<qint64> bytesWritten;    // On the device; what progress reports
+        QAtomicInteger<qint64> cachedBytes;     // Buffered writes still in the page cache
+        QAtomicInteger<qint64> changedBytes;    // Chunks delta mode found different
+        QString errorString;            // Guarded by m_errorMutex
+        
+        // Read back while writing; the writer moves verifyEnd after each flush
+        QThread *verifyThread;
+        QMutex verifyMutex;
+        QWaitCondition verifyReady;
+        qint64 verifyEnd;               // Guarded by verifyMutex
+        ByteRangeList verifyZeroRanges; // Guarded by verifyMutex
+        bool writerFinished;            // Guarded by verifyMutex
+        LeafDigests deviceLeaves;
+        ByteRangeList mismatches;
+        QString verifyError;
+    };
+    
+    // Setup and teardown
+    bool openImage();
+    bool planRanges();
+    bool planNextChunk();
+    bool checkResumePoint();
+    void skipResumedChunks();
+    bool openTargets();
+    bool openTarget(Target *target);
+    void closeFiles();
+    bool allocateBuffers();
+    void freeBuffers();
+    
+    // Reader side of the copy, running on the engine thread
+    void readerLoop();
+    bool readChunk(int chunk, Buffer &buffer, qint64 &nextData);
+    bool readStream(Buffer &buffer);
+    bool rewindImage();
+    QString readErrorString() const;
+    
+    // Inline image hashing, another consumer of the ring
+    void hasherLoop();
+    int takeHashBuffer();
+    
+    // Writer side, one thread per target
+    void writerLoop(Target *target);
+    bool writePrivately(Target *target);
+    bool writeBuffer(Target *target, int tag);
+    bool writeTail(Target *target, int tag, qint64 alignedLength);
+    void recycleBuffers(Target *target, QList<IoRequest> &completed);
+    void completeBuffer(Target *target, int tag);
+    void releasePendingBuffers(Target *target);
+    bool flushDevice(Target *target);
+    bool flushWritten(Target *target);
+    bool writeBack(Target *target);
+    void limitDirtyData(Target *target);
+    void restoreDirtyData(Target *target);
+    bool reachFlushPoint(Target *target);
+    void startTrial(Target *target);
+    bool finishTrial(Target *target);
+    void settleTuning(Target *target);
+    bool writeCheckpoint(Target *target);
+    void checkpointIfCancelled(Target *target);
+    ByteRange resumeWindow(qint64 offset) const;
+    QByteArray windowHash(int fd, char *data, const ByteRange &window) const;
+    Buffer &bufferFor(Target *target, int tag);
+    bool deviceMatches(Target *target, const Buffer &buffer);
+    bool allocatePrivateBuffer(Target *target);
+    
+    // Read back while writing, one thread per target
+    void verifyLoop(Target *target);
+    void publishVerifyPoint(Target *target);
+    void finishVerification();
+    
+    // Sparse writing
+    bool prepareSparseWrite(Target *target);
+    bool discardReadsZero(Target *target);
+    bool planSparseWrite(Target *target, int tag, QList<IoRequest> &requests);
+    bool addZeroRange(Target *target, qint64 offset, qint64 length);
+    bool flushZeroRange(Target *target);
+    
+    // Buffer ring shared by the reader and all writers
+    int takeFreeBuffer();
+    void publishBuffer(int index);
+    void publishEnd();
+    int takeFilledBuffer(Target *target);
+    void releaseBuffer(int index);
+    void releaseBufferLocked(int index);
+    void detachSlowestTarget();
+    void detachTarget(Target *target);
+    int attachedTargetCount() const;
+    
+    void fail(const QString &message);
+    void failTarget(Target *target, const QString &message);
+    void stop();
+    bool isStopped(const Target *target) const;
+    void reportProgress(bool force);
+    
+    BurnOptions m_options;
+    int m_imageFd;
+    ImageSource *m_stream;          // Decoder for compressed images, otherwise null
+    qint64 m_totalBytes;            // -1 while a compressed image's size is unknown
+    QAtomicInteger<qint64> m_bytesToWrite;
+    qint64 m_chunkSize;
+    qint64 m_writebackWindow;       // Buffered writes left to the page cache at a time
+    qint64 m_resumeOffset;          // Where this run starts; 0 unless a checkpoint checked out
+    
+    BlockMap m_blockMap;
+    QVector<BlockMap::Range> m_writeRanges;     // Image ranges to copy, in order
+    QVector<Chunk> m_chunks;                    // The same ranges cut into buffer sized pieces
+    QVector<Target *> m_targets;
+    
+    QVector<Buffer> m_buffers;
+    QVector<int> m_bufferRefs;      // Targets still holding each buffer
+    QQueue<int> m_freeBuffers;
+    int m_publishedChunks;
+    QElapsedTimer m_ringStall;      // Running while the reader finds the ring full
+    bool m_hashImage;
+    bool m_verifyWhileWriting;
+    QQueue<int> m_hashBuffers;      // Published buffers the hasher has not seen yet
+    QMutex m_ringMutex;
+    QWaitCondition m_bufferFreed;
+    QWaitCondition m_bufferFilled;
+    
+    QAtomicInt m_cancelled;
+    QAtomicInt m_stopped;
+    QMutex m_progressMutex;
+    QElapsedTimer m_progressTimer;
+    
+    QByteArray m_imageDigest;
+    LeafDigests m_imageLeaves;
+    
+    mutable QMutex m_errorMutex;
+    QString m_errorString;
+    bool m_success;
+};
+
+#endif // WRITEENGINE_H
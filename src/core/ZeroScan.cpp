@@ -0,0 +1,131 @@
+#include "ZeroScan.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZEROSCAN_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define ZEROSCAN_NEON
+#endif
+
+typedef bool (*ScanFunction)(const char *data, qint64 length);
+
+static bool isZeroGeneric(const char *data, qint64 length)
+{
+    quint64 accumulator = 0;
+    qint64 i = 0;
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        memcpy(&word, data + i, sizeof(word));
+        accumulator |= word;
+    }
+    for (; i < length; ++i) {
+        accumulator |= quint8(data[i]);
+    }
+    return accumulator == 0;
+}
+
+#ifdef ZEROSCAN_X86
+__attribute__((target("avx2")))
+static bool isZeroAvx2(const char *data, qint64 length)
+{
+    qint64 i = 0;
+    // OR four vectors together so there is one test per 128 bytes
+    for (; i + 128 <= length; i += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (!_mm256_testz_si256(any, any)) {
+            return false;
+        }
+    }
+    return isZeroGeneric(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static bool isZeroSse2(const char *data, qint64 length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    qint64 i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 32));
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xffff) {
+            return false;
+        }
+    }
+    return isZeroGeneric(data + i, length - i);
+}
+#endif
+
+#ifdef ZEROSCAN_NEON
+static bool isZeroNeon(const char *data, qint64 length)
+{
+    qint64 i = 0;
+    for (; i + 64 <= length; i += 64) {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data + i);
+        uint8x16_t any = vorrq_u8(vorrq_u8(vld1q_u8(p), vld1q_u8(p + 16)),
+                                  vorrq_u8(vld1q_u8(p + 32), vld1q_u8(p + 48)));
+        if (vmaxvq_u8(any) != 0) {
+            return false;
+        }
+    }
+    return isZeroGeneric(data + i, length - i);
+}
+#endif
+
+static ScanFunction selectScanner(QString *name)
+{
+#ifdef ZEROSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "AVX2";
+        return isZeroAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        *name = "SSE2";
+        return isZeroSse2;
+    }
+#endif
+#ifdef ZEROSCAN_NEON
+    *name = "NEON";
+    return isZeroNeon;
+#endif
+    *name = "generic";
+    return isZeroGeneric;
+}
+
+static ScanFunction scanner(QString *name = nullptr)
+{
+    static QString selectedName;
+    static const ScanFunction selected = selectScanner(&selectedName);
+    if (name) {
+        *name = selectedName;
+    }
+    return selected;
+}
+
+bool ZeroScan::isZero(const char *data, qint64 length)
+{
+    // Most data blocks fail on the first byte, so check that before the vector loop
+    if (length <= 0) {
+        return true;
+    }
+    if (data[0] != 0) {
+        return false;
+    }
+    return scanner()(data, length);
+}
+
+QString ZeroScan::implementation()
+{
+    QString name;
+    scanner(&name);
+    return name;
+}
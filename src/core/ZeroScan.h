@@ -0,0 +1,18 @@
+#ifndef ZEROSCAN_H
+#define ZEROSCAN_H
+
+#include <QString>
+
+// Fast all-zero test for image blocks. Picks the widest vector unit the CPU
+// offers (AVX2, SSE2 or NEON) on first use.
+class ZeroScan
+{
+public:
+    static bool isZero(const char *data, qint64 length);
+    static QString implementation();
+
+private:
+    ZeroScan() = delete;
+};
+
+#endif // ZEROSCAN_H
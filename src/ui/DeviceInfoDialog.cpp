@@ -21,7 +21,7 @@ DeviceInfoDialog::DeviceInfoDialog(const DeviceInfo &deviceInfo, QWidget *parent
 
 void DeviceInfoDialog::setupUi()
 {
-    resize(500, 400);
+    resize(500, 600);
     
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
     
@@ -70,6 +70,37 @@ void DeviceInfoDialog::setupUi()
     
     mainLayout->addWidget(detailsGroup);
     
+    // What earlier burns measured
+    QGroupBox *performanceGroup = new QGroupBox("Performance");
+    QGridLayout *performanceLayout = new QGridLayout(performanceGroup);
+    
+    performanceLayout->addWidget(new QLabel("Write Speed:"), 0, 0);
+    m_writeSpeedLabel = new QLabel();
+    performanceLayout->addWidget(m_writeSpeedLabel, 0, 1);
+    
+    performanceLayout->addWidget(new QLabel("Read Speed:"), 1, 0);
+    m_readSpeedLabel = new QLabel();
+    performanceLayout->addWidget(m_readSpeedLabel, 1, 1);
+    
+    performanceLayout->addWidget(new QLabel("Best Settings:"), 2, 0);
+    m_tuningLabel = new QLabel();
+    performanceLayout->addWidget(m_tuningLabel, 2, 1);
+    
+    performanceLayout->addWidget(new QLabel("Write Cache:"), 3, 0);
+    m_cliffLabel = new QLabel();
+    performanceLayout->addWidget(m_cliffLabel, 3, 1);
+    
+    m_trendLabel = new QLabel();
+    m_trendLabel->setWordWrap(true);
+    performanceLayout->addWidget(m_trendLabel, 4, 0, 1, 2);
+    
+    m_historyText = new QTextEdit();
+    m_historyText->setReadOnly(true);
+    m_historyText->setMaximumHeight(120);
+    performanceLayout->addWidget(m_historyText, 5, 0, 1, 2);
+    
+    mainLayout->addWidget(performanceGroup);
+    
     // Action buttons
     QHBoxLayout *actionLayout = new QHBoxLayout();
     
@@ -145,6 +176,54 @@ void DeviceInfoDialog::updateInfo()
     }
     
     m_detailsText->setPlainText(details);
+    
+    updatePerformance();
+}
+
+void DeviceInfoDialog::updatePerformance()
+{
+    DeviceProfile profile(m_deviceInfo);
+    profile.load();
+    
+    auto speed = [](qint64 bytesPerSecond) {
+        return bytesPerSecond > 0 ? DeviceManager::formatSize(bytesPerSecond) + "/s" : QString("Not measured yet");
+    };
+    
+    m_writeSpeedLabel->setText(speed(profile.writeThroughput()));
+    m_readSpeedLabel->setText(speed(profile.readThroughput()));
+    m_tuningLabel->setText(profile.isTuned() ? QString("%1 KB blocks, queue depth %2")
+                                               .arg(profile.blockSize() / 1024).arg(profile.queueDepth())
+                                             : QString("Not tuned yet"));
+    
+    if (profile.cliffOffset() > 0) {
+        m_cliffLabel->setText(QString("Slows down to %1 after %2")
+                              .arg(speed(profile.cliffThroughput()), DeviceManager::formatSize(profile.cliffOffset())));
+    } else {
+        m_cliffLabel->setText(profile.writeThroughput() > 0 ? "No slowdown seen" : "Not measured yet");
+    }
+    
+    // A stick that writes slower with every burn is likely to fail soon
+    double trend = profile.writeTrend();
+    if (trend < 0.8) {
+        m_trendLabel->setText(QString("Write speed dropped %1% since the first burns; the device may be wearing out")
+                              .arg(qRound((1.0 - trend) * 100)));
+        m_trendLabel->setStyleSheet("QLabel { color: red; }");
+    } else {
+        m_trendLabel->clear();
+        m_trendLabel->setStyleSheet(QString());
+    }
+    
+    // Latest burn first
+    QStringList history;
+    for (int i = profile.history().count() - 1; i >= 0; --i) {
+        const DeviceProfile::BurnRecord &record = profile.history()[i];
+        history << QString("%1  %2  %3  %4")
+                   .arg(record.date.toString("yyyy-MM-dd hh:mm"))
+                   .arg(record.success ? "OK    " : "Failed")
+                   .arg(record.writeThroughput > 0 ? speed(record.writeThroughput) : DeviceManager::formatSize(record.bytes))
+                   .arg(record.imageName);
+    }
+    m_historyText->setPlainText(history.isEmpty() ? QString("No burns recorded for this device") : history.join("\n"));
 }
 
 void DeviceInfoDialog::refreshInfo()
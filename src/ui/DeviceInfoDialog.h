@@ -6,6 +6,7 @@
 #include <QTextEdit>
 #include <QPushButton>
 #include "../core/DeviceManager.h"
+#include "../core/DeviceProfile.h"
 
 class DeviceInfoDialog : public QDialog
 {
@@ -22,6 +23,7 @@ private slots:
 private:
     void setupUi();
     void updateInfo();
+    void updatePerformance();
     
     DeviceInfo m_deviceInfo;
     DeviceManager *m_deviceManager;
@@ -35,6 +37,14 @@ private:
     QLabel *m_typeLabel;
     QTextEdit *m_detailsText;
     
+    // From the device's profile (see DeviceProfile)
+    QLabel *m_writeSpeedLabel;
+    QLabel *m_readSpeedLabel;
+    QLabel *m_tuningLabel;
+    QLabel *m_cliffLabel;
+    QLabel *m_trendLabel;
+    QTextEdit *m_historyText;
+    
     QPushButton *m_refreshButton;
     QPushButton *m_unmountButton;
     QPushButton *m_ejectButton;
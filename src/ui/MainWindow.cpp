@@ -16,6 +16,7 @@
 #include <QComboBox>
 #include <QLineEdit>
 #include <QCheckBox>
+#include <QListWidget>
 #include <QProgressBar>
 #include <QTextEdit>
 #include <QSplitter>
@@ -23,9 +24,16 @@
 #include <QCloseEvent>
 #include <QStandardPaths>
 #include <QDateTime>
+#include <QFileInfo>
 #include <QRegularExpression>
 #include <QTextCursor>
 #include <QIcon>
+#include <QThread>
+#include <QThreadPool>
+#include <QSharedPointer>
+
+// Share of the image a quick verification compares
+static const double QuickVerifySample = 0.02;
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -130,6 +138,15 @@ void MainWindow::setupUi()
     m_deviceInfoLabel->setWordWrap(true);
     deviceLayout->addWidget(m_deviceInfoLabel, 1, 0, 1, 4);
     
+    m_multiDeviceCheck = new QCheckBox("Burn to multiple devices");
+    m_multiDeviceCheck->setToolTip("Write the same image to every checked device at once");
+    deviceLayout->addWidget(m_multiDeviceCheck, 2, 0, 1, 4);
+    
+    m_targetList = new QListWidget();
+    m_targetList->setMaximumHeight(100);
+    m_targetList->setVisible(false);
+    deviceLayout->addWidget(m_targetList, 3, 0, 1, 4);
+    
     // File system options group
     m_fileSystemGroup = new QGroupBox("File System Options");
     QGridLayout *fsLayout = new QGridLayout(m_fileSystemGroup);
@@ -165,6 +182,25 @@ void MainWindow::setupUi()
     m_verifyCheck = new QCheckBox("Verify after burning");
     advancedLayout->addWidget(m_verifyCheck);
     
+    m_verifyWhileWritingCheck = new QCheckBox("Verify while writing");
+    m_verifyWhileWritingCheck->setChecked(true);
+    m_verifyWhileWritingCheck->setEnabled(false);
+    m_verifyWhileWritingCheck->setToolTip("Read the device back a little behind the writer instead of in a separate pass afterwards");
+    advancedLayout->addWidget(m_verifyWhileWritingCheck);
+    
+    m_verifyBlake3Check = new QCheckBox("Verify with BLAKE3 (hashes on every core)");
+    m_verifyBlake3Check->setEnabled(false);
+    m_verifyBlake3Check->setToolTip("SHA-256 is one stream on one core; BLAKE3 hashes the image and each "
+                                    "device on all of them, for when hashing limits the verify pass");
+    advancedLayout->addWidget(m_verifyBlake3Check);
+    
+    m_quickVerifyCheck = new QCheckBox("Quick verify (compare a 2% random sample)");
+    m_quickVerifyCheck->setEnabled(false);
+    m_quickVerifyCheck->setToolTip("Reads the start and end of the device, its partition tables and random "
+                                   "chunks instead of all of it; enough to catch dead or counterfeit sticks "
+                                   "in seconds, not to prove every byte");
+    advancedLayout->addWidget(m_quickVerifyCheck);
+    
     m_createBootableCheck = new QCheckBox("Create bootable USB");
     m_createBootableCheck->setChecked(true);
     advancedLayout->addWidget(m_createBootableCheck);
@@ -172,6 +208,43 @@ void MainWindow::setupUi()
     m_badBlockCheck = new QCheckBox("Check for bad blocks");
     advancedLayout->addWidget(m_badBlockCheck);
     
+    m_sparseWriteCheck = new QCheckBox("Skip empty blocks (sparse write)");
+    m_sparseWriteCheck->setChecked(true);
+    m_sparseWriteCheck->setToolTip("Zero-filled regions of the image are discarded on the device instead of written");
+    advancedLayout->addWidget(m_sparseWriteCheck);
+    
+    m_bufferedWriteCheck = new QCheckBox("Write through the page cache (at most 64 MB unwritten per device)");
+    m_bufferedWriteCheck->setToolTip("For devices that are slow with direct writes; write-back is paced so the "
+                                     "system stays responsive and progress shows what reached the device");
+    advancedLayout->addWidget(m_bufferedWriteCheck);
+    
+    m_deltaWriteCheck = new QCheckBox("Only rewrite blocks that changed (reflash)");
+    m_deltaWriteCheck->setToolTip("The device is compared with the image first and only differing blocks are written; "
+                                  "for reflashing a device that already holds an older build of the same image");
+    advancedLayout->addWidget(m_deltaWriteCheck);
+    
+    QHBoxLayout *writeTuningLayout = new QHBoxLayout();
+    writeTuningLayout->addWidget(new QLabel("Write Block Size:"));
+    m_blockSizeCombo = new QComboBox();
+    m_blockSizeCombo->addItem("Auto", 0);
+    m_blockSizeCombo->addItem("256 KB", 256 * 1024);
+    m_blockSizeCombo->addItem("1 MB", 1024 * 1024);
+    m_blockSizeCombo->addItem("4 MB", 4 * 1024 * 1024);
+    m_blockSizeCombo->addItem("16 MB", 16 * 1024 * 1024);
+    m_blockSizeCombo->setCurrentIndex(0);
+    m_blockSizeCombo->setToolTip("Auto tries block sizes and queue depths on the first few hundred MB and "
+                                 "remembers the fastest for the device, so later burns start with them");
+    writeTuningLayout->addWidget(m_blockSizeCombo);
+    
+    writeTuningLayout->addWidget(new QLabel("Queue Depth:"));
+    m_queueDepthSpin = new QSpinBox();
+    m_queueDepthSpin->setRange(1, 32);
+    m_queueDepthSpin->setValue(4);
+    m_queueDepthSpin->setToolTip("Writes kept in flight with io_uring; 1 uses plain synchronous writes");
+    writeTuningLayout->addWidget(m_queueDepthSpin);
+    writeTuningLayout->addStretch();
+    advancedLayout->addLayout(writeTuningLayout);
+    
     // Progress group
     m_progressGroup = new QGroupBox("Progress");
     QVBoxLayout *progressLayout = new QVBoxLayout(m_progressGroup);
@@ -203,6 +276,11 @@ void MainWindow::setupUi()
     m_cancelButton->setEnabled(false);
     m_cancelButton->setMinimumHeight(35);
     
+    m_pauseButton = new QPushButton("Pause");
+    m_pauseButton->setEnabled(false);
+    m_pauseButton->setMinimumHeight(35);
+    m_pauseButton->setToolTip("Stop after flushing the device; the burn can be resumed later, even after a restart");
+    
     m_formatButton = new QPushButton("Format Device");
     m_formatButton->setMinimumHeight(35);
     
@@ -213,6 +291,7 @@ void MainWindow::setupUi()
     m_logButton->setMinimumHeight(35);
     
     buttonLayout->addWidget(m_startButton);
+    buttonLayout->addWidget(m_pauseButton);
     buttonLayout->addWidget(m_cancelButton);
     buttonLayout->addStretch();
     buttonLayout->addWidget(m_formatButton);
@@ -252,6 +331,9 @@ void MainWindow::setupMenuBar()
     selectImageAction->setShortcut(QKeySequence::Open);
     connect(selectImageAction, &QAction::triggered, this, &MainWindow::selectImage);
     
+    m_checksumAction = fileMenu->addAction("Compute &Checksums...");
+    connect(m_checksumAction, &QAction::triggered, this, &MainWindow::computeChecksums);
+    
     fileMenu->addSeparator();
     
     QAction *exitAction = fileMenu->addAction("E&xit");
@@ -295,14 +377,23 @@ void MainWindow::setupConnections()
     connect(m_deviceCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::deviceSelectionChanged);
     connect(m_deviceInfoButton, &QPushButton::clicked, this, &MainWindow::showDeviceInfo);
+    connect(m_multiDeviceCheck, &QCheckBox::toggled, m_targetList, &QListWidget::setVisible);
+    connect(m_multiDeviceCheck, &QCheckBox::toggled, this, &MainWindow::validateInputs);
+    connect(m_targetList, &QListWidget::itemChanged, this, &MainWindow::validateInputs);
     
     // File system options
     connect(m_fileSystemCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
             this, &MainWindow::fileSystemChanged);
     
+    // Advanced options
+    connect(m_verifyCheck, &QCheckBox::toggled, m_verifyWhileWritingCheck, &QCheckBox::setEnabled);
+    connect(m_verifyCheck, &QCheckBox::toggled, m_verifyBlake3Check, &QCheckBox::setEnabled);
+    connect(m_verifyCheck, &QCheckBox::toggled, m_quickVerifyCheck, &QCheckBox::setEnabled);
+    
     // Actions
     connect(m_startButton, &QPushButton::clicked, this, &MainWindow::startBurn);
     connect(m_cancelButton, &QPushButton::clicked, this, &MainWindow::cancelBurn);
+    connect(m_pauseButton, &QPushButton::clicked, this, &MainWindow::togglePause);
     connect(m_formatButton, &QPushButton::clicked, this, &MainWindow::formatDevice);
     connect(m_advancedToggle, &QPushButton::clicked, this, &MainWindow::toggleAdvancedOptions);
     connect(m_logButton, &QPushButton::clicked, this, &MainWindow::showLog);
@@ -322,18 +413,26 @@ void MainWindow::setupConnections()
     connect(m_burner, &Burner::speedChanged, this, &MainWindow::onSpeedChanged);
     connect(m_burner, &Burner::statusChanged, this, &MainWindow::onStatusChanged);
     connect(m_burner, &Burner::timeRemainingChanged, this, &MainWindow::onTimeRemainingChanged);
+    connect(m_burner, &Burner::timeRemainingRangeChanged, this, &MainWindow::onTimeRemainingRangeChanged);
     connect(m_burner, &Burner::error, this, &MainWindow::onBurnerError);
+    connect(m_burner, &Burner::verificationStarted, this, &MainWindow::onVerificationStarted);
+    connect(m_burner, &Burner::verificationFinished, this, &MainWindow::onVerificationFinished);
+    connect(m_burner, &Burner::deviceProgressChanged, this, &MainWindow::onDeviceProgressChanged);
+    connect(m_burner, &Burner::deviceFailed, this, &MainWindow::onDeviceFailed);
+    connect(m_burner, &Burner::deviceStatsChanged, this, &MainWindow::onDeviceStatsChanged);
 }
 
 void MainWindow::selectImage()
 {
     QStringList filters;
-    filters << "All Supported Images (*.iso *.img *.dmg *.vhd *.vhdx *.vmdk)"
+    QString compressed = ImageSource::compressedExtensions().join(" ");
+    filters << QString("All Supported Images (*.iso *.img *.dmg *.vhd *.vhdx *.vmdk %1)").arg(compressed)
             << "ISO Images (*.iso)"
             << "IMG Images (*.img)"
             << "DMG Images (*.dmg)"  
             << "VHD Images (*.vhd *.vhdx)"
             << "VMDK Images (*.vmdk)"
+            << QString("Compressed Images (%1)").arg(compressed)
             << "All Files (*)";
     
     QString fileName = QFileDialog::getOpenFileName(
@@ -409,9 +508,61 @@ void MainWindow::deviceSelectionChanged()
         m_deviceInfoLabel->setText("No device selected");
     }
     
+    updateTargetList();
     validateInputs();
 }
 
+void MainWindow::updateTargetList()
+{
+    // The list shows per-device progress while burning
+    if (m_isBurning) {
+        return;
+    }
+    
+    // Keep the user's choices across refreshes for devices that are still present
+    QStringList checked = additionalDevices();
+    
+    QSignalBlocker blocker(m_targetList);
+    m_targetList->clear();
+    
+    for (int i = 0; i < m_deviceCombo->count(); ++i) {
+        QString devicePath = m_deviceCombo->itemData(i).toString();
+        if (devicePath.isEmpty()) {
+            continue;
+        }
+        
+        QListWidgetItem *item = new QListWidgetItem(m_deviceCombo->itemText(i), m_targetList);
+        item->setData(Qt::UserRole, devicePath);
+        item->setData(Qt::UserRole + 1, m_deviceCombo->itemText(i));
+        
+        // The device picked above is always part of the burn
+        if (devicePath == m_selectedDevicePath) {
+            item->setFlags(Qt::ItemIsEnabled);
+            item->setCheckState(Qt::Checked);
+        } else {
+            item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+            item->setCheckState(checked.contains(devicePath) ? Qt::Checked : Qt::Unchecked);
+        }
+    }
+}
+
+QStringList MainWindow::additionalDevices() const
+{
+    QStringList devicePaths;
+    if (!m_multiDeviceCheck->isChecked()) {
+        return devicePaths;
+    }
+    
+    for (int i = 0; i < m_targetList->count(); ++i) {
+        QListWidgetItem *item = m_targetList->item(i);
+        QString devicePath = item->data(Qt::UserRole).toString();
+        if (item->checkState() == Qt::Checked && devicePath != m_selectedDevicePath) {
+            devicePaths << devicePath;
+        }
+    }
+    return devicePaths;
+}
+
 void MainWindow::fileSystemChanged()
 {
     QString fsType = m_fileSystemCombo->currentText();
@@ -436,12 +587,15 @@ void MainWindow::fileSystemChanged()
 
 void MainWindow::updateImageInfo()
 {
+    m_selectedBmapPath.clear();
+    
     if (m_selectedImagePath.isEmpty()) {
         m_imageInfoLabel->setText("Select an image file to see details");
         return;
     }
     
     ImageInfo info = m_imageHandler->analyzeImage(m_selectedImagePath);
+    m_selectedBmapPath = info.bmapPath;
     
     if (info.isValid) {
         QString infoText = QString("Size: %1\nType: %2\nBootable: %3")
@@ -461,6 +615,12 @@ void MainWindow::updateImageInfo()
             infoText += QString("\nBoot Loaders: %1").arg(info.bootLoaders.join(", "));
         }
         
+        if (!info.bmapPath.isEmpty()) {
+            infoText += QString("\nBlock Map: %1 mapped (%2%)")
+                       .arg(ImageHandler::formatSize(info.mappedBytes))
+                       .arg(info.mappedFraction * 100.0, 0, 'f', 1);
+        }
+        
         m_imageInfoLabel->setText(infoText);
     } else {
         m_imageInfoLabel->setText("Error: " + info.errorMessage);
@@ -503,19 +663,59 @@ void MainWindow::startBurn()
         return;
     }
     
-    // Show confirmation dialog
-    QMessageBox::StandardButton reply = QMessageBox::warning(
-        this, "Confirm Burn Operation",
-        QString("This will completely erase all data on %1.\n\n"
-                "Are you sure you want to continue?")
-                .arg(m_selectedDevicePath),
-        QMessageBox::Yes | QMessageBox::No);
-    
-    if (reply != QMessageBox::Yes) {
-        return;
+    for (const QString &devicePath : additionalDevices()) {
+        if (!Validation::validateBurnOptions(m_selectedImagePath, devicePath,
+                                            m_fileSystemCombo->currentText(),
+                                            m_volumeLabelEdit->text())) {
+            QStringList errors = Validation::getBurnOptionsErrors(m_selectedImagePath, devicePath,
+                                                                 m_fileSystemCombo->currentText(),
+                                                                 m_volumeLabelEdit->text());
+            
+            QMessageBox::warning(this, "Validation Error",
+                               QString("Cannot burn to %1:\n\n").arg(devicePath) + errors.join("\n"));
+            return;
+        }
     }
     
+    QStringList targets = QStringList() << m_selectedDevicePath << additionalDevices();
     BurnOptions options = getBurnOptions();
+    
+    // Offer to continue an interrupted burn of this image to the same devices
+    if (m_burner->findResumePoint(options)) {
+        // gzip and bzip2 images only know their size once fully decoded
+        qint64 imageSize = ImageSource::imageSize(m_selectedImagePath);
+        QMessageBox::StandardButton resume = QMessageBox::question(
+            this, "Resume Burn",
+            QString("An interrupted burn of this image to %1 was found, with %2 of %3 already written.\n\n"
+                    "Continue from there instead of starting over?")
+                    .arg(targets.join(", "))
+                    .arg(ImageHandler::formatSize(options.resumeOffset))
+                    .arg(imageSize >= 0 ? ImageHandler::formatSize(imageSize) : QString("the image")),
+            QMessageBox::Yes | QMessageBox::No | QMessageBox::Cancel);
+        
+        if (resume == QMessageBox::Cancel) {
+            return;
+        }
+        if (resume == QMessageBox::No) {
+            options.resumeOffset = 0;
+            options.resumeHash.clear();
+        }
+    }
+    
+    // Show confirmation dialog
+    if (options.resumeOffset == 0) {
+        QMessageBox::StandardButton reply = QMessageBox::warning(
+            this, "Confirm Burn Operation",
+            QString("This will completely erase all data on %1.\n\n"
+                    "Are you sure you want to continue?")
+                    .arg(targets.join(", ")),
+            QMessageBox::Yes | QMessageBox::No);
+        
+        if (reply != QMessageBox::Yes) {
+            return;
+        }
+    }
+    
     m_burner->burnImage(options);
     
     logMessage("Started burn operation", "INFO");
@@ -527,6 +727,19 @@ void MainWindow::cancelBurn()
     logMessage("Burn operation cancelled", "INFO");
 }
 
+void MainWindow::togglePause()
+{
+    if (m_burner->isPaused()) {
+        m_pauseButton->setText("Pause");
+        m_burner->resume();
+        logMessage("Burn operation resumed", "INFO");
+    } else {
+        m_pauseButton->setText("Resume");
+        m_burner->pause();
+        logMessage("Burn operation paused", "INFO");
+    }
+}
+
 void MainWindow::formatDevice()
 {
     if (m_selectedDevicePath.isEmpty()) {
@@ -591,6 +804,47 @@ void MainWindow::showDeviceInfo()
     }
 }
 
+void MainWindow::computeChecksums()
+{
+    if (m_selectedImagePath.isEmpty()) {
+        selectImage();
+        if (m_selectedImagePath.isEmpty()) {
+            return;
+        }
+    }
+    
+    // Every digest from one read of the image, off the UI thread
+    QString imagePath = m_selectedImagePath;
+    auto digests = QSharedPointer<QMap<QString, QString>>::create();
+    QThread *thread = QThread::create([imagePath, digests]() {
+        *digests = Utils::getFileDigests(imagePath, {"md5", "sha1", "sha256", "sha512", "blake3"});
+    });
+    
+    connect(thread, &QThread::finished, this, [this, thread, imagePath, digests]() {
+        thread->deleteLater();
+        m_checksumAction->setEnabled(true);
+        
+        if (digests->isEmpty()) {
+            logMessage("Could not read " + imagePath + " for checksums", "ERROR");
+            QMessageBox::warning(this, "Checksums", "Could not read " + imagePath);
+            return;
+        }
+        
+        QStringList lines;
+        for (auto it = digests->constBegin(); it != digests->constEnd(); ++it) {
+            lines << QString("%1: %2").arg(it.key().toUpper(), it.value());
+            logMessage(QString("%1 %2").arg(it.key(), it.value()), "INFO");
+        }
+        QMessageBox::information(this, "Checksums",
+                                 QFileInfo(imagePath).fileName() + "\n\n" + lines.join("\n"));
+    });
+    
+    m_checksumAction->setEnabled(false);
+    logMessage(QString("Computing checksums of %1 (BLAKE3 on %2 threads)")
+               .arg(imagePath).arg(QThreadPool::globalInstance()->maxThreadCount()), "INFO");
+    thread->start();
+}
+
 void MainWindow::showAbout()
 {
     QString aboutText = QString(
@@ -637,14 +891,19 @@ void MainWindow::onBurnStarted()
     m_isBurning = true;
     m_startButton->setEnabled(false);
     m_cancelButton->setEnabled(true);
+    m_pauseButton->setEnabled(true);
+    m_pauseButton->setText("Pause");
     m_formatButton->setEnabled(false);
     m_selectImageButton->setEnabled(false);
     m_refreshButton->setEnabled(false);
+    m_multiDeviceCheck->setEnabled(false);
+    m_targetList->setEnabled(false);
     
     m_progressBar->setValue(0);
     m_statusLabel->setText("Starting burn...");
     m_speedLabel->clear();
     m_timeLabel->clear();
+    m_timeLabel->setToolTip(QString());
     
     logMessage("Burn started", "INFO");
 }
@@ -654,16 +913,34 @@ void MainWindow::onBurnFinished(bool success, const QString &message)
     m_isBurning = false;
     m_startButton->setEnabled(true);
     m_cancelButton->setEnabled(false);
+    m_pauseButton->setEnabled(false);
+    m_pauseButton->setText("Pause");
     m_formatButton->setEnabled(true);
     m_selectImageButton->setEnabled(true);
     m_refreshButton->setEnabled(true);
+    m_multiDeviceCheck->setEnabled(true);
+    m_targetList->setEnabled(true);
     
     if (success) {
         m_progressBar->setValue(100);
-        m_statusLabel->setText("Burn completed successfully");
+        // A delta burn says how much it rewrote, or that there was nothing to do
+        m_statusLabel->setText(message);
         QMessageBox::information(this, "Burn Complete", 
-                               "The image has been successfully burned to the device.");
-        logMessage("Burn completed successfully", "SUCCESS");
+                               "The image has been successfully burned to the device.\n\n" + message);
+        logMessage(message, "SUCCESS");
+    } else if (!m_burner->mismatchedDevices().isEmpty()) {
+        // Verification found where the devices differ, so only that needs writing again
+        m_statusLabel->setText("Burn failed");
+        logMessage("Burn failed: " + message, "ERROR");
+        qint64 mb = qMax<qint64>(1, m_burner->mismatchedRanges().totalLength() / (1024 * 1024));
+        QMessageBox::StandardButton answer = QMessageBox::question(this, "Verification Failed",
+            QString("The burn operation failed:\n\n%1\n\nRewrite the %2 MB that differ on %3 and verify again?")
+            .arg(message).arg(mb).arg(m_burner->mismatchedDevices().join(", ")));
+        if (answer == QMessageBox::Yes) {
+            logMessage(QString("Repairing %1 MB on %2").arg(mb).arg(m_burner->mismatchedDevices().join(", ")), "INFO");
+            // The burner is still finishing the failed burn when it reports it
+            QTimer::singleShot(0, m_burner, &Burner::repair);
+        }
     } else {
         m_statusLabel->setText("Burn failed");
         QMessageBox::critical(this, "Burn Failed", 
@@ -674,6 +951,23 @@ void MainWindow::onBurnFinished(bool success, const QString &message)
     validateInputs();
 }
 
+void MainWindow::onVerificationStarted()
+{
+    // Verification cannot be paused, only cancelled
+    m_pauseButton->setEnabled(false);
+    m_progressBar->setValue(0);
+    m_speedLabel->clear();
+    m_timeLabel->clear();
+    m_timeLabel->setToolTip(QString());
+    
+    logMessage("Verifying written data", "INFO");
+}
+
+void MainWindow::onVerificationFinished(bool success, const QString &message)
+{
+    logMessage(message, success ? "SUCCESS" : "ERROR");
+}
+
 void MainWindow::onProgressChanged(int percentage)
 {
     m_progressBar->setValue(percentage);
@@ -695,12 +989,57 @@ void MainWindow::onTimeRemainingChanged(const QString &timeRemaining)
     m_timeLabel->setText("Time remaining: " + timeRemaining);
 }
 
+void MainWindow::onTimeRemainingRangeChanged(const QString &minimum, const QString &maximum)
+{
+    m_timeLabel->setToolTip(QString("Between %1 and %2 (90% confidence)").arg(minimum, maximum));
+}
+
 void MainWindow::onBurnerError(const QString &message)
 {
     logMessage("Burner error: " + message, "ERROR");
     QMessageBox::critical(this, "Burn Error", message);
 }
 
+void MainWindow::onDeviceProgressChanged(const QString &devicePath, int percentage, const QString &speed,
+                                         const QString &state)
+{
+    for (int i = 0; i < m_targetList->count(); ++i) {
+        QListWidgetItem *item = m_targetList->item(i);
+        if (item->data(Qt::UserRole).toString() == devicePath) {
+            QString text = QString("%1 - %2% %3").arg(item->data(Qt::UserRole + 1).toString()).arg(percentage).arg(state);
+            if (!speed.isEmpty() && state != "done") {
+                text += QString(" (%1)").arg(speed);
+            }
+            item->setText(text);
+        }
+    }
+}
+
+void MainWindow::onDeviceStatsChanged(const QString &devicePath, qint64 bytesWritten, int inFlight,
+                                      double queueDepth, double utilization)
+{
+    // Telemetry from the kernel's counters, next to the speed the burn reports
+    m_speedLabel->setToolTip(QString("%1: %2 MB written, %3 requests in flight, "
+                                     "average queue depth %4, %5% busy")
+                             .arg(devicePath)
+                             .arg(bytesWritten / (1024 * 1024))
+                             .arg(inFlight)
+                             .arg(queueDepth, 0, 'f', 1)
+                             .arg(qRound(utilization * 100)));
+}
+
+void MainWindow::onDeviceFailed(const QString &devicePath, const QString &message)
+{
+    for (int i = 0; i < m_targetList->count(); ++i) {
+        QListWidgetItem *item = m_targetList->item(i);
+        if (item->data(Qt::UserRole).toString() == devicePath) {
+            item->setText(QString("%1 - failed").arg(item->data(Qt::UserRole + 1).toString()));
+        }
+    }
+    
+    logMessage(QString("Device %1 failed: %2").arg(devicePath, message), "ERROR");
+}
+
 // Device manager event handlers
 void MainWindow::onDeviceListChanged()
 {
@@ -742,7 +1081,9 @@ BurnOptions MainWindow::getBurnOptions()
     
     options.imagePath = m_selectedImagePath;
     options.devicePath = m_selectedDevicePath;
-    options.mode = BurnMode::DDMode; // Default mode
+    options.additionalDevicePaths = additionalDevices();
+    options.bmapPath = m_selectedBmapPath;
+    options.mode = m_deltaWriteCheck->isChecked() ? BurnMode::DeltaMode : BurnMode::DDMode;
     
     // Parse partition scheme
     QString partitionScheme = m_partitionSchemeCombo->currentText();
@@ -759,9 +1100,24 @@ BurnOptions MainWindow::getBurnOptions()
     options.volumeLabel = m_volumeLabelEdit->text();
     options.quickFormat = m_quickFormatCheck->isChecked();
     options.verifyAfterBurn = m_verifyCheck->isChecked();
+    options.verifyWhileWriting = m_verifyWhileWritingCheck->isChecked();
+    options.verifyHash = m_verifyBlake3Check->isChecked() ? VerifyHash::Blake3 : VerifyHash::Sha256;
+    options.verifySample = m_quickVerifyCheck->isChecked() ? QuickVerifySample : 0.0;
     options.createBootableUSB = m_createBootableCheck->isChecked();
     options.badBlockCheck = m_badBlockCheck->isChecked();
     
+    // Write engine tuning; a queue depth of 1 selects plain pwrite unless autotuning
+    // tries deeper queues
+    options.autotune = m_blockSizeCombo->currentData().toInt() == 0;
+    if (!options.autotune) {
+        options.blockSize = m_blockSizeCombo->currentData().toInt();
+    }
+    options.queueDepth = m_queueDepthSpin->value();
+    options.writeBackend = options.queueDepth > 1 || options.autotune ? WriteBackend::Auto : WriteBackend::Pwrite;
+    options.bufferedWrites = m_bufferedWriteCheck->isChecked();
+    options.sparseMode = m_sparseWriteCheck->isChecked() ? SparseMode::Discard : SparseMode::Off;
+    options.recordSkippedRanges = options.verifyAfterBurn && options.sparseMode != SparseMode::Off;
+    
     // Parse cluster size
     QString clusterSizeText = m_clusterSizeCombo->currentText();
     QRegularExpression re("(\\d+)");
@@ -14,6 +14,8 @@
 #include <QTimer>
 #include <QLineEdit>
 #include <QCheckBox>
+#include <QSpinBox>
+#include <QListWidget>
 #include "../core/DeviceManager.h"
 #include "../core/ImageHandler.h"
 #include "../core/Burner.h"
@@ -43,8 +45,10 @@ private slots:
     void fileSystemChanged();
     void startBurn();
     void cancelBurn();
+    void togglePause();
     void formatDevice();
     void showDeviceInfo();
+    void computeChecksums();
     void showAbout();
     void showLog();
     void toggleAdvancedOptions();
@@ -56,7 +60,14 @@ private slots:
     void onSpeedChanged(const QString &speed);
     void onStatusChanged(const QString &status);
     void onTimeRemainingChanged(const QString &timeRemaining);
+    void onTimeRemainingRangeChanged(const QString &minimum, const QString &maximum);
     void onBurnerError(const QString &message);
+    void onVerificationStarted();
+    void onVerificationFinished(bool success, const QString &message);
+    void onDeviceProgressChanged(const QString &devicePath, int percentage, const QString &speed, const QString &state);
+    void onDeviceFailed(const QString &devicePath, const QString &message);
+    void onDeviceStatsChanged(const QString &devicePath, qint64 bytesWritten, int inFlight,
+                              double queueDepth, double utilization);
     
     // Device manager slots
     void onDeviceListChanged();
@@ -69,6 +80,8 @@ private:
     void setupStatusBar();
     void setupConnections();
     void updateDeviceList();
+    void updateTargetList();
+    QStringList additionalDevices() const;
     void updateImageInfo();
     void updateBurnOptions();
     void validateInputs();
@@ -90,6 +103,8 @@ private:
     QPushButton *m_refreshButton;
     QPushButton *m_deviceInfoButton;
     QLabel *m_deviceInfoLabel;
+    QCheckBox *m_multiDeviceCheck;
+    QListWidget *m_targetList;
     
     // File system options
     QGroupBox *m_fileSystemGroup;
@@ -104,8 +119,16 @@ private:
     QGroupBox *m_advancedGroup;
     QCheckBox *m_quickFormatCheck;
     QCheckBox *m_verifyCheck;
+    QCheckBox *m_verifyWhileWritingCheck;
+    QCheckBox *m_verifyBlake3Check;
+    QCheckBox *m_quickVerifyCheck;
     QCheckBox *m_createBootableCheck;
     QCheckBox *m_badBlockCheck;
+    QCheckBox *m_sparseWriteCheck;
+    QCheckBox *m_bufferedWriteCheck;
+    QCheckBox *m_deltaWriteCheck;
+    QComboBox *m_blockSizeCombo;
+    QSpinBox *m_queueDepthSpin;
     QPushButton *m_advancedToggle;
     
     // Progress
@@ -118,6 +141,7 @@ private:
     // Actions
     QPushButton *m_startButton;
     QPushButton *m_cancelButton;
+    QPushButton *m_pauseButton;
     QPushButton *m_formatButton;
     QPushButton *m_logButton;
     
@@ -127,6 +151,7 @@ private:
     
     // Menu and status
     QMenuBar *m_menuBar;
+    QAction *m_checksumAction;
     QStatusBar *m_statusBar;
     QLabel *m_statusBarLabel;
     
@@ -137,6 +162,7 @@ private:
     
     // State
     QString m_selectedImagePath;
+    QString m_selectedBmapPath;
     QString m_selectedDevicePath;
     bool m_isBurning;
     bool m_advancedVisible;
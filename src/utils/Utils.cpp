@@ -1,9 +1,10 @@
 #include "Utils.h"
+#include "core/MultiHasher.h"
+#include "core/ChecksumCache.h"
 #include <QFileInfo>
 #include <QDir>
 #include <QFile>
 #include <QProcess>
-#include <QCryptographicHash>
 #include <QRegularExpression>
 #include <QDateTime>
 #include <QStandardPaths>
@@ -305,32 +306,30 @@ qint64 Utils::getFileSize(const QString &filePath)
 
 QString Utils::getFileMD5(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return QString();
-    }
-    
-    QCryptographicHash hash(QCryptographicHash::Md5);
-    if (hash.addData(&file)) {
-        return hash.result().toHex();
-    }
-    
-    return QString();
+    return getFileDigests(filePath, {"md5"}).value("md5");
 }
 
 QString Utils::getFileSHA256(const QString &filePath)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return QString();
+    return getFileDigests(filePath, {"sha256"}).value("sha256");
+}
+
+QMap<QString, QString> Utils::getFileDigests(const QString &filePath, const QStringList &algorithms)
+{
+    QList<MultiHasher::Algorithm> wanted;
+    for (const QString &name : algorithms) {
+        MultiHasher::Algorithm algorithm;
+        if (MultiHasher::algorithmFromName(name, algorithm)) {
+            wanted << algorithm;
+        }
     }
     
-    QCryptographicHash hash(QCryptographicHash::Sha256);
-    if (hash.addData(&file)) {
-        return hash.result().toHex();
+    QMap<QString, QString> digests;
+    QMap<MultiHasher::Algorithm, QByteArray> results = ChecksumCache::hashFile(filePath, wanted);
+    for (auto it = results.constBegin(); it != results.constEnd(); ++it) {
+        digests.insert(MultiHasher::algorithmName(it.key()), QString::fromLatin1(it.value()));
     }
-    
-    return QString();
+    return digests;
 }
 
 QStringList Utils::getBlockDevices()
@@ -4,6 +4,7 @@
 #include <QString>
 #include <QStringList>
 #include <QDateTime>
+#include <QMap>
 
 class Utils
 {
@@ -48,6 +49,11 @@ public:
     static QString getFileMD5(const QString &filePath);
     static QString getFileSHA256(const QString &filePath);
     
+    // Hex digests by algorithm name (md5, sha1, sha256, sha512, blake3), all
+    // from a single read of the file, or none where ChecksumCache still has
+    // them; empty when it cannot be read
+    static QMap<QString, QString> getFileDigests(const QString &filePath, const QStringList &algorithms);
+    
     // Device utilities
     static QStringList getBlockDevices();
     static QStringList getRemovableDevices();
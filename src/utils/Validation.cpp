@@ -2,6 +2,7 @@
 #include "Utils.h"
 #include "../core/ImageHandler.h"
 #include "../core/FileSystemManager.h"
+#include "../core/ImageSource.h"
 #include <QFileInfo>
 #include <QFile>
 #include <QProcess>
@@ -136,7 +137,12 @@ bool Validation::isValidSize(qint64 size)
 
 bool Validation::isImageFitsOnDevice(const QString &imagePath, const QString &devicePath)
 {
-    qint64 imageSize = Utils::getFileSize(imagePath);
+    // gzip and bzip2 images do not record their size; a write that runs past
+    // the end of the device fails then instead
+    qint64 imageSize = ImageSource::imageSize(imagePath);
+    if (imageSize < 0) {
+        return true;
+    }
     
     QString deviceName = QFileInfo(devicePath).fileName();
     QString sizePath = QString("/sys/block/%1/size").arg(deviceName);
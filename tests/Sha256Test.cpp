@@ -0,0 +1,115 @@
+#include "core/Sha256.h"
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QList>
+#include <stdio.h>
+
+// FIPS 180-2 examples, besides comparing with QCryptographicHash below
+struct Vector {
+    QByteArray input;
+    const char *digest;
+};
+
+static int check(const char *feed, qint64 length, const QByteArray &digest, const QByteArray &expected)
+{
+    if (digest == expected) {
+        return 0;
+    }
+    fprintf(stderr, "FAIL %s (%s), %lld bytes: %s, expected %s\n", feed,
+            qPrintable(Sha256::implementationName()), length,
+            digest.toHex().constData(), expected.toHex().constData());
+    return 1;
+}
+
+// Not a repeating pattern, so a block processed twice or out of order shows
+static QByteArray input(qint64 length)
+{
+    QByteArray data(int(length), 0);
+    quint32 state = 2463534242u;
+    for (qint64 i = 0; i < length; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        data[int(i)] = char(state);
+    }
+    return data;
+}
+
+static int checkAll()
+{
+    int failures = 0;
+    
+    const Vector vectors[] = {
+        {QByteArray(), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {QByteArray("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {QByteArray("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {QByteArray(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+    for (const Vector &vector : vectors) {
+        failures += check("FIPS 180-2", vector.input.size(), Sha256::hash(vector.input),
+                          QByteArray::fromHex(vector.digest));
+    }
+    
+    // Every length around the 55 and 56 bytes where padding spills into a
+    // second block, several blocks, and a long odd one
+    QList<qint64> lengths;
+    for (qint64 length = 0; length <= 300; ++length) {
+        lengths << length;
+    }
+    lengths << 511 << 512 << 513 << 4095 << 4096 << 4097 << 1000003;
+    
+    for (qint64 length : lengths) {
+        QByteArray data = input(length);
+        QByteArray expected = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+        
+        Sha256 whole;
+        whole.addData(data.constData(), length);
+        failures += check("one addData", length, whole.result(), expected);
+        
+        // Uneven pieces leave the block part filled between calls
+        Sha256 pieces;
+        for (qint64 done = 0, piece = 1; done < length; piece = piece % 67 + 2) {
+            qint64 count = qMin(piece, length - done);
+            pieces.addData(data.constData() + done, count);
+            done += count;
+        }
+        failures += check("addData in pieces", length, pieces.result(), expected);
+        
+        // Two calls, split anywhere in the first two blocks
+        for (qint64 split = 1; split < qMin<qint64>(length, 130); split += 1 + length % 3) {
+            Sha256 halves;
+            halves.addData(data.constData(), split);
+            halves.addData(data.constData() + split, length - split);
+            failures += check("split addData", length, halves.result(), expected);
+        }
+        
+        // reset() forgets what came before
+        Sha256 reused;
+        reused.addData("something else", 14);
+        reused.reset();
+        reused.addData(data);
+        failures += check("after reset()", length, reused.result(), expected);
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    printf("SHA instructions: %s\n", Sha256::isAccelerated() ? "yes" : "no");
+    
+    // Both paths where the CPU has the instructions; QCryptographicHash alone otherwise
+    for (bool accelerated : {true, false}) {
+        Sha256::setAccelerationEnabled(accelerated);
+        printf("Checking %s\n", qPrintable(Sha256::implementationName()));
+        failures += checkAll();
+    }
+    
+    if (failures > 0) {
+        fprintf(stderr, "%d SHA-256 checks failed\n", failures);
+        return 1;
+    }
+    printf("All SHA-256 checks passed\n");
+    return 0;
+}